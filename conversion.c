@@ -0,0 +1,59 @@
+#include "image.h"
+#include <dirent.h>
+#include <string.h>
+#include <stdlib.h>
+
+//conversion d'un répertoire PPM / PGM vers le cache sans perte QOI (nrio.h) :
+//./conversion repertoire_source repertoire_destination => x.ppm / x.pgm deviennent x.qoi
+//les PPM restent en couleur (QOI standard), les PGM en gris (variante canaux = 1)
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        printf("usage : %s repertoire_source repertoire_destination\n", argv[0]);
+        return 1;
+    }
+    DIR *dir = opendir(argv[1]);
+    if (!dir) {
+        printf("erreur => : %s\n", argv[1]);
+        return 1;
+    }
+    int nb = 0, erreurs = 0;
+    //matrices de même taille d'un fichier à l'autre => reprises dans la réserve de nralloc
+    nrpool_init(0, 0);
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        int image_type = image_type_depuis_nom(entry->d_name);
+        if (image_type != IMAGE_TYPE_PPM && image_type != IMAGE_TYPE_PGM) continue;
+
+        char source[512], destination[512];
+        snprintf(source, sizeof(source), "%s/%s", argv[1], entry->d_name);
+        const char *point = strrchr(entry->d_name, '.');
+        snprintf(destination, sizeof(destination), "%s/%.*s.qoi", argv[2], (int)(point - entry->d_name), entry->d_name);
+
+        long nrl, nrh, ncl, nch;
+        int code = PNM_ERR_FICHIER;
+        if (image_type == IMAGE_TYPE_PPM) {
+            rgb8 **m = LoadPPM_rgb8matrix(source, &nrl, &nrh, &ncl, &nch);
+            if (m) {
+                code = SaveQOI_rgb8matrix(m, nrl, nrh, ncl, nch, destination);
+                free_rgb8matrix(m, nrl, nrh, ncl, nch);
+            }
+        } else {
+            byte **m = LoadPGM_bmatrix(source, &nrl, &nrh, &ncl, &nch);
+            if (m) {
+                code = SaveQOI_bmatrix(m, nrl, nrh, ncl, nch, destination);
+                free_bmatrix(m, nrl, nrh, ncl, nch);
+            }
+        }
+        if (code != PNM_OK) {
+            printf("Erreur conversion: %s (%s)\n", source, PNMerror(code));
+            erreurs++;
+            continue;
+        }
+        nb++;
+    }
+    closedir(dir);
+    nrpool_release();
+    printf("%d images converties, %d erreurs\n", nb, erreurs);
+    return erreurs != 0;
+}
@@ -0,0 +1,316 @@
+#define _GNU_SOURCE // qsort_r (glibc, musl)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "enumeration.h"
+#include "image.h"
+
+#if defined(__linux__) && defined(SYS_getdents64)
+#define ENUM_AVEC_GETDENTS 1
+//enregistrement rendu par getdents64 (pas de déclaration dans la glibc avant 2.30)
+struct dirent64_noyau {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+//file commune des répertoires à lire
+typedef struct {
+    pthread_mutex_t verrou;
+    pthread_cond_t travail;
+    char **file;
+    long nb_file, cap_file;
+    long actifs;          // répertoires en file ou en cours de lecture => 0 = parcours terminé
+    int mode;
+    int memoire;          // une allocation a échoué quelque part
+} Enumeration;
+
+//résultats d'un thread, fusionnés à la fin => aucun verrou par fichier
+typedef struct {
+    Enumeration *e;
+    char *chemins;
+    size_t taille, cap;
+    EntreeChemin *entrees;
+    long nb, cap_entrees;
+    long erreurs;
+    char *tampon;
+} Travailleur;
+
+static int pousser_repertoire(Enumeration *e, const char *chemin) {
+    char *copie = strdup(chemin);
+    pthread_mutex_lock(&e->verrou);
+    if (copie && e->nb_file == e->cap_file) {
+        long cap = e->cap_file ? 2 * e->cap_file : 64;
+        char **f = (char**) realloc(e->file, (size_t) cap * sizeof(char*));
+        if (f) {
+            e->file = f;
+            e->cap_file = cap;
+        }
+    }
+    int ok = copie && e->nb_file < e->cap_file;
+    if (ok) {
+        e->file[e->nb_file++] = copie;
+        e->actifs++;
+        pthread_cond_signal(&e->travail);
+    } else {
+        e->memoire = 1;
+        free(copie);
+    }
+    pthread_mutex_unlock(&e->verrou);
+    return ok ? 0 : -1;
+}
+
+//plusieurs threads peuvent échouer en même temps => sous le verrou de la file
+static void signaler_memoire(Enumeration *e) {
+    pthread_mutex_lock(&e->verrou);
+    e->memoire = 1;
+    pthread_mutex_unlock(&e->verrou);
+}
+
+static void ajouter_image(Travailleur *t, const char *chemin, uint64_t inode, int image_type) {
+    size_t l = strlen(chemin) + 1;
+    if (t->taille + l > t->cap) {
+        size_t cap = t->cap ? 2 * t->cap : 65536;
+        while (cap < t->taille + l) cap *= 2;
+        char *p = (char*) realloc(t->chemins, cap);
+        if (!p) { signaler_memoire(t->e); return; }
+        t->chemins = p;
+        t->cap = cap;
+    }
+    if (t->nb == t->cap_entrees) {
+        long cap = t->cap_entrees ? 2 * t->cap_entrees : 1024;
+        EntreeChemin *p = (EntreeChemin*) realloc(t->entrees, (size_t) cap * sizeof(EntreeChemin));
+        if (!p) { signaler_memoire(t->e); return; }
+        t->entrees = p;
+        t->cap_entrees = cap;
+    }
+    memcpy(t->chemins + t->taille, chemin, l);
+    t->entrees[t->nb].inode = inode;
+    t->entrees[t->nb].chemin = t->taille;
+    t->entrees[t->nb].image_type = image_type;
+    t->nb++;
+    t->taille += l;
+}
+
+//premiers octets du fichier => type réel, -1 si ce n'est pas une image lisible
+static int verifier_magie(int fd_rep, const char *nom) {
+    byte entete[16];
+    int fd = openat(fd_rep, nom, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = pread(fd, entete, sizeof(entete), 0);
+    close(fd);
+    if (n <= 0) return -1;
+    return image_type_depuis_magie(entete, (size_t) n);
+}
+
+static void traiter_entree(Travailleur *t, int fd_rep, const char *rep, const char *nom, int type, uint64_t inode) {
+    if (nom[0] == '.' && (nom[1] == '\0' || (nom[1] == '.' && nom[2] == '\0'))) return;
+    if (type == DT_UNKNOWN || type == DT_LNK) {
+        //pas de d_type (certains systèmes de fichiers) ou lien : un stat pour trancher
+        struct stat st;
+        if (fstatat(fd_rep, nom, &st, AT_SYMLINK_NOFOLLOW) != 0) return;
+        if (S_ISLNK(st.st_mode)) {
+            //lien suivi vers un fichier seulement => pas de cycle possible
+            if (fstatat(fd_rep, nom, &st, 0) != 0 || !S_ISREG(st.st_mode)) return;
+            type = DT_REG;
+        } else if (S_ISDIR(st.st_mode)) {
+            type = DT_DIR;
+        } else if (S_ISREG(st.st_mode)) {
+            type = DT_REG;
+        } else {
+            return;
+        }
+    }
+    if (type != DT_DIR && type != DT_REG) return;
+    int image_type = -1;
+    if (type == DT_REG) {
+        image_type = image_type_depuis_nom(nom);
+        if (image_type < 0) return;
+    }
+
+    char chemin[4096];
+    size_t l = strlen(rep);
+    int n = (l > 0 && rep[l - 1] == '/') ? snprintf(chemin, sizeof(chemin), "%s%s", rep, nom)
+                                          : snprintf(chemin, sizeof(chemin), "%s/%s", rep, nom);
+    if (n < 0 || (size_t) n >= sizeof(chemin)) {
+        t->erreurs++;
+        return;
+    }
+    if (type == DT_DIR) {
+        pousser_repertoire(t->e, chemin);
+        return;
+    }
+    if (t->e->mode == ENUM_MAGIE) {
+        image_type = verifier_magie(fd_rep, nom);
+        if (image_type < 0) return;
+    }
+    ajouter_image(t, chemin, inode, image_type);
+}
+
+static void lire_repertoire(Travailleur *t, const char *rep) {
+    int fd = open(rep, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        t->erreurs++;
+        return;
+    }
+#ifdef ENUM_AVEC_GETDENTS
+    for (;;) {
+        long n = syscall(SYS_getdents64, fd, t->tampon, ENUM_TAMPON);
+        if (n <= 0) {
+            if (n < 0) t->erreurs++;
+            break;
+        }
+        for (long pos = 0; pos < n;) {
+            struct dirent64_noyau *d = (struct dirent64_noyau*) (t->tampon + pos);
+            pos += d->d_reclen;
+            traiter_entree(t, fd, rep, d->d_name, d->d_type, d->d_ino);
+        }
+    }
+    close(fd);
+#else
+    DIR *dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        t->erreurs++;
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) traiter_entree(t, fd, rep, entry->d_name, entry->d_type, entry->d_ino);
+    closedir(dir);
+#endif
+}
+
+static void *enumeration_thread(void *arg) {
+    Travailleur *t = (Travailleur*) arg;
+    Enumeration *e = t->e;
+    for (;;) {
+        pthread_mutex_lock(&e->verrou);
+        while (e->nb_file == 0 && e->actifs > 0) pthread_cond_wait(&e->travail, &e->verrou);
+        if (e->nb_file == 0) {
+            pthread_mutex_unlock(&e->verrou);
+            break;
+        }
+        char *rep = e->file[--e->nb_file];
+        pthread_mutex_unlock(&e->verrou);
+
+        lire_repertoire(t, rep);
+        free(rep);
+
+        pthread_mutex_lock(&e->verrou);
+        if (--e->actifs == 0) pthread_cond_broadcast(&e->travail);
+        pthread_mutex_unlock(&e->verrou);
+    }
+    return NULL;
+}
+
+//ordre du disque ; liens durs (même inode) départagés par le chemin => résultat indépendant des threads
+//bloc de chemins passé en contexte (qsort_r) => pas de variable globale, enumerer_images réentrante
+static int comparer_entrees(const void *a, const void *b, void *contexte) {
+    const EntreeChemin *x = (const EntreeChemin*) a, *y = (const EntreeChemin*) b;
+    const char *chemins = (const char*) contexte;
+    if (x->inode != y->inode) return (x->inode < y->inode) ? -1 : 1;
+    return strcmp(chemins + x->chemin, chemins + y->chemin);
+}
+
+int enumerer_images(const char *const *racines, int nb_racines, int nb_threads, int mode, TableChemins *table) {
+    memset(table, 0, sizeof(*table));
+    if (nb_threads <= 0) nb_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (nb_threads < 1) nb_threads = 1;
+
+    Enumeration e;
+    memset(&e, 0, sizeof(e));
+    e.mode = mode;
+    pthread_mutex_init(&e.verrou, NULL);
+    pthread_cond_init(&e.travail, NULL);
+
+    int code = PNM_OK;
+    for (int r = 0; r < nb_racines && code == PNM_OK; r++) {
+        struct stat st;
+        if (stat(racines[r], &st) != 0 || !S_ISDIR(st.st_mode)) code = PNM_ERR_FICHIER;
+        else if (pousser_repertoire(&e, racines[r]) != 0) code = PNM_ERR_MEMOIRE;
+    }
+
+    Travailleur *tr = (Travailleur*) calloc((size_t) nb_threads, sizeof(Travailleur));
+    pthread_t *threads = (pthread_t*) malloc((size_t) nb_threads * sizeof(pthread_t));
+    if (!tr || !threads) code = PNM_ERR_MEMOIRE;
+    int lances = 0;
+    if (code == PNM_OK) {
+        for (int i = 0; i < nb_threads; i++) {
+            tr[i].e = &e;
+            tr[i].tampon = (char*) malloc(ENUM_TAMPON);
+            if (!tr[i].tampon) break;
+            //le thread appelant fait le travailleur 0
+            if (i > 0 && pthread_create(&threads[i], NULL, enumeration_thread, &tr[i]) != 0) {
+                free(tr[i].tampon);
+                tr[i].tampon = NULL;
+                break;
+            }
+            lances++;
+        }
+        if (lances == 0) code = PNM_ERR_MEMOIRE;
+        else enumeration_thread(&tr[0]);
+        for (int i = 1; i < lances; i++) pthread_join(threads[i], NULL);
+    }
+    for (long i = 0; i < e.nb_file; i++) free(e.file[i]); //restes si aucun thread n'a démarré
+    free(e.file);
+    pthread_mutex_destroy(&e.verrou);
+    pthread_cond_destroy(&e.travail);
+    if (code == PNM_OK && e.memoire) code = PNM_ERR_MEMOIRE;
+
+    //fusion des résultats des threads en une seule table
+    if (code == PNM_OK) {
+        size_t taille = 0;
+        long nb = 0;
+        for (int i = 0; i < lances; i++) {
+            taille += tr[i].taille;
+            nb += tr[i].nb;
+        }
+        table->chemins = (char*) malloc(taille ? taille : 1);
+        table->entrees = (EntreeChemin*) malloc((size_t) (nb ? nb : 1) * sizeof(EntreeChemin));
+        if (!table->chemins || !table->entrees) code = PNM_ERR_MEMOIRE;
+        for (int i = 0; i < lances && code == PNM_OK; i++) {
+            memcpy(table->chemins + table->taille_chemins, tr[i].chemins, tr[i].taille);
+            for (long k = 0; k < tr[i].nb; k++) {
+                EntreeChemin ec = tr[i].entrees[k];
+                ec.chemin += table->taille_chemins;
+                table->entrees[table->nb++] = ec;
+            }
+            table->taille_chemins += tr[i].taille;
+            table->erreurs += tr[i].erreurs;
+        }
+        if (code == PNM_OK) {
+            qsort_r(table->entrees, (size_t) table->nb, sizeof(EntreeChemin), comparer_entrees, table->chemins);
+        }
+    }
+    if (tr) {
+        for (int i = 0; i < nb_threads; i++) {
+            free(tr[i].chemins);
+            free(tr[i].entrees);
+            free(tr[i].tampon);
+        }
+    }
+    free(tr);
+    free(threads);
+    if (code != PNM_OK) table_liberer(table);
+    return code;
+}
+
+const char *table_chemin(const TableChemins *table, long i) {
+    return table->chemins + table->entrees[i].chemin;
+}
+
+void table_liberer(TableChemins *table) {
+    free(table->chemins);
+    free(table->entrees);
+    memset(table, 0, sizeof(*table));
+}
@@ -0,0 +1,37 @@
+#ifndef ENUMERATION_H
+#define ENUMERATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//énumération des images sous une ou plusieurs racines, sous-répertoires compris :
+//chaque thread prend un répertoire dans une file commune, le lit par getdents64 avec un grand tampon
+//(readdir hors Linux) et y remet les sous-répertoires trouvés => les arbres profonds ou larges sont
+//parcourus en parallèle, sans stat par fichier quand le système de fichiers renseigne d_type
+//résultat : table compacte (un seul bloc de chemins) triée par inode => lecture dans l'ordre du disque
+#define ENUM_SUFFIXE 0  // type d'après l'extension seule (aucune ouverture de fichier)
+#define ENUM_MAGIE   1  // extension candidate confirmée par les premiers octets, type pris dans le fichier
+
+#define ENUM_TAMPON  (256 * 1024)  // octets par appel getdents64
+
+typedef struct {
+    uint64_t inode;
+    size_t chemin;        // position du chemin dans TableChemins.chemins
+    int image_type;       // IMAGE_TYPE_*
+} EntreeChemin;
+
+typedef struct {
+    char *chemins;        // chemins terminés par '\0', les uns à la suite des autres
+    size_t taille_chemins;
+    EntreeChemin *entrees;
+    long nb;
+    long erreurs;         // sous-répertoires illisibles (ignorés)
+} TableChemins;
+
+//nb_threads <= 0 => autant que de cœurs ; liens symboliques vers des fichiers suivis, pas vers des répertoires
+//retourne PNM_OK, PNM_ERR_FICHIER si une racine est illisible ou PNM_ERR_MEMOIRE (codes de nrio.h)
+int  enumerer_images(const char *const *racines, int nb_racines, int nb_threads, int mode, TableChemins *table);
+const char *table_chemin(const TableChemins *table, long i);
+void table_liberer(TableChemins *table);
+
+#endif
@@ -1,5 +1,6 @@
 #include "image.h"
-#include <dirent.h>
+#include "enumeration.h"
+#include "table.h"
 #include <string.h>
 
 // Structure pour stocker nom et score d'une image
@@ -47,57 +48,61 @@ int main() {
     DistanceFunc dist_func = distance_bhattacharyya;
     ImageData score[100];  //tableau de scoires
     int num_images = 0;
+    TableFeatures features; //caractéristiques en colonnes (table.h), scorées en une passe après l'extraction
+    if (table_features_init(&features, 100) != 0) {
+        printf("Erreur allocation mémoire\n");
+        return 1;
+    }
     
-    // Parcourir chaque répertoire
-    for (int d = 0; d < num_dirs; d++) {
-        DIR *dir = opendir(directories[d]);
-        if (!dir) {
-            printf("Erreur ouverture répertoire: %s\n", directories[d]);
+    // Parcourir les répertoires (sous-répertoires compris, voir enumeration.h)
+    TableChemins table;
+    if (enumerer_images(directories, num_dirs, 0, ENUM_SUFFIXE, &table) != PNM_OK) {
+        printf("Erreur ouverture répertoire: %s\n", directories[0]);
+        return 1;
+    }
+    //pas d'arène ici : tampons des images gardés par classe de taille et réutilisés (nralloc.h)
+    nrpool_init(0, 0);
+    for (long i = 0; i < table.nb; i++) {
+        const char *full_path = table_chemin(&table, i);
+        int image_type = table.entrees[i].image_type;
+        if (image_type != IMAGE_TYPE_PGM && image_type != IMAGE_TYPE_PPM) continue;  // Ignorer les autres formats
+
+        // Extraire les caractéristiques de l'image courante
+        ImageFeatures feat_curr;
+        if (extraire_features_from_file(full_path, &feat_curr, 0, 0.25, image_type) != 0) {
+            printf("Erreur extraction: %s\n", full_path);
             continue;
         }
-        
-        struct dirent *entry;
-        while ((entry = readdir(dir)) != NULL) {
-            // Ignorer . et ..
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
-            
-            // Construire le chemin complet
-            char full_path[512];
-            snprintf(full_path, sizeof(full_path), "%s/%s", directories[d], entry->d_name);
-            
-            // Déterminer le type d'image
-            int image_type = -1;
-            if (strstr(entry->d_name, ".pgm")) image_type = IMAGE_TYPE_PGM;
-            else if (strstr(entry->d_name, ".ppm")) image_type = IMAGE_TYPE_PPM;
-            else continue;  // Ignorer les fichiers non image
-            
-            // Extraire les caractéristiques de l'image courante
-            ImageFeatures feat_curr;
-            if (extraire_features_from_file(full_path, &feat_curr, 0, 0.25, image_type) != 0) {
-                printf("Erreur extraction: %s\n", full_path);
-                continue;
-            }
-            
-            // Calculer le score de similarité
-            double current_score = evaluate_score(&feat_ref, &feat_curr, dist_func,
-                                                 weight_hist, weight_r, weight_g, weight_b,
-                                                 weight_norm, weight_contour, weight_color);
-            
-            // Stocker dans le tableau score
-            strcpy(score[num_images].filename, full_path);
-            score[num_images].score = current_score;
-            num_images++;
-            
-            // Vérifier la taille max
-            if (num_images >= 100) {
-                printf("Trop d'images, arrêt à 100\n");
-                break;
-            }
+
+        if (table_features_ajouter(&features, full_path, &feat_curr) < 0) {
+            printf("Erreur allocation mémoire\n");
+            break;
+        }
+
+        // Vérifier la taille max
+        if (features.nb >= 100) {
+            printf("Trop d'images, arrêt à 100\n");
+            break;
         }
-        
-        closedir(dir);
-        if (num_images >= 100) break;
     }
+    table_liberer(&table);
+    NRpoolStats reserve;
+    nrpool_stats(&reserve);
+    fprintf(stderr, "réserve : %ld réutilisés, %ld malloc, pic %zu Ko\n",
+            reserve.nb_succes, reserve.nb_echecs, reserve.pic >> 10);
+    nrpool_release();
+
+    // Scores de similarité de toutes les images d'un coup, colonne par colonne
+    double scores[100];
+    table_features_scores(&features, &feat_ref, dist_func,
+                          weight_hist, weight_r, weight_g, weight_b,
+                          weight_norm, weight_contour, weight_color, scores);
+    for (long i = 0; i < features.nb; i++) {
+        snprintf(score[num_images].filename, sizeof(score[num_images].filename), "%s", table_features_chemin(&features, i));
+        score[num_images].score = scores[i];
+        num_images++;
+    }
+    table_features_liberer(&features);
     
     //ranking
     sort_ranking(score, num_images);
@@ -1,8 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <math.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "image.h"
+#include "simd.h"
+#include "jpeg.h"
+#include "png.h"
 
 
 //utilitaire à déplacer static pour limiter la visibilité de cette fonctiion dans ce fichier ... mais inline ici est utile, au lieu d'appeler la fonction on remplace l'appel par le corps de la fonction dans la fonction précise.
@@ -17,26 +24,20 @@ byte **load_pgm_gray(const char *filename, long *nrl, long *nrh, long *ncl, long
     return LoadPGM_bmatrix((char*)filename, nrl, nrh, ncl, nch);
 }
 
-//Charge une image PPM couleur=>  convertit en gris, calcule ratios RGB et détecte couleur
-rgb8 **load_ppm_rgb_and_to_gray(const char *filename,
-                                long *nrl, long *nrh, long *ncl, long *nch,
-                                byte ***pgray,
-                                double *r_ratio, double *g_ratio, double *b_ratio,
-                                int *is_color) {
-
-    rgb8 **rgb = LoadPPM_rgb8matrix((char*)filename, nrl, nrh, ncl, nch);
-    if (!rgb) return NULL;
-
+//conversion en gris + ratios + détection couleur, commune au PPM et au jpeg
+static void rgb_vers_gris_ratios(rgb8 **rgb, long nrl, long nrh, long ncl, long nch,
+                                 byte ***pgray, double *r_ratio, double *g_ratio, double *b_ratio,
+                                 int *is_color) {
     long i, j;
     //sortie matrice en niveau de gris 
-    *pgray = bmatrix(*nrl, *nrh, *ncl, *nch);
+    *pgray = bmatrix(nrl, nrh, ncl, nch);
 
     //initialisation
     uint64_t Rsum = 0, Gsum = 0, Bsum = 0;
 
     //parcours image
-    for (i = *nrl; i <= *nrh; i++) {
-        for (j = *ncl; j <= *nch; j++) {
+    for (i = nrl; i <= nrh; i++) {
+        for (j = ncl; j <= nch; j++) {
             //
             Rsum += rgb[i][j].r;
             Gsum += rgb[i][j].g;
@@ -59,113 +60,302 @@ rgb8 **load_ppm_rgb_and_to_gray(const char *filename,
     }
 
     //détecte si image couleur est vraiment noir et blanc
-    *is_color = verifier_image_couleur_est_nb(Rsum, Gsum, Bsum, *nrl, *nrh, *ncl, *nch);
+    *is_color = verifier_image_couleur_est_nb(Rsum, Gsum, Bsum, nrl, nrh, ncl, nch);
+}
+
+//Charge une image PPM couleur=>  convertit en gris, calcule ratios RGB et détecte couleur
+rgb8 **load_ppm_rgb_and_to_gray(const char *filename,
+                                long *nrl, long *nrh, long *ncl, long *nch,
+                                byte ***pgray,
+                                double *r_ratio, double *g_ratio, double *b_ratio,
+                                int *is_color) {
 
+    rgb8 **rgb = LoadPPM_rgb8matrix((char*)filename, nrl, nrh, ncl, nch);
+    if (!rgb) return NULL;
+    rgb_vers_gris_ratios(rgb, *nrl, *nrh, *ncl, *nch, pgray, r_ratio, g_ratio, b_ratio, is_color);
     return rgb;
 }
 
+//fichier complet en mémoire (jpeg / png compressés : petits), NULL si illisible
+static byte *charger_fichier(const char *filename, size_t *taille) {
+    FILE *f = fopen(filename, "rb");
+    if (!f) return NULL;
+    byte *donnees = NULL;
+    long n = -1;
+    if (fseek(f, 0, SEEK_END) == 0) n = ftell(f);
+    if (n > 0 && fseek(f, 0, SEEK_SET) == 0) donnees = (byte*)malloc((size_t)n);
+    if (donnees && fread(donnees, 1, (size_t)n, f) != (size_t)n) {
+        free(donnees);
+        donnees = NULL;
+    }
+    fclose(f);
+    *taille = (size_t)n;
+    return donnees;
+}
+
+byte **load_jpeg_gray(const char *filename, long *nrl, long *nrh, long *ncl, long *nch,
+                      double *r_ratio, double *g_ratio, double *b_ratio, int *is_color) {
+    size_t taille;
+    byte *donnees = charger_fichier(filename, &taille);
+    if (!donnees) return NULL;
+    ImageJPEG img;
+    int code = jpeg_decoder(donnees, taille, JPEG_ECHELLE_PLEINE, r_ratio == NULL, &img);
+    free(donnees);
+    if (code != PNM_OK) return NULL;
+
+    *nrl = 0; *nrh = img.height - 1;
+    *ncl = 0; *nch = img.width - 1;
+    byte **gray = NULL;
+    if (r_ratio) {
+        *r_ratio = *g_ratio = *b_ratio = 1.0 / 3.0;
+        *is_color = 0;
+    }
+    if (img.ncanal == 1) {
+        gray = bmatrix(*nrl, *nrh, *ncl, *nch);
+        for (long i = 0; i < img.height; i++) memcpy(gray[i], img.pixels + i * img.width, (size_t)img.width);
+    } else {
+        rgb8 **rgb = rgb8matrix(*nrl, *nrh, *ncl, *nch);
+        for (long i = 0; i < img.height; i++) memcpy(rgb[i], img.pixels + 3 * i * img.width, 3 * (size_t)img.width);
+        rgb_vers_gris_ratios(rgb, *nrl, *nrh, *ncl, *nch, &gray, r_ratio, g_ratio, b_ratio, is_color);
+        free_rgb8matrix(rgb, *nrl, *nrh, *ncl, *nch);
+    }
+    jpeg_liberer(&img);
+    return gray;
+}
+
+byte **load_png_gray(const char *filename, long *nrl, long *nrh, long *ncl, long *nch,
+                     double *r_ratio, double *g_ratio, double *b_ratio, int *is_color) {
+    size_t taille;
+    byte *donnees = charger_fichier(filename, &taille);
+    if (!donnees) return NULL;
+    PNGflux flux;
+    if (png_ouvrir(donnees, taille, &flux) != PNM_OK) {
+        free(donnees);
+        return NULL;
+    }
+    *nrl = 0; *nrh = flux.height - 1;
+    *ncl = 0; *nch = flux.width - 1;
+    byte **gray = NULL;
+    rgb8 **rgb = NULL;
+    *r_ratio = *g_ratio = *b_ratio = 1.0 / 3.0;
+    *is_color = 0;
+    if (flux.ncanal == 1) gray = bmatrix(*nrl, *nrh, *ncl, *nch);
+    else rgb = rgb8matrix(*nrl, *nrh, *ncl, *nch);
+    int code = PNM_OK;
+    for (long i = 0; i < flux.height && code == PNM_OK; i++) {
+        const byte *ligne;
+        code = png_ligne_suivante(&flux, &ligne);
+        if (code != PNM_OK) break;
+        if (gray) memcpy(gray[i], ligne, (size_t)flux.width);
+        else memcpy(rgb[i], ligne, 3 * (size_t)flux.width);
+    }
+    png_fermer(&flux);
+    free(donnees);
+    if (code != PNM_OK) {
+        if (gray) free_bmatrix(gray, *nrl, *nrh, *ncl, *nch);
+        if (rgb) free_rgb8matrix(rgb, *nrl, *nrh, *ncl, *nch);
+        return NULL;
+    }
+    if (rgb) {
+        rgb_vers_gris_ratios(rgb, *nrl, *nrh, *ncl, *nch, &gray, r_ratio, g_ratio, b_ratio, is_color);
+        free_rgb8matrix(rgb, *nrl, *nrh, *ncl, *nch);
+    }
+    return gray;
+}
+
+byte **load_qoi_gray(const char *filename, long *nrl, long *nrh, long *ncl, long *nch,
+                     double *r_ratio, double *g_ratio, double *b_ratio, int *is_color) {
+    QOIstream flux;
+    if (MapQOI((char*)filename, &flux) != PNM_OK) return NULL;
+    *nrl = 0; *nrh = flux.height - 1;
+    *ncl = 0; *nch = flux.width - 1;
+    byte **gray = NULL;
+    rgb8 **rgb = NULL;
+    *r_ratio = *g_ratio = *b_ratio = 1.0 / 3.0;
+    *is_color = 0;
+    if (flux.ncanal == 1) gray = bmatrix(*nrl, *nrh, *ncl, *nch);
+    else rgb = rgb8matrix(*nrl, *nrh, *ncl, *nch);
+    int code = PNM_OK;
+    for (long i = 0; i < flux.height && code == PNM_OK; i++) {
+        byte *ligne;
+        code = NextQOIrow(&flux, &ligne);
+        if (code != PNM_OK) break;
+        if (gray) memcpy(gray[i], ligne, (size_t)flux.width);
+        else memcpy(rgb[i], ligne, 3 * (size_t)flux.width);
+    }
+    CloseQOI(&flux);
+    if (code != PNM_OK) {
+        if (gray) free_bmatrix(gray, *nrl, *nrh, *ncl, *nch);
+        if (rgb) free_rgb8matrix(rgb, *nrl, *nrh, *ncl, *nch);
+        return NULL;
+    }
+    if (rgb) {
+        rgb_vers_gris_ratios(rgb, *nrl, *nrh, *ncl, *nch, &gray, r_ratio, g_ratio, b_ratio, is_color);
+        free_rgb8matrix(rgb, *nrl, *nrh, *ncl, *nch);
+    }
+    return gray;
+}
+
 //sauvergarde image
 void save_pgm_gray(const char *filename, byte **m, long nrl, long nrh, long ncl, long nch) {
     SavePGM_bmatrix(m, nrl, nrh, ncl, nch, (char*)filename);
 }
 
-//implémentation du filtre , choix notation c++ (in/out)
-void filtre_moyenneur(byte **in, byte **out, long nrl, long nrh, long ncl, long nch) {
-    long i, j;
-    for (i = nrl + 1; i <= nrh - 1; i++) {
-        for (j = ncl + 1; j <= nch - 1; j++) {
-            //intérieur du fitlre => associer avec toutes les valeurs 
-            int s = 0;
-            s += in[i-1][j-1] + in[i-1][j] + in[i-1][j+1];
-            s += in[i][j-1] + in[i][j] + in[i][j+1];
-            s += in[i+1][j-1] + in[i+1][j] + in[i+1][j+1];
-            //moyenne de chaque puixel
-            out[i][j] = (byte)(s / 9);
-        }
-    }
-    //ici cas particulier comme la shape baisse, il faut remplacer par des 0 les bords
-    for (i = nrl; i <= nrh; i++) {
-        out[i][ncl] = in[i][ncl];
-        out[i][nch] = in[i][nch];
+//filtre boîte par sommes glissantes => une addition et une soustraction par pixel et par passe
+int filtre_boite_init(FiltreBoite *fb, long width, long height, int rayon) {
+    memset(fb, 0, sizeof(*fb));
+    if (rayon < 1 || rayon > RAYON_FILTRE_MAX || width <= 0 || height <= 0) return -1;
+    fb->width = width;
+    fb->height = height;
+    fb->rayon = rayon;
+    long k = 2 * rayon + 1;
+    fb->anneau = (byte*)malloc((size_t)(k + 1) * (size_t)width);
+    fb->colonnes = (uint16*)calloc((size_t)(2 * width + 1), sizeof(uint16));
+    if (!fb->anneau || !fb->colonnes) {
+        filtre_boite_liberer(fb);
+        return -1;
     }
-    for (j = ncl; j <= nch; j++) {
-        out[nrl][j] = in[nrl][j];
-        out[nrh][j] = in[nrh][j];
+    fb->sortie = fb->anneau + k * width;
+    fb->prefixe = fb->colonnes + width;
+    //division exacte par d = k² : decalage = floor(log2(d)), mult = ceil(2^(16+decalage) / d) < 2^16
+    //erreur (mult - 2^(16+decalage)/d) * s / 2^(16+decalage) < 1/d pour s <= 255*d (vérifié pour d = 9, 25, 49)
+    uint32 d = (uint32)(k * k);
+    int decalage = 0;
+    while ((2u << decalage) <= d) decalage++;
+    fb->decalage = decalage;
+    fb->mult = (uint16)(((1u << (16 + decalage)) + d - 1) / d);
+    return 0;
+}
+
+void filtre_boite_liberer(FiltreBoite *fb) {
+    free(fb->anneau);
+    free(fb->colonnes);
+    fb->anneau = NULL;
+    fb->colonnes = NULL;
+}
+
+//ligne i de sortie : bords (rayon premiers/derniers pixels) recopiés, intérieur = moyenne de la boîte
+static const byte *filtre_boite_ligne_interieure(FiltreBoite *fb) {
+    long w = fb->width, r = fb->rayon, k = 2 * r + 1;
+    const byte *centre = fb->anneau + (fb->emises % k) * w;
+    byte *out = fb->sortie;
+    //préfixe horizontal des sommes verticales (modulo 2^16, la différence reste exacte)
+    uint16 acc = 0;
+    fb->prefixe[0] = 0;
+    for (long j = 0; j < w; j++) {
+        acc = (uint16)(acc + fb->colonnes[j]);
+        fb->prefixe[j + 1] = acc;
     }
+    long jmax = (w - 1 - r < r) ? r - 1 : w - 1 - r;
+    memcpy(out, centre, (size_t)w);
+    if (jmax >= r) boite_ligne(fb->prefixe, out, r, jmax, (int)r, fb->mult, fb->decalage);
+    fb->emises++;
+    return out;
 }
 
-// Calcule Ix et Iy avec Sobel
-void sobel_ix_iy(byte **gray, int **ix, int **iy, long nrl, long nrh, long ncl, long nch) {
-    //masque sobel 
-    static const int SX[3][3] = {{-1, 0, 1}, {-2, 0, 2}, {-1, 0, 1}};  // Horizontal
-    static const int SY[3][3] = {{-1, -2, -1}, {0, 0, 0}, {1, 2, 1}};  // Vertical
+const byte *filtre_boite_pousser(FiltreBoite *fb, const byte *ligne) {
+    long w = fb->width, r = fb->rayon, k = 2 * r + 1;
+    long t = fb->recues++;
+    byte *slot = fb->anneau + (t % k) * w;
+    //somme verticale glissante : on retire la ligne qui sort de la fenêtre avant de l'écraser
+    if (t >= k) {
+        for (long j = 0; j < w; j++) fb->colonnes[j] = (uint16)(fb->colonnes[j] - slot[j]);
+    }
+    memcpy(slot, ligne, (size_t)w);
+    for (long j = 0; j < w; j++) fb->colonnes[j] = (uint16)(fb->colonnes[j] + slot[j]);
 
-    long i, j;
-    //traite information
-    for (i = nrl + 1; i <= nrh - 1; i++) {
-        for (j = ncl + 1; j <= nch - 1; j++) {
-            int gx = 0, gy = 0;
+    //lignes du haut (bord) : ressortent telles quelles dès leur arrivée
+    if (t < r) {
+        fb->emises++;
+        return slot;
+    }
+    //ligne t-r filtrée dès que la fenêtre est pleine, si elle n'est pas dans le bord du bas
+    if (t >= 2 * r && t - r <= fb->height - 1 - r) return filtre_boite_ligne_interieure(fb);
+    return NULL;
+}
 
-            //convoluer avec SX pour gx
-            gx = SX[0][0] * gray[i-1][j-1] + SX[0][1] * gray[i-1][j] + SX[0][2] * gray[i-1][j+1] + 
-            SX[1][0] * gray[i][j-1] + SX[1][1] * gray[i][j] + SX[1][2] * gray[i][j+1] +
-            SX[2][0] * gray[i+1][j-1] + SX[2][1] * gray[i+1][j] + SX[2][2] * gray[i+1][j+1];
+const byte *filtre_boite_vider(FiltreBoite *fb) {
+    if (fb->emises >= fb->recues) return NULL;
+    //lignes du bas (bord) : encore dans l'anneau, recopiées telles quelles
+    long k = 2 * fb->rayon + 1;
+    return fb->anneau + ((fb->emises++) % k) * fb->width;
+}
+
+int filtre_moyenneur_rayon(byte **in, byte **out, long nrl, long nrh, long ncl, long nch, int rayon) {
+    FiltreBoite fb;
+    long w = nch - ncl + 1;
+    if (filtre_boite_init(&fb, w, nrh - nrl + 1, rayon) != 0) return -1;
+    long i_out = nrl;
+    const byte *ligne;
+    for (long i = nrl; i <= nrh; i++) {
+        if ((ligne = filtre_boite_pousser(&fb, &in[i][ncl])) != NULL) memcpy(&out[i_out++][ncl], ligne, (size_t)w);
+    }
+    while ((ligne = filtre_boite_vider(&fb)) != NULL) memcpy(&out[i_out++][ncl], ligne, (size_t)w);
+    filtre_boite_liberer(&fb);
+    return 0;
+}
 
-            //convoluer avec SY pour gy
-            gy += SY[0][0] * gray[i-1][j-1] + SY[0][1] * gray[i-1][j] + SY[0][2] * gray[i-1][j+1]+ 
-            SY[1][0] * gray[i][j-1] + SY[1][1] * gray[i][j] + SY[1][2] * gray[i][j+1]+
-            SY[2][0] * gray[i+1][j-1] + SY[2][1] * gray[i+1][j] + SY[2][2] * gray[i+1][j+1];
+//implémentation du filtre , choix notation c++ (in/out) => sommes glissantes, mêmes valeurs que la boucle 3x3
+int filtre_moyenneur(byte **in, byte **out, long nrl, long nrh, long ncl, long nch) {
+    return filtre_moyenneur_rayon(in, out, nrl, nrh, ncl, nch, 1);
+}
 
-            ix[i][j] = gx;
-            iy[i][j] = gy;
+// Calcule Ix et Iy avec Sobel => noyau ligne choisi au démarrage (scalaire de référence ou SSE2/AVX2/AVX-512)
+void sobel_ix_iy(byte **gray, int **ix, int **iy, long nrl, long nrh, long ncl, long nch) {
+    long i, j;
+    long w = nch - ncl + 1;
+    //lignes int16 de travail puis élargissement en int pour garder l'interface imatrix
+    //(arène du thread si active ; échec => nrerror, comme les imatrix ix / iy de l'appelant)
+    int16 *gx = (int16*)nralloc_bloc((size_t)(2 * w) * sizeof(int16));
+    if (!gx) nrerror("allocation failure in sobel_ix_iy()");
+    int16 *gy = gx + w;
+    //traite information => sobel_ligne met déjà gx/gy à 0 aux deux bouts, la ligne est recopiée en entier
+    for (i = nrl + 1; i <= nrh - 1; i++) {
+        sobel_ligne(&gray[i-1][ncl], &gray[i][ncl], &gray[i+1][ncl], gx, gy, w);
+        int *lx = &ix[i][ncl], *ly = &iy[i][ncl];
+        for (j = 0; j < w; j++) {
+            lx[j] = gx[j];
+            ly[j] = gy[j];
         }
     }
-    //bords à 0
-    for (i = nrl; i <= nrh; i++) {
-        ix[i][ncl] = ix[i][nch] = 0;
-        iy[i][ncl] = iy[i][nch] = 0;
-    }
-    for (j = ncl; j <= nch; j++) {
-        ix[nrl][j] = ix[nrh][j] = 0;
-        iy[nrl][j] = iy[nrh][j] = 0;
-    }
+    nrfree_bloc(gx);
+    //lignes du haut et du bas à 0
+    memset(&ix[nrl][ncl], 0, (size_t)w * sizeof(int));
+    memset(&iy[nrl][ncl], 0, (size_t)w * sizeof(int));
+    memset(&ix[nrh][ncl], 0, (size_t)w * sizeof(int));
+    memset(&iy[nrh][ncl], 0, (size_t)w * sizeof(int));
 }
 
 // Calcule la magnitude normalisée du gradient et retourne la moyenne
 double gradient_magnitude_norm(byte **gray, double **mag_norm,
                                long nrl, long nrh, long ncl, long nch) {
-    //Ix et Iy
-    int **ix = imatrix(nrl, nrh, ncl, nch);
-    int **iy = imatrix(nrl, nrh, ncl, nch);
+    //Ix et Iy => lignes alignées (nralloc.h), anneau extérieur à 0 par sobel_ix_iy
+    int **ix = imatrix_halo(nrl, nrh, ncl, nch, 0, 0);
+    int **iy = imatrix_halo(nrl, nrh, ncl, nch, 0, 0);
     sobel_ix_iy(gray, ix, iy, nrl, nrh, ncl, nch);
 
     double sum = 0.0;
-    long count = 0;
-    //ici pour chaque pixel caclul de la magnitude 
-    for (long i = nrl + 1; i <= nrh - 1; i++) {
-        for (long j = ncl + 1; j <= nch - 1; j++) {
-            double gx = (double)ix[i][j];
-            double gy = (double)iy[i][j];
+    long w = nch - ncl + 1, h = nrh - nrl + 1;
+    long count = (h >= 3 && w >= 3) ? (h - 2) * (w - 2) : 0;
+    //ici pour chaque pixel caclul de la magnitude => lignes complètes, sans cas particulier au bord :
+    //ix = iy = 0 sur l'anneau extérieur donne mn = 0, qui ne change pas la somme
+    for (long i = nrl; i <= nrh; i++) {
+        const int *lx = &ix[i][ncl], *ly = &iy[i][ncl];
+        double *lm = &mag_norm[i][ncl];
+        for (long j = 0; j < w; j++) {
+            double gx = (double)lx[j];
+            double gy = (double)ly[j];
             double mag = sqrt(gx * gx + gy * gy);
             double mn = mag / VAL_SOBEL_MAX_THEORIQUE;  //normalisation selon seuil théorique 
             if (mn > 1.0) mn = 1.0; // manière pour s'assurer que ça ne dépasse pas 
-            if (mn < 0.0) mn = 0.0;
-            mag_norm[i][j] = mn;
+            lm[j] = mn;
             sum += mn;
-            count++;
         }
     }
-    //traiter les bords et les metttre à 0 comme tt à l'heure
-    for (long i = nrl; i <= nrh; i++) {
-        mag_norm[i][ncl] = mag_norm[i][nch] = 0.0;
-    }
-    for (long j = ncl; j <= nch; j++) {
-        mag_norm[nrl][j] = mag_norm[nrh][j] = 0.0;
-    }
 
     //libération mem
-    free_imatrix(ix, nrl, nrh, ncl, nch);
-    free_imatrix(iy, nrl, nrh, ncl, nch);
+    free_imatrix_halo(ix, nrl, nrh, ncl, nch, 0);
+    free_imatrix_halo(iy, nrl, nrh, ncl, nch, 0);
 
     //retourner la moyenne de la norme => à voir si opn ajoute en bas écart type ou pas .... 
     return (count > 0) ? (sum / (double)count) : 0.0;
@@ -195,37 +385,77 @@ double detection_contours_hysterisis(double **mag_norm, byte **edges,
     return (total > 0) ? ((double)edgec / (double)total) : 0.0;
 }
 
-//calcule histogramme non normalisé
-void histogramme256(byte** gray, long nrl ,long nrh, long ncl , long nch , double hist[256]){
-    uint64_t H[256] = {0}; // choix uint64 car la somme des pixels peut dépasser le byte
+//histogramme à 4 bancs : des pixels voisins de même niveau tombent dans des compteurs différents
+//=> plus de dépendance store->load sur le même H[v] (cas des ciels et fonds uniformes)
+void histo_bancs_init(HistogrammeBancs *hb) {
+    memset(hb, 0, sizeof(*hb));
+}
+
+//reverse les bancs uint32 dans le total 64 bits
+static void histo_bancs_vider(HistogrammeBancs *hb) {
+    for (int v = 0; v < 256; v++) {
+        hb->total[v] += (uint64_t)hb->bancs[0][v] + hb->bancs[1][v] + hb->bancs[2][v] + hb->bancs[3][v];
+    }
+    memset(hb->bancs, 0, sizeof(hb->bancs));
+    hb->depuis_vidage = 0;
+}
+
+void histo_bancs_ajouter(HistogrammeBancs *hb, const byte *p, long n) {
+    while (n > 0) {
+        //un banc ne peut pas dépasser depuis_vidage => on vide avant tout risque de débordement uint32
+        long bloc = (n > (1L << 30)) ? (1L << 30) : n;
+        if (hb->depuis_vidage + (uint64_t)bloc > 0xFFFFFFFFull) histo_bancs_vider(hb);
+        uint32 *b0 = hb->bancs[0], *b1 = hb->bancs[1], *b2 = hb->bancs[2], *b3 = hb->bancs[3];
+        long j = 0;
+        //ligne contiguë déroulée par 8
+        for (; j + 8 <= bloc; j += 8) {
+            b0[p[j]]++;     b1[p[j + 1]]++; b2[p[j + 2]]++; b3[p[j + 3]]++;
+            b0[p[j + 4]]++; b1[p[j + 5]]++; b2[p[j + 6]]++; b3[p[j + 7]]++;
+        }
+        for (; j < bloc; j++) b0[p[j]]++;
+        hb->depuis_vidage += (uint64_t)bloc;
+        p += bloc;
+        n -= bloc;
+    }
+}
+
+uint64_t histo_bancs_fusionner(HistogrammeBancs *hb, uint64_t H[256]) {
+    histo_bancs_vider(hb);
     uint64_t N = 0;
-    //initialisation 
-    for (int k = 0; k < 256; k++) hist[k] = 0.0;
-    //remplissage valeur par valeur 
+    for (int v = 0; v < 256; v++) {
+        H[v] = hb->total[v];
+        N += H[v];
+    }
+    return N;
+}
+
+//histogramme non normalisé d'un buffer contigu (pas besoin de byte**) => retourne le nombre de pixels
+uint64_t histogramme256_buffer(const byte *p, long n, uint64_t H[256]) {
+    HistogrammeBancs hb;
+    histo_bancs_init(&hb);
+    histo_bancs_ajouter(&hb, p, n);
+    return histo_bancs_fusionner(&hb, H);
+}
+
+//calcule histogramme non normalisé (comptes) => même noyau, ligne par ligne
+uint64_t histogramme256(byte** gray, long nrl ,long nrh, long ncl , long nch , uint64_t H[256]){
+    HistogrammeBancs hb;
+    histo_bancs_init(&hb);
     for (long i = nrl; i <= nrh; i++) {
-        for (long j = ncl; j <= nch; j++) {
-            H[gray[i][j]]++;
-            N++;
-        }
+        histo_bancs_ajouter(&hb, &gray[i][ncl], nch - ncl + 1);
     }
+    return histo_bancs_fusionner(&hb, H);
 }
 
 // Calcule l'histogramme normalisé
 void histogramme256_normalise(byte **gray, long nrl, long nrh, long ncl, long nch, double hist[256]) {
-    uint64_t H[256] = {0}; // choix uint64 car la somme des pixels peut dépasser le byte
-    uint64_t N = 0;
+    uint64_t H[256]; // choix uint64 car la somme des pixels peut dépasser le byte
     //initialisation 
     for (int k = 0; k < 256; k++) hist[k] = 0.0;
-    //remplissage valeur par valeur 
-    for (long i = nrl; i <= nrh; i++) {
-        for (long j = ncl; j <= nch; j++) {
-            H[gray[i][j]]++;
-            N++;
-        }
-    }
+    uint64_t N = histogramme256(gray, nrl, nrh, ncl, nch, H);
     if (N == 0) return;
 
-    //normalisation pour être entre 0 et 1 // N aurait pu être calculé autrmeent mais tant pis optimiser lors de l'exécution pas avant 
+    //normalisation pour être entre 0 et 1
     for (int b = 0; b < 256; b++) {
         hist[b] = (double)H[b] / (double)N;
     }
@@ -245,29 +475,39 @@ int verifier_image_couleur_est_nb(uint64_t rsum, uint64_t gsum, uint64_t bsum,
     return ((maxc - minc) < 0.02) ? 0 : 1;
 }
 
-//extraction complète des features ici => 
-int extraire_features_from_file(const char *filename, ImageFeatures *feat,
-                               int do_apply_filtre, double seuil_contour, int image_type) {
+//matrice en gris selon le format, ratios et couleur remplis par le chargeur (1/3 et pas couleur par défaut)
+static byte **charger_gris(const char *filename, int image_type, long *nrl, long *nrh, long *ncl, long *nch,
+                           double *r_ratio, double *g_ratio, double *b_ratio, int *is_color) {
+    byte **gray = NULL;
+    if (image_type == IMAGE_TYPE_PPM) {
+        rgb8 **rgb = load_ppm_rgb_and_to_gray(filename, nrl, nrh, ncl, nch, &gray, r_ratio, g_ratio, b_ratio, is_color);
+        if (!rgb) return NULL;
+        free_rgb8matrix(rgb, *nrl, *nrh, *ncl, *nch);
+        return gray;
+    }
+    if (image_type == IMAGE_TYPE_PGM) return load_pgm_gray(filename, nrl, nrh, ncl, nch);
+    if (image_type == IMAGE_TYPE_JPEG) return load_jpeg_gray(filename, nrl, nrh, ncl, nch, r_ratio, g_ratio, b_ratio, is_color);
+    if (image_type == IMAGE_TYPE_PNG) return load_png_gray(filename, nrl, nrh, ncl, nch, r_ratio, g_ratio, b_ratio, is_color);
+    if (image_type == IMAGE_TYPE_QOI) return load_qoi_gray(filename, nrl, nrh, ncl, nch, r_ratio, g_ratio, b_ratio, is_color);
+    return NULL;  // pareil
+}
+
+//extraction complète des features ici => version de référence, une matrice par étape
+int extraire_features_multipasse(const char *filename, ImageFeatures *feat,
+                                 int do_apply_filtre, double seuil_contour, int image_type) {
     //TODO, à ajouter une fonction qui initialise toutes les ressources dont nous avons besoin 
     memset(feat, 0, sizeof(*feat));
+    //arène du thread (si active) : toutes les matrices de l'image rendues d'un coup à la fin
+    size_t marque = nrarena_mark();
     long nrl, nrh, ncl, nch;
-    byte **gray = NULL;
     double r_ratio = 1.0 / 3.0, g_ratio = 1.0 / 3.0, b_ratio = 1.0 / 3.0;
     int is_color = 0;
-    if (image_type == IMAGE_TYPE_PPM) {
-        rgb8 **rgb = load_ppm_rgb_and_to_gray(filename, &nrl, &nrh, &ncl, &nch, &gray, &r_ratio, &g_ratio, &b_ratio, &is_color);
-        if (!rgb) return -1;
-        free_rgb8matrix(rgb, nrl, nrh, ncl, nch);
-    } else if (image_type == IMAGE_TYPE_PGM) {
-        gray = load_pgm_gray(filename, &nrl, &nrh, &ncl, &nch);
-        if (!gray) return -1;
-        is_color = 0;
-    } else if (image_type == IMAGE_TYPE_JPEG) {
-        goto je_sais_pas ;  // faudra voir comment on gère ce cas de figure ... 
-    } else {
-        return -1;  // pareil 
+    byte **gray = charger_gris(filename, image_type, &nrl, &nrh, &ncl, &nch, &r_ratio, &g_ratio, &b_ratio, &is_color);
+    if (!gray) {
+        //un chargeur peut avoir pris de l'arène avant d'échouer => rendue ici aussi
+        nrarena_reset(marque);
+        return -1;
     }
-    je_sais_pas : // à enlever cette partie 
     // Remplit les champs de base
     feat->nrl = nrl; feat->nrh = nrh; feat->ncl = ncl; feat->nch = nch;
     feat->width = nch - ncl + 1;
@@ -280,24 +520,925 @@ int extraire_features_from_file(const char *filename, ImageFeatures *feat,
     //Fitlre moyenneur par défaut si on indique dans le param, mais j'ai peur que ça fausse le reste 
     if (do_apply_filtre) {
         byte **filt = bmatrix(nrl, nrh, ncl, nch);
-        filtre_moyenneur(gray, filt, nrl, nrh, ncl, nch);
+        int code = filtre_moyenneur(gray, filt, nrl, nrh, ncl, nch);
         free_bmatrix(gray, nrl, nrh, ncl, nch);
+        if (code != 0) {
+            free_bmatrix(filt, nrl, nrh, ncl, nch);
+            nrarena_reset(marque);
+            return -1;
+        }
         gray = filt;
     }
 
     //gradient
-    double **mag_norm = (double**)dmatrix(nrl, nrh, ncl, nch);
+    double **mag_norm = dmatrix_halo(nrl, nrh, ncl, nch, 0, 0);
     feat->moyenne_gradient_norme = gradient_magnitude_norm(gray, mag_norm, nrl, nrh, ncl, nch);
     //contour
-    byte **edges = bmatrix(nrl, nrh, ncl, nch);
+    byte **edges = bmatrix_halo(nrl, nrh, ncl, nch, 0, 0);
     feat->densite_contours = detection_contours_hysterisis(mag_norm, edges, nrl, nrh, ncl, nch, seuil_contour);
     //histogramme normalisé et remplissage tabeau directement passé par adresse 
     histogramme256_normalise(gray, nrl, nrh, ncl, nch, feat->hist);
     //libération de ressources 
     free_bmatrix(gray, nrl, nrh, ncl, nch);
-    free_dmatrix((double**)mag_norm, nrl, nrh, ncl, nch); 
-    free_bmatrix(edges, nrl, nrh, ncl, nch);
+    free_dmatrix_halo(mag_norm, nrl, nrh, ncl, nch, 0);
+    free_bmatrix_halo(edges, nrl, nrh, ncl, nch, 0);
+    nrarena_reset(marque);
+
+    return 0;
+}
+
+//point d'entrée => passe par l'extracteur fusionné, la version multipasse reste la référence
+int extraire_features_from_file(const char *filename, ImageFeatures *feat,
+                               int do_apply_filtre, double seuil_contour, int image_type) {
+    return extraire_features_fusionne(filename, feat, do_apply_filtre, seuil_contour, image_type);
+}
+
+//extension exacte en fin de nom (casse ignorée) => "x.ppm.bak" ou "x.pngs" ne sont plus pris pour des images
+int image_type_depuis_nom(const char *nom) {
+    const char *point = strrchr(nom, '.');
+    if (!point) return -1;
+    point++;
+    if (strcasecmp(point, "pgm") == 0) return IMAGE_TYPE_PGM;
+    if (strcasecmp(point, "ppm") == 0) return IMAGE_TYPE_PPM;
+    if (strcasecmp(point, "jpg") == 0 || strcasecmp(point, "jpeg") == 0) return IMAGE_TYPE_JPEG;
+    if (strcasecmp(point, "png") == 0) return IMAGE_TYPE_PNG;
+    if (strcasecmp(point, "qoi") == 0) return IMAGE_TYPE_QOI;
+    return -1;
+}
+
+int image_type_depuis_magie(const byte *entete, size_t taille) {
+    if (taille >= 2 && entete[0] == 'P' && entete[1] == '5') return IMAGE_TYPE_PGM;
+    if (taille >= 2 && entete[0] == 'P' && entete[1] == '6') return IMAGE_TYPE_PPM;
+    if (jpeg_signature(entete, taille)) return IMAGE_TYPE_JPEG;
+    if (png_signature(entete, taille)) return IMAGE_TYPE_PNG;
+    if (taille >= 4 && memcmp(entete, "qoif", 4) == 0) return IMAGE_TYPE_QOI;
+    return -1;
+}
+
+void options_extraction_defaut(OptionsExtraction *opt) {
+    opt->appliquer_filtre = 0;
+    opt->rayon_filtre = 1;
+    opt->seuil_contour = SEUIL_CONTOUR;
+    opt->image_type = IMAGE_TYPE_PPM;
+    opt->mode_magnitude = MAGNITUDE_EXACTE;
+    opt->conversion_gris = GRIS_EXACT;
+    opt->precision = PRECISION_DOUBLE;
+    opt->decimation = 1;
+    opt->echelle_jpeg = JPEG_ECHELLE_PLEINE;
+    opt->lecture_mmap = 0;
+    opt->budget_bande = 0;
+    opt->nb_threads = 0;
+}
+
+void sommes_bande_init(SommesBande *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+void sommes_bande_fusionner(SommesBande *total, const SommesBande *b) {
+    for (int v = 0; v < 256; v++) total->hist[v] += b->hist[v];
+    total->Rsum += b->Rsum;
+    total->Gsum += b->Gsum;
+    total->Bsum += b->Bsum;
+    total->somme_mag_q8 += b->somme_mag_q8;
+    total->somme_mag_q16 += b->somme_mag_q16;
+    total->somme_mag += b->somme_mag;
+    total->nb_interieur += b->nb_interieur;
+    total->nb_contours += b->nb_contours;
+}
+
+//seuil de contour en domaine entier : norme/1500 >= t <=> gx²+gy² >= (t*1500)²
+//la norme est bornée à 1 donc t > 1 ne donne jamais de contour, t <= 0 donne tous les pixels
+static int32 seuil_contour_carre(double t_norm) {
+    if (t_norm <= 0.0) return 0;
+    if (t_norm > 1.0) return INT_MAX;
+    double s = t_norm * VAL_SOBEL_MAX_THEORIQUE;
+    return (int32)ceil(s * s);
+}
+
+//gx, gy en int16 + une ligne de normes (float au plus)
+static size_t etage_gradient_octets(long width) {
+    return 2 * (size_t)width * sizeof(int16) + (size_t)width * sizeof(float);
+}
+
+//tampon : etage_gradient_octets(width) octets alignés
+static void etage_gradient_init(EtageGradient *eg, const OptionsExtraction *opt, void *tampon, long width) {
+    double t = opt->seuil_contour;
+    eg->mode_magnitude = opt->mode_magnitude;
+    eg->precision = opt->precision;
+    eg->seuil_contour = t;
+    eg->seuil_carre = seuil_contour_carre(t);
+    eg->seuil_f32 = (float)t;
+    eg->seuil_q16 = (t <= 0.0) ? 0 : (t > 1.0) ? 65536 : (uint32)ceil(t * 65535.0);
+    eg->normes = tampon;
+    eg->gx = (int16*)((byte*)tampon + (size_t)width * sizeof(float));
+    eg->gy = eg->gx + width;
+}
+
+//initialisation de l'extracteur => un seul bloc pour toutes les lignes de la fenêtre
+int extracteur_init(ExtracteurFlux *ex, long width, long height, const OptionsExtraction *opt) {
+    memset(ex, 0, sizeof(*ex));
+    int f = opt->decimation;
+    if (width <= 0 || height <= 0 || f < 1 || f > DECIMATION_MAX) return PNM_ERR_DIMENSIONS;
+    if (opt->appliquer_filtre && (opt->rayon_filtre < 1 || opt->rayon_filtre > RAYON_FILTRE_MAX)) return PNM_ERR_FORMAT;
+    int do_apply_filtre = opt->appliquer_filtre;
+    //blocs incomplets gardés au bord droit et en bas
+    ex->largeur_source = width;
+    ex->hauteur_source = height;
+    ex->decimation = f;
+    width = (width + f - 1) / f;
+    height = (height + f - 1) / f;
+    ex->width = width;
+    ex->height = height;
+    ex->appliquer_filtre = do_apply_filtre;
+    ex->conversion_gris = opt->conversion_gris;
+
+    //le filtre garde ses 2*rayon+1 lignes brutes de son côté
+    if (do_apply_filtre && filtre_boite_init(&ex->filtre, width, height, opt->rayon_filtre) != 0) return PNM_ERR_MEMOIRE;
+
+    //3 lignes sobel + 1 ligne de travail + tampons de l'étage gradient (+ sommes des blocs si décimation)
+    size_t octets = ((size_t)4 * (size_t)width + 63) & ~(size_t)63; //étage gradient aligné
+    size_t octets_decim = (f > 1) ? 3 * (size_t)width * (sizeof(uint32) + sizeof(rgb8)) : 0;
+    ex->bloc = (byte*)nralloc_bloc(octets + etage_gradient_octets(width) + octets_decim);
+    if (!ex->bloc) {
+        extracteur_liberer(ex);
+        return PNM_ERR_MEMOIRE;
+    }
+    etage_gradient_init(&ex->grad, opt, ex->bloc + octets, width);
+    for (int k = 0; k < 3; k++) ex->fen[k] = ex->bloc + k * width;
+    ex->tmp = ex->bloc + 3 * width;
+    if (f > 1) {
+        ex->acc = (uint32*)(ex->bloc + octets + etage_gradient_octets(width));
+        ex->moyenne_rgb = (rgb8*)(ex->acc + 3 * width);
+        memset(ex->acc, 0, 3 * (size_t)width * sizeof(uint32));
+    }
+    return 0;
+}
+
+//sobel/magnitude/contours de la ligne du milieu m (h au-dessus, b en dessous), ajoutés à s
+static void gradient_ligne(const byte *h, const byte *m, const byte *b, long w, const EtageGradient *eg,
+                           SommesBande *s) {
+    int16 *gx = eg->gx, *gy = eg->gy;
+    //gx/gy de la ligne du milieu avec le noyau vectoriel
+    sobel_ligne(h, m, b, gx, gy, w);
+    if (eg->mode_magnitude == MAGNITUDE_ENTIERE) {
+        //pas de racine pour le seuil, racine simple précision vectorisée pour la moyenne
+        s->nb_contours += contours_ligne(gx, gy, w, eg->seuil_carre);
+        s->somme_mag_q8 += magnitude_ligne_q8(gx, gy, w);
+        s->nb_interieur += (w >= 3) ? w - 2 : 0;
+        return;
+    }
+    if (eg->precision == PRECISION_FLOAT32) {
+        //normes de la ligne en float (vectoriel), sommées en double dans l'ordre des pixels
+        float *mn = (float*)eg->normes;
+        norme_ligne_f32(gx, gy, mn, w);
+        for (long j = 1; j <= w - 2; j++) {
+            s->somme_mag += mn[j];
+            s->nb_contours += (mn[j] >= eg->seuil_f32) ? 1 : 0;
+        }
+        s->nb_interieur += (w >= 3) ? w - 2 : 0;
+        return;
+    }
+    if (eg->precision == PRECISION_Q16) {
+        //normes en uint16 : somme et seuil entiers
+        uint16 *mn = (uint16*)eg->normes;
+        uint64_t somme = 0;
+        long nb = 0;
+        norme_ligne_q16(gx, gy, mn, w);
+        for (long j = 1; j <= w - 2; j++) {
+            somme += mn[j];
+            nb += (mn[j] >= eg->seuil_q16) ? 1 : 0;
+        }
+        s->somme_mag_q16 += somme;
+        s->nb_contours += nb;
+        s->nb_interieur += (w >= 3) ? w - 2 : 0;
+        return;
+    }
+    //même calcul et même ordre de sommation que gradient_magnitude_norm => résultats identiques
+    for (long j = 1; j <= w - 2; j++) {
+        double dx = (double)gx[j], dy = (double)gy[j];
+        double mn = sqrt(dx * dx + dy * dy) / VAL_SOBEL_MAX_THEORIQUE;
+        if (mn > 1.0) mn = 1.0;
+        s->somme_mag += mn;
+        s->nb_contours += (mn >= eg->seuil_contour) ? 1 : 0;
+        s->nb_interieur++;
+    }
+}
+
+//conversion d'une ligne rgb en gris, sommes des canaux ajoutées à s
+static void convertir_ligne_gris(const rgb8 *ligne, byte *gris, long w, int conversion_gris, SommesBande *s) {
+    if (conversion_gris == GRIS_VIRGULE_FIXE) {
+        //désentrelacement + conversion + sommes en un seul noyau vectoriel
+        uint64_t sommes[3] = {0, 0, 0};
+        rgb_vers_gris_ligne(ligne, gris, w, sommes);
+        s->Rsum += sommes[0]; s->Gsum += sommes[1]; s->Bsum += sommes[2];
+        return;
+    }
+    uint64_t rs = 0, gs = 0, bs = 0;
+    for (long j = 0; j < w; j++) {
+        rs += ligne[j].r;
+        gs += ligne[j].g;
+        bs += ligne[j].b;
+        double y = 0.299 * ligne[j].r + 0.587 * ligne[j].g + 0.114 * ligne[j].b;
+        gris[j] = borne_sup_inf((int)(y));
+    }
+    s->Rsum += rs; s->Gsum += gs; s->Bsum += bs;
+}
+
+//features finales à partir des sommes (histogramme compris)
+static void sommes_vers_features(const SommesBande *s, long width, long height, int est_rgb,
+                                 int mode_magnitude, int precision, ImageFeatures *feat) {
+    memset(feat, 0, sizeof(*feat));
+    feat->nrl = 0; feat->nrh = height - 1;
+    feat->ncl = 0; feat->nch = width - 1;
+    feat->width = width;
+    feat->height = height;
+
+    feat->ratio_rouge = feat->ratio_vert = feat->ratio_bleu = 1.0 / 3.0;
+    if (est_rgb) {
+        double S = (double)s->Rsum + (double)s->Gsum + (double)s->Bsum;
+        if (S > 0.0) {
+            feat->ratio_rouge = s->Rsum / S;
+            feat->ratio_vert = s->Gsum / S;
+            feat->ratio_bleu = s->Bsum / S;
+        }
+        feat->est_couleur = verifier_image_couleur_est_nb(s->Rsum, s->Gsum, s->Bsum,
+                                                          feat->nrl, feat->nrh, feat->ncl, feat->nch);
+    }
+
+    //mode entier : |g| <= 1020*sqrt(2) < 1500 donc le bornage à 1 n'est jamais atteint
+    double somme_mag = s->somme_mag;
+    if (mode_magnitude == MAGNITUDE_ENTIERE) {
+        somme_mag = (double)s->somme_mag_q8 / (256.0 * VAL_SOBEL_MAX_THEORIQUE);
+    } else if (precision == PRECISION_Q16) {
+        somme_mag = (double)s->somme_mag_q16 / 65535.0;
+    }
+    feat->moyenne_gradient_norme = (s->nb_interieur > 0) ? (somme_mag / (double)s->nb_interieur) : 0.0;
+    feat->densite_contours = (s->nb_interieur > 0) ? ((double)s->nb_contours / (double)s->nb_interieur) : 0.0;
+
+    uint64_t N = 0;
+    for (int b = 0; b < 256; b++) N += s->hist[b];
+    for (int b = 0; b < 256; b++) {
+        feat->hist[b] = (double)s->hist[b] / (double)N;
+    }
+}
+
+//histogramme de l'aperçu : chaque pixel réduit compte pour la surface de son bloc source
+static void histo_ligne_ponderee(ExtracteurFlux *ex, const byte *ligne, long k) {
+    long f = ex->decimation, w = ex->width;
+    uint64_t hl = (k == ex->height - 1) ? (uint64_t)(ex->hauteur_source - (ex->height - 1) * f) : (uint64_t)f;
+    uint64_t plein = hl * (uint64_t)f;
+    for (long j = 0; j < w - 1; j++) ex->sommes.hist[ligne[j]] += plein;
+    ex->sommes.hist[ligne[w - 1]] += hl * (uint64_t)(ex->largeur_source - (w - 1) * f);
+}
+
+//étage principal : histogramme de la ligne puis sobel/magnitude/contours sur la ligne du milieu
+static void extracteur_etage_principal(ExtracteurFlux *ex, const byte *ligne) {
+    long w = ex->width;
+    long k = ex->lignes_traitees++;
+    byte *cur = ex->fen[k % 3];
+    memcpy(cur, ligne, (size_t)w);
+
+    if (ex->decimation > 1) histo_ligne_ponderee(ex, cur, k);
+    else histo_bancs_ajouter(&ex->hist, cur, w);
+
+    if (k < 2) return; //pas encore 3 lignes dans la fenêtre
+    gradient_ligne(ex->fen[(k - 2) % 3], ex->fen[(k - 1) % 3], cur, w, &ex->grad, &ex->sommes);
+}
+
+//ligne à la résolution de travail => passe éventuellement par le filtre moyenneur
+//les lignes filtrées (rayon lignes de retard) vont directement dans l'étage sobel/histogramme
+static void extracteur_ligne_travail(ExtracteurFlux *ex, const byte *ligne) {
+    if (!ex->appliquer_filtre) {
+        extracteur_etage_principal(ex, ligne);
+        return;
+    }
+    const byte *filtree = filtre_boite_pousser(&ex->filtre, ligne);
+    if (filtree) extracteur_etage_principal(ex, filtree);
+}
+
+//somme de chaque bloc de f colonnes d'une ligne source, nc canaux entrelacés (1 gris, 3 rgb)
+//acc[c * width + jr] += somme du canal c sur le bloc jr ; boucles à pas fixe pour f = 2 et 4
+static void decimation_accumuler(ExtracteurFlux *ex, const byte *src, int nc) {
+    long f = ex->decimation, w = ex->width, ws = ex->largeur_source;
+    long pleins = ws / f; //blocs complets, le dernier bloc peut être partiel
+    for (int c = 0; c < nc; c++) {
+        uint32 *acc = ex->acc + c * w;
+        const byte *p = src + c;
+        long jr = 0;
+        if (f == 2) {
+            for (; jr < pleins; jr++, p += 2 * nc) acc[jr] += (uint32)p[0] + p[nc];
+        } else if (f == 4) {
+            for (; jr < pleins; jr++, p += 4 * nc) acc[jr] += (uint32)p[0] + p[nc] + p[2 * nc] + p[3 * nc];
+        }
+        for (; jr < w; jr++) {
+            uint32 s = 0;
+            for (long js = jr * f; js < ws && js < (jr + 1) * f; js++) s += src[js * nc + c];
+            acc[jr] += s;
+        }
+    }
+}
+
+//bloc de lignes complet (ou dernier bloc) => moyenne arrondie de chaque bloc, ligne réduite vers l'étage suivant
+static void decimation_emettre(ExtracteurFlux *ex) {
+    long f = ex->decimation, w = ex->width, ws = ex->largeur_source;
+    long nc = ex->est_rgb ? 3 : 1;
+    byte *gris = ex->tmp;
+    for (long jr = 0; jr < w; jr++) {
+        uint32 surface = (uint32)(ex->lignes_acc * ((jr < w - 1) ? f : ws - (w - 1) * f));
+        if (!ex->est_rgb) {
+            gris[jr] = (byte)((ex->acc[jr] + surface / 2) / surface);
+            continue;
+        }
+        ex->moyenne_rgb[jr].r = (byte)((ex->acc[jr] + surface / 2) / surface);
+        ex->moyenne_rgb[jr].g = (byte)((ex->acc[w + jr] + surface / 2) / surface);
+        ex->moyenne_rgb[jr].b = (byte)((ex->acc[2 * w + jr] + surface / 2) / surface);
+        //sommes exactes des canaux sur tous les pixels source
+        ex->sommes.Rsum += ex->acc[jr];
+        ex->sommes.Gsum += ex->acc[w + jr];
+        ex->sommes.Bsum += ex->acc[2 * w + jr];
+    }
+    if (ex->est_rgb) {
+        SommesBande jetees; // sommes des canaux moyennés, déjà comptées au-dessus
+        sommes_bande_init(&jetees);
+        convertir_ligne_gris(ex->moyenne_rgb, gris, w, ex->conversion_gris, &jetees);
+    }
+    memset(ex->acc, 0, (size_t)(nc * w) * sizeof(uint32));
+    ex->lignes_acc = 0;
+    extracteur_ligne_travail(ex, gris);
+}
+
+//pousse une ligne en niveaux de gris (ou accumule dans le bloc si aperçu décimé)
+void extracteur_ligne_gris(ExtracteurFlux *ex, const byte *ligne) {
+    if (ex->decimation == 1) {
+        extracteur_ligne_travail(ex, ligne);
+        return;
+    }
+    decimation_accumuler(ex, ligne, 1);
+    if (++ex->lignes_acc == ex->decimation) decimation_emettre(ex);
+}
+
+//pousse une ligne couleur => conversion gris + sommes des canaux à la volée
+//en aperçu décimé les canaux sont moyennés par bloc et seule la ligne réduite est convertie
+void extracteur_ligne_rgb(ExtracteurFlux *ex, const rgb8 *ligne) {
+    ex->est_rgb = 1;
+    if (ex->decimation > 1) {
+        decimation_accumuler(ex, (const byte*)ligne, 3);
+        if (++ex->lignes_acc == ex->decimation) decimation_emettre(ex);
+        return;
+    }
+    byte *gris = ex->tmp;
+    convertir_ligne_gris(ligne, gris, ex->width, ex->conversion_gris, &ex->sommes);
+    extracteur_ligne_travail(ex, gris);
+}
+
+void extracteur_liberer(ExtracteurFlux *ex) {
+    nrfree_bloc(ex->bloc);
+    ex->bloc = NULL;
+    filtre_boite_liberer(&ex->filtre);
+}
+
+//vide le filtre (dernières lignes = bord) puis remplit les features
+void extracteur_terminer(ExtracteurFlux *ex, ImageFeatures *feat) {
+    //dernier bloc incomplet de l'aperçu
+    if (ex->decimation > 1 && ex->lignes_acc > 0) decimation_emettre(ex);
+    if (ex->appliquer_filtre) {
+        const byte *ligne;
+        while ((ligne = filtre_boite_vider(&ex->filtre)) != NULL) extracteur_etage_principal(ex, ligne);
+    }
+
+    //aperçu : histogramme pondéré déjà dans les sommes
+    if (ex->decimation == 1) histo_bancs_fusionner(&ex->hist, ex->sommes.hist);
+    sommes_vers_features(&ex->sommes, ex->largeur_source, ex->hauteur_source, ex->est_rgb,
+                         ex->grad.mode_magnitude, ex->grad.precision, feat);
+    extracteur_liberer(ex);
+}
+
+//lecture ligne à ligne du fichier => jamais d'image complète en mémoire
+int extraire_features_fusionne(const char *filename, ImageFeatures *feat,
+                               int do_apply_filtre, double seuil_contour, int image_type) {
+    OptionsExtraction opt;
+    options_extraction_defaut(&opt);
+    opt.appliquer_filtre = do_apply_filtre;
+    opt.seuil_contour = seuil_contour;
+    opt.image_type = image_type;
+    return extraire_features_avec_options(filename, feat, &opt);
+}
+
+int extraire_features_avec_options(const char *filename, ImageFeatures *feat, const OptionsExtraction *opt) {
+    int image_type = opt->image_type;
+    memset(feat, 0, sizeof(*feat));
+    if (image_type == IMAGE_TYPE_JPEG || image_type == IMAGE_TYPE_PNG) {
+        size_t taille;
+        byte *donnees = charger_fichier(filename, &taille);
+        if (!donnees) return PNM_ERR_FICHIER;
+        int code = extraire_features_tampon(donnees, taille, feat, opt);
+        free(donnees);
+        return code;
+    }
+    if (image_type == IMAGE_TYPE_QOI) {
+        //décodé en place dans la projection
+        QOIstream flux;
+        int code = MapQOI((char*)filename, &flux);
+        if (code == PNM_OK) code = extraire_features_qoi(&flux, feat, opt);
+        CloseQOI(&flux);
+        return code;
+    }
+    if (image_type != IMAGE_TYPE_PPM && image_type != IMAGE_TYPE_PGM) return PNM_ERR_FORMAT;
+    int decime = (opt->decimation > 1);
+    if (opt->nb_threads != 0 && !decime) return extraire_features_parallele(filename, feat, opt);
+    if (opt->budget_bande > 0 && !decime) return extraire_features_par_bandes(filename, feat, opt);
+    if (opt->lecture_mmap) {
+        //projection impossible (pipe, ...) => on retombe sur la lecture par fread
+        //entête invalide ou fichier tronqué => inutile de relire, le code est rendu tel quel
+        PNMview vue;
+        int code = MapPNM((char*)filename, &vue);
+        if (code == PNM_OK) {
+            int ret = PNM_ERR_FORMAT;
+            if (vue.ncanal == ((image_type == IMAGE_TYPE_PPM) ? 3 : 1)) ret = extraire_features_vue(&vue, feat, opt);
+            UnmapPNM(&vue);
+            return ret;
+        }
+        if (code != PNM_ERR_FICHIER) return code;
+    }
+    return extraire_features_flux_pnm(filename, feat, opt);
+}
+
+//fichier P5/P6 complet déjà en mémoire (lecture anticipée, archive, ...) => vue sans copie sur le tampon
+int extraire_features_tampon(const byte *donnees, size_t taille, ImageFeatures *feat, const OptionsExtraction *opt) {
+    int image_type = opt->image_type;
+    memset(feat, 0, sizeof(*feat));
+    if (image_type == IMAGE_TYPE_JPEG) return extraire_features_jpeg(donnees, taille, feat, opt);
+    if (image_type == IMAGE_TYPE_PNG) return extraire_features_png(donnees, taille, feat, opt);
+    if (image_type == IMAGE_TYPE_QOI) {
+        QOIstream flux;
+        int code = ViewQOI(donnees, taille, &flux);
+        if (code == PNM_OK) code = extraire_features_qoi(&flux, feat, opt);
+        CloseQOI(&flux);
+        return code;
+    }
+    if (image_type != IMAGE_TYPE_PPM && image_type != IMAGE_TYPE_PGM) return PNM_ERR_FORMAT;
+    PNMview vue;
+    int code = ViewPNM(donnees, taille, &vue);
+    if (code == PNM_OK) {
+        code = PNM_ERR_FORMAT;
+        if (vue.ncanal == ((image_type == IMAGE_TYPE_PPM) ? 3 : 1)) code = extraire_features_vue(&vue, feat, opt);
+    }
+    UnmapPNM(&vue);
+    return code;
+}
+
+int extraire_features_jpeg(const byte *donnees, size_t taille, ImageFeatures *feat, const OptionsExtraction *opt) {
+    memset(feat, 0, sizeof(*feat));
+    ImageJPEG img;
+    int code = jpeg_decoder(donnees, taille, opt->echelle_jpeg, opt->conversion_gris == GRIS_LUMA, &img);
+    if (code != PNM_OK) return code;
+    ExtracteurFlux ex;
+    code = extracteur_init(&ex, img.width, img.height, opt);
+    if (code != PNM_OK) {
+        jpeg_liberer(&img);
+        return code;
+    }
+    for (long i = 0; i < img.height; i++) {
+        if (img.ncanal == 3) extracteur_ligne_rgb(&ex, (const rgb8*)(img.pixels + 3 * i * img.width));
+        else extracteur_ligne_gris(&ex, img.pixels + i * img.width);
+    }
+    extracteur_terminer(&ex, feat);
+    //aperçu DCT : comme la décimation, les features gardent les dimensions de l'image source
+    feat->width = img.largeur_source;
+    feat->height = img.hauteur_source;
+    feat->nrh = feat->height - 1;
+    feat->nch = feat->width - 1;
+    jpeg_liberer(&img);
+    return 0;
+}
+
+int extraire_features_png(const byte *donnees, size_t taille, ImageFeatures *feat, const OptionsExtraction *opt) {
+    memset(feat, 0, sizeof(*feat));
+    PNGflux flux;
+    int code = png_ouvrir(donnees, taille, &flux);
+    if (code != PNM_OK) return code;
+    ExtracteurFlux ex;
+    code = extracteur_init(&ex, flux.width, flux.height, opt);
+    if (code != PNM_OK) {
+        png_fermer(&flux);
+        return code;
+    }
+    for (long i = 0; i < flux.height; i++) {
+        const byte *ligne;
+        code = png_ligne_suivante(&flux, &ligne);
+        if (code != PNM_OK) break;
+        if (flux.ncanal == 3) extracteur_ligne_rgb(&ex, (const rgb8*)ligne);
+        else extracteur_ligne_gris(&ex, ligne);
+    }
+    png_fermer(&flux);
+    if (code != PNM_OK) {
+        extracteur_liberer(&ex);
+        return code;
+    }
+    extracteur_terminer(&ex, feat);
+    return 0;
+}
+
+int extraire_features_qoi(QOIstream *flux, ImageFeatures *feat, const OptionsExtraction *opt) {
+    memset(feat, 0, sizeof(*feat));
+    ExtracteurFlux ex;
+    int code = extracteur_init(&ex, flux->width, flux->height, opt);
+    if (code != PNM_OK) return code;
+    for (long i = 0; i < flux->height; i++) {
+        byte *ligne;
+        code = NextQOIrow(flux, &ligne);
+        if (code != PNM_OK) {
+            extracteur_liberer(&ex);
+            return code;
+        }
+        if (flux->ncanal == 3) extracteur_ligne_rgb(&ex, (const rgb8*)ligne);
+        else extracteur_ligne_gris(&ex, ligne);
+    }
+    extracteur_terminer(&ex, feat);
+    return 0;
+}
+
+//lots de lignes tirés du lecteur en flux et poussés dans l'extracteur => empreinte fixe
+int extraire_features_flux_pnm(const char *filename, ImageFeatures *feat, const OptionsExtraction *opt) {
+    int image_type = opt->image_type;
+    memset(feat, 0, sizeof(*feat));
+    if (image_type != IMAGE_TYPE_PPM && image_type != IMAGE_TYPE_PGM) return PNM_ERR_FORMAT;
+
+    PNMstream flux;
+    int code = OpenPNMstream((char*)filename, LIGNES_LOT_FLUX, &flux);
+    if (code != PNM_OK) return code;
+    ExtracteurFlux ex;
+    if (flux.ncanal != ((image_type == IMAGE_TYPE_PPM) ? 3 : 1)) {
+        ClosePNMstream(&flux);
+        return PNM_ERR_FORMAT;
+    }
+    code = extracteur_init(&ex, flux.width, flux.height, opt);
+    if (code != PNM_OK) {
+        ClosePNMstream(&flux);
+        return code;
+    }
+
+    byte **lignes;
+    long k;
+    while ((k = NextPNMrows(&flux, LIGNES_LOT_FLUX, &lignes)) > 0) {
+        for (long i = 0; i < k; i++) {
+            if (flux.ncanal == 3) extracteur_ligne_rgb(&ex, (const rgb8*)lignes[i]);
+            else extracteur_ligne_gris(&ex, lignes[i]);
+        }
+    }
+    ClosePNMstream(&flux);
+    if (k < 0) { //fichier tronqué
+        extracteur_liberer(&ex);
+        return (int)k;
+    }
+    extracteur_terminer(&ex, feat);
+    return 0;
+}
+
+int extraire_features_vue(const PNMview *vue, ImageFeatures *feat, const OptionsExtraction *opt) {
+    long w = vue->width, h = vue->height;
+    memset(feat, 0, sizeof(*feat));
+    if (vue->ncanal == 1 && !opt->appliquer_filtre && opt->decimation <= 1) {
+        //gris brut : aucune ligne de travail, les noyaux lisent la projection
+        void *tampon = malloc(etage_gradient_octets(w));
+        if (!tampon) return PNM_ERR_MEMOIRE;
+        EtageGradient eg;
+        etage_gradient_init(&eg, opt, tampon, w);
+        SommesBande s;
+        sommes_bande_init(&s);
+        if (vue->stride == w) {
+            histogramme256_buffer(vue->base, w * h, s.hist);
+        } else {
+            histogramme256(vue->row, 0, h - 1, 0, w - 1, s.hist);
+        }
+        for (long i = 1; i + 1 < h; i++) {
+            gradient_ligne(vue->row[i - 1], vue->row[i], vue->row[i + 1], w, &eg, &s);
+        }
+        free(tampon);
+        sommes_vers_features(&s, w, h, 0, opt->mode_magnitude, opt->precision, feat);
+        return 0;
+    }
+    //rgb, filtre ou aperçu : l'extracteur lit les lignes projetées (pas de tampon de lecture)
+    ExtracteurFlux ex;
+    int code = extracteur_init(&ex, w, h, opt);
+    if (code != PNM_OK) return code;
+    for (long i = 0; i < h; i++) {
+        if (vue->ncanal == 3) extracteur_ligne_rgb(&ex, (const rgb8*)vue->row[i]);
+        else extracteur_ligne_gris(&ex, vue->row[i]);
+    }
+    extracteur_terminer(&ex, feat);
+    return 0;
+}
+
+//bande courante : lignes grises contiguës, les 2 premières sont le halo de la bande précédente
+typedef struct {
+    long width, cap;       // cap = lignes max, halo compris
+    long n, deja;          // lignes présentes / lignes du haut déjà comptées dans l'histogramme
+    long hist_restant;     // lignes encore à compter (le halo du bas d'une bande parallèle ne compte pas)
+    byte *lignes;
+    EtageGradient grad;
+    SommesBande *s;
+} BandeGris;
+
+//histogramme des nouvelles lignes, sobel des lignes qui ont leurs deux voisines dans la bande,
+//puis les 2 dernières lignes restent comme halo pour la bande suivante
+static void bande_traiter(BandeGris *bg) {
+    long w = bg->width;
+    long nh = bg->n - bg->deja;
+    if (nh > bg->hist_restant) nh = bg->hist_restant;
+    if (nh > 0) {
+        uint64_t H[256];
+        histogramme256_buffer(bg->lignes + bg->deja * w, nh * w, H);
+        for (int v = 0; v < 256; v++) bg->s->hist[v] += H[v];
+        bg->hist_restant -= nh;
+    }
+    //lignes 1..n-2 : la ligne 1 est la dernière de la bande précédente, pas encore traitée
+    for (long i = 1; i + 1 < bg->n; i++) {
+        gradient_ligne(bg->lignes + (i - 1) * w, bg->lignes + i * w, bg->lignes + (i + 1) * w, w,
+                       &bg->grad, bg->s);
+    }
+    long garde = (bg->n < 2) ? bg->n : 2;
+    memmove(bg->lignes, bg->lignes + (bg->n - garde) * w, (size_t)(garde * w));
+    bg->n = bg->deja = garde;
+}
+
+//prochaine ligne libre de la bande (traite la bande si elle est pleine)
+static byte *bande_reserver(BandeGris *bg) {
+    if (bg->n == bg->cap) bande_traiter(bg);
+    return bg->lignes + (bg->n++) * bg->width;
+}
+
+int extraire_features_par_bandes(const char *filename, ImageFeatures *feat, const OptionsExtraction *opt) {
+    int image_type = opt->image_type;
+    memset(feat, 0, sizeof(*feat));
+    if (image_type != IMAGE_TYPE_PPM && image_type != IMAGE_TYPE_PGM) return PNM_ERR_FORMAT;
+    if (opt->appliquer_filtre && (opt->rayon_filtre < 1 || opt->rayon_filtre > RAYON_FILTRE_MAX)) return PNM_ERR_FORMAT;
+
+    FILE *file = fopen(filename, "rb");
+    if (!file) return PNM_ERR_FICHIER;
+    int ncanal;
+    long width, height, maxval;
+    int code = ReadPNMheader(file, &ncanal, &width, &height, &maxval);
+    if (code == PNM_OK && ncanal != ((image_type == IMAGE_TYPE_PPM) ? 3 : 1)) code = PNM_ERR_FORMAT;
+    if (code != PNM_OK) {
+        fclose(file);
+        return code;
+    }
+
+    FiltreBoite filtre;
+    int filtrer = opt->appliquer_filtre;
+    if (filtrer && filtre_boite_init(&filtre, width, height, opt->rayon_filtre) != 0) {
+        fclose(file);
+        return PNM_ERR_MEMOIRE;
+    }
+    //pgm sans filtre : lecture directement dans la bande, sinon tampon brut à convertir/filtrer
+    int direct = (ncanal == 1 && !filtrer);
+    size_t octets_brut = direct ? 0 : (size_t)ncanal * (size_t)width;
+
+    //coût fixe : gx/gy, ligne de travail, anneau + sommes du filtre, halo de 2 lignes
+    //puis chaque ligne de la bande coûte une ligne grise + une ligne brute
+    long fixe = 4 * width + (filtrer ? (2 * filtre.rayon + 3) * width + 2 * (2 * width + 1) : 0) + 2 * width;
+    long nb = (opt->budget_bande - fixe) / (long)((size_t)width + octets_brut);
+    if (nb < 1) nb = 1;
+    if (nb > height) nb = height;
+
+    SommesBande sommes;
+    sommes_bande_init(&sommes);
+    BandeGris bg;
+    memset(&bg, 0, sizeof(bg));
+    bg.width = width;
+    bg.cap = nb + 2;
+    bg.hist_restant = height;
+    bg.s = &sommes;
+
+    size_t octets = ((size_t)(bg.cap + 1) * (size_t)width + 63) & ~(size_t)63; //étage gradient aligné
+    byte *bloc = (byte*)malloc(octets + etage_gradient_octets(width) + (size_t)nb * octets_brut);
+    if (!bloc) {
+        if (filtrer) filtre_boite_liberer(&filtre);
+        fclose(file);
+        return PNM_ERR_MEMOIRE;
+    }
+    bg.lignes = bloc;
+    byte *tmp = bloc + bg.cap * width;
+    etage_gradient_init(&bg.grad, opt, bloc + octets, width);
+    byte *brut = bloc + octets + etage_gradient_octets(width);
+
+    int erreur = 0;
+    for (long lues = 0; lues < height && !erreur; ) {
+        long k = (height - lues < nb) ? height - lues : nb;
+        if (direct) {
+            //après traitement il reste au plus 2 lignes de halo => nb lignes libres
+            if (bg.n + k > bg.cap) bande_traiter(&bg);
+            if (fread(bg.lignes + bg.n * width, (size_t)width, (size_t)k, file) != (size_t)k) erreur = 1;
+            bg.n += k;
+            lues += k;
+            continue;
+        }
+        //une seule lecture pour toute la bande
+        if (fread(brut, octets_brut, (size_t)k, file) != (size_t)k) {
+            erreur = 1;
+            break;
+        }
+        for (long i = 0; i < k; i++) {
+            const byte *src = brut + (size_t)i * octets_brut;
+            byte *gris = filtrer ? tmp : bande_reserver(&bg);
+            if (ncanal == 3) convertir_ligne_gris((const rgb8*)src, gris, width, opt->conversion_gris, &sommes);
+            else memcpy(gris, src, (size_t)width);
+            if (filtrer) {
+                const byte *filtree = filtre_boite_pousser(&filtre, gris);
+                if (filtree) memcpy(bande_reserver(&bg), filtree, (size_t)width);
+            }
+        }
+        lues += k;
+    }
+    if (filtrer) {
+        const byte *filtree;
+        if (!erreur) {
+            while ((filtree = filtre_boite_vider(&filtre)) != NULL) memcpy(bande_reserver(&bg), filtree, (size_t)width);
+        }
+        filtre_boite_liberer(&filtre);
+    }
+    if (!erreur) bande_traiter(&bg);
+    free(bloc);
+    fclose(file);
+    if (erreur) return PNM_ERR_TRONQUE;
+
+    sommes_vers_features(&sommes, width, height, ncanal == 3, opt->mode_magnitude, opt->precision, feat);
+    return 0;
+}
+
+//travail partagé entre les threads : les bandes sont prises dans l'ordre par un compteur atomique,
+//chacune écrit ses sommes dans sa propre case => l'ordre de fusion ne dépend pas de l'ordonnancement
+typedef struct {
+    const char *filename;
+    const OptionsExtraction *opt;
+    int ncanal;
+    long width, height;
+    off_t debut_donnees;     // position du premier pixel dans le fichier
+    long nb_bandes;
+    SommesBande *partielles;
+    long suivante;
+    int erreur;              // PNM_OK, sinon premier code PNM_ERR_* rencontré par un thread
+} TravailBandes;
+
+static void travail_erreur(TravailBandes *tb, int code) {
+    int attendu = PNM_OK;
+    __atomic_compare_exchange_n(&tb->erreur, &attendu, code, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+//bande [i0, i1] : lit les lignes i0-1..i1+1 (+ rayon du filtre) et calcule ses sommes partielles
+//seules les lignes i0..i1 comptent dans l'histogramme et les sommes de canaux, sobel sur i0..i1 (hors bords)
+static int bande_parallele(TravailBandes *tb, FILE *file, long i0, long i1, byte *brut, byte *tmp,
+                           BandeGris *bg, SommesBande *s) {
+    const OptionsExtraction *opt = tb->opt;
+    long w = tb->width, h = tb->height;
+    long a0 = (i0 > 0) ? i0 - 1 : 0;
+    long a1 = (i1 < h - 1) ? i1 + 1 : h - 1;
+    int filtrer = opt->appliquer_filtre;
+    int r = filtrer ? opt->rayon_filtre : 0;
+    long s0 = (a0 - r > 0) ? a0 - r : 0;
+    long s1 = (a1 + r < h - 1) ? a1 + r : h - 1;
+    size_t octets_ligne = (size_t)tb->ncanal * (size_t)w;
+
+    //filtre relancé à la ligne s0 : ses r premières lignes (bord relatif) tombent avant a0 sauf au vrai bord
+    FiltreBoite filtre;
+    if (filtrer && filtre_boite_init(&filtre, w, h - s0, r) != 0) return PNM_ERR_MEMOIRE;
+    if (fseeko(file, tb->debut_donnees + (off_t)s0 * (off_t)octets_ligne, SEEK_SET) != 0) {
+        if (filtrer) filtre_boite_liberer(&filtre);
+        return PNM_ERR_TRONQUE;
+    }
+
+    sommes_bande_init(s);
+    SommesBande halo = {0}; // canaux des lignes de halo, jetés
+    bg->s = s;
+    bg->n = 0;
+    bg->deja = (a0 < i0) ? 1 : 0;
+    bg->hist_restant = i1 - i0 + 1;
+    long emises = s0;
+    int erreur = 0;
+    for (long a = s0; a <= s1; a++) {
+        if (fread(brut, octets_ligne, 1, file) != 1) {
+            erreur = 1;
+            break;
+        }
+        byte *gris = filtrer ? tmp : bande_reserver(bg);
+        if (tb->ncanal == 3) {
+            convertir_ligne_gris((const rgb8*)brut, gris, w, opt->conversion_gris, (a >= i0 && a <= i1) ? s : &halo);
+        } else {
+            memcpy(gris, brut, (size_t)w);
+        }
+        if (filtrer) {
+            const byte *filtree = filtre_boite_pousser(&filtre, gris);
+            if (filtree && emises >= a0 && emises <= a1) memcpy(bande_reserver(bg), filtree, (size_t)w);
+            if (filtree) emises++;
+        }
+    }
+    if (filtrer) {
+        //au vrai bas de l'image => lignes de bord, sinon lignes au-delà de a1 ignorées
+        const byte *filtree;
+        while (!erreur && (filtree = filtre_boite_vider(&filtre)) != NULL) {
+            if (emises >= a0 && emises <= a1) memcpy(bande_reserver(bg), filtree, (size_t)w);
+            emises++;
+        }
+        filtre_boite_liberer(&filtre);
+    }
+    if (erreur) return PNM_ERR_TRONQUE;
+    bande_traiter(bg);
+    return PNM_OK;
+}
+
+static void *travailleur_bandes(void *arg) {
+    TravailBandes *tb = (TravailBandes*)arg;
+    long w = tb->width;
+    FILE *file = fopen(tb->filename, "rb");
+    //une bande + halo tient toujours dans la fenêtre => un seul traitement par bande
+    BandeGris bg;
+    memset(&bg, 0, sizeof(bg));
+    bg.width = w;
+    bg.cap = LIGNES_BANDE_PARALLELE + 2;
+    size_t octets = ((size_t)(bg.cap + 1) * (size_t)w + 63) & ~(size_t)63; //étage gradient aligné
+    byte *bloc = (byte*)malloc(octets + etage_gradient_octets(w) + (size_t)tb->ncanal * (size_t)w);
+    if (!file || !bloc) {
+        travail_erreur(tb, file ? PNM_ERR_MEMOIRE : PNM_ERR_FICHIER);
+        free(bloc);
+        if (file) fclose(file);
+        return NULL;
+    }
+    bg.lignes = bloc;
+    byte *tmp = bloc + bg.cap * w;
+    etage_gradient_init(&bg.grad, tb->opt, bloc + octets, w);
+    byte *brut = bloc + octets + etage_gradient_octets(w);
+
+    for (;;) {
+        long b = __atomic_fetch_add(&tb->suivante, 1, __ATOMIC_RELAXED);
+        if (b >= tb->nb_bandes || __atomic_load_n(&tb->erreur, __ATOMIC_RELAXED) != PNM_OK) break;
+        long i0 = b * LIGNES_BANDE_PARALLELE;
+        long i1 = (i0 + LIGNES_BANDE_PARALLELE - 1 < tb->height - 1) ? i0 + LIGNES_BANDE_PARALLELE - 1 : tb->height - 1;
+        int code = bande_parallele(tb, file, i0, i1, brut, tmp, &bg, &tb->partielles[b]);
+        if (code != PNM_OK) {
+            travail_erreur(tb, code);
+            break;
+        }
+    }
+    free(bloc);
+    fclose(file);
+    return NULL;
+}
+
+int extraire_features_parallele(const char *filename, ImageFeatures *feat, const OptionsExtraction *opt) {
+    int image_type = opt->image_type;
+    memset(feat, 0, sizeof(*feat));
+    if (image_type != IMAGE_TYPE_PPM && image_type != IMAGE_TYPE_PGM) return PNM_ERR_FORMAT;
+    if (opt->appliquer_filtre && (opt->rayon_filtre < 1 || opt->rayon_filtre > RAYON_FILTRE_MAX)) return PNM_ERR_FORMAT;
+
+    //entête lu une fois => position des pixels, chaque thread rouvre le fichier
+    FILE *file = fopen(filename, "rb");
+    if (!file) return PNM_ERR_FICHIER;
+    TravailBandes tb;
+    long maxval;
+    memset(&tb, 0, sizeof(tb));
+    int code = ReadPNMheader(file, &tb.ncanal, &tb.width, &tb.height, &maxval);
+    if (code == PNM_OK && tb.ncanal != ((image_type == IMAGE_TYPE_PPM) ? 3 : 1)) code = PNM_ERR_FORMAT;
+    if (code != PNM_OK) {
+        fclose(file);
+        return code;
+    }
+    tb.debut_donnees = ftello(file);
+    fclose(file);
+    tb.filename = filename;
+    tb.opt = opt;
+    tb.nb_bandes = (tb.height + LIGNES_BANDE_PARALLELE - 1) / LIGNES_BANDE_PARALLELE;
+    tb.partielles = (SommesBande*)malloc((size_t)tb.nb_bandes * sizeof(SommesBande));
+    if (!tb.partielles) return PNM_ERR_MEMOIRE;
+
+    long nb_threads = opt->nb_threads;
+    if (nb_threads < 0) nb_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nb_threads < 1) nb_threads = 1;
+    if (nb_threads > tb.nb_bandes) nb_threads = tb.nb_bandes;
+
+    //le thread appelant travaille aussi
+    pthread_t *threads = (pthread_t*)malloc((size_t)nb_threads * sizeof(pthread_t));
+    long lances = 0;
+    if (threads) {
+        for (; lances < nb_threads - 1; lances++) {
+            if (pthread_create(&threads[lances], NULL, travailleur_bandes, &tb) != 0) break;
+        }
+    }
+    travailleur_bandes(&tb);
+    for (long t = 0; t < lances; t++) pthread_join(threads[t], NULL);
+    free(threads);
+
+    if (tb.erreur != PNM_OK) {
+        free(tb.partielles);
+        return tb.erreur;
+    }
+    //fusion dans l'ordre des bandes
+    SommesBande total;
+    sommes_bande_init(&total);
+    for (long b = 0; b < tb.nb_bandes; b++) sommes_bande_fusionner(&total, &tb.partielles[b]);
+    free(tb.partielles);
 
+    sommes_vers_features(&total, tb.width, tb.height, tb.ncanal == 3, opt->mode_magnitude, opt->precision, feat);
     return 0;
 }
 
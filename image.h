@@ -16,7 +16,14 @@
 //constantes pour différencier la logique de traitement
 #define IMAGE_TYPE_PGM 0  // Niveaux de gris
 #define IMAGE_TYPE_PPM 1  // Couleur
-#define IMAGE_TYPE_JPEG 2  // Non supporté par NRC (retourne erreur)
+#define IMAGE_TYPE_JPEG 2  // Décodeur baseline de jpeg.c (pas de conversion préalable en PPM)
+#define IMAGE_TYPE_PNG 3   // Lecteur png.c, lignes décompressées à la volée
+#define IMAGE_TYPE_QOI 4   // Cache sans perte (codec QOI de nrio.c, voir conversion.c)
+
+//type d'après l'extension du nom de fichier (.pgm, .ppm, .jpg / .jpeg, .png, .qoi), -1 si ce n'est pas une image
+int image_type_depuis_nom(const char *nom);
+//type d'après les premiers octets du fichier (P5, P6, FF D8 FF, signature PNG, "qoif"), -1 sinon
+int image_type_depuis_magie(const byte *entete, size_t taille);
 
 
 typedef struct {
@@ -32,6 +39,51 @@ typedef struct {
     double hist[256];       
 } ImageFeatures;
 
+//mode de calcul de la norme du gradient
+#define MAGNITUDE_EXACTE  0  // sqrt en double, référence reproductible (par défaut)
+#define MAGNITUDE_ENTIERE 1  // contours par gx²+gy² >= (t*1500)², moyenne en Q8 entier (erreur <= 1.4e-6)
+
+//conversion rgb -> gris
+//GRIS_VIRGULE_FIXE : ±1 niveau sur 0.06% des couleurs seulement, mais parmi elles 65 gris neutres (r=g=b),
+//très fréquents dans les vraies photos => écarts mesurés contre GRIS_EXACT sur archive500ppm (500 images) :
+//  histogramme : L1 > 0.05 sur 268 images, jusqu'à 0.90 (387.ppm) ; Bhattacharyya entre les deux jusqu'à 0.34
+//  moyenne_gradient_norme |delta| <= 1.3e-4, densite_contours |delta| <= 5.1e-4
+//=> ne jamais classer ensemble des signatures calculées avec des modes de conversion différents
+#define GRIS_EXACT        0  // (int)(0.299 r + 0.587 g + 0.114 b) en double, référence (par défaut)
+#define GRIS_VIRGULE_FIXE 1  // 16.16 vectorisé avec sommes des canaux fusionnées (histogrammes décalés, voir plus haut)
+#define GRIS_LUMA         2  // jpeg : gris = composante Y décodée, chromas jamais reconstruites => ratios à 1/3 et
+                             // pas couleur ; autres formats : comme GRIS_EXACT
+
+//précision des normes par pixel en mode MAGNITUDE_EXACTE (le mode entier a son propre chemin)
+//écarts mesurés contre PRECISION_DOUBLE sur archive500ppm (500 images, seuil 0.25) :
+//  FLOAT32 : moyenne_gradient_norme |delta| <= 3.0e-10, densite_contours et histogramme identiques
+//  Q16     : moyenne_gradient_norme |delta| <= 1.2e-6,  densite_contours et histogramme identiques
+//temps sur la même archive : 0.33 s (double), 0.26 s (float32), 0.24 s (q16)
+#define PRECISION_DOUBLE  0  // référence, norme en double
+#define PRECISION_FLOAT32 1  // norme float (sqrt simple précision vectorisée)
+#define PRECISION_Q16     2  // norme uint16 en 1/65535, somme entière exacte
+
+//options d'extraction => évite d'allonger la signature de extraire_features_from_file à chaque ajout
+typedef struct {
+    int    appliquer_filtre;  // filtre moyenneur avant le gradient
+    int    rayon_filtre;      // 1 (3x3, défaut), 2 (5x5) ou 3 (7x7)
+    double seuil_contour;     // seuil sur la norme normalisée
+    int    image_type;        // IMAGE_TYPE_PGM / PPM / JPEG / PNG / QOI
+    int    mode_magnitude;    // MAGNITUDE_EXACTE / MAGNITUDE_ENTIERE
+    int    conversion_gris;   // GRIS_EXACT / GRIS_VIRGULE_FIXE / GRIS_LUMA
+    int    precision;         // PRECISION_DOUBLE / PRECISION_FLOAT32 / PRECISION_Q16
+    int    decimation;        // 1 => pleine résolution, f (2..DECIMATION_MAX) => aperçu réduit f x f
+    int    echelle_jpeg;      // jpeg seulement : 1 (IDCT complète), 2 / 4 (IDCT partielle), 8 (DC seul)
+    int    lecture_mmap;      // 1 => fichier projeté en mémoire (MapPNM), pixels lus en place
+    long   budget_bande;      // 0 => ligne par ligne, sinon octets max pour le traitement par bandes
+    int    nb_threads;        // 0 => une seule passe séquentielle, n > 0 => bandes réparties sur n threads,
+                              // < 0 => autant de threads que de cœurs
+} OptionsExtraction;
+
+//valeurs par défaut : pas de filtre (rayon 1 si activé), SEUIL_CONTOUR, PPM, magnitude et gris exacts,
+//lecture ligne par ligne, pleine résolution
+void options_extraction_defaut(OptionsExtraction *opt);
+
 
 
 
@@ -48,12 +100,52 @@ rgb8 **load_ppm_rgb_and_to_gray(const char *filename,
                                 double *r_ratio, double *g_ratio, double *b_ratio,
                                 int *is_color);
 
+//Charge un jpeg (décodeur de jpeg.c, pleine résolution) => matrice en gris, mêmes ratios / détection que le PPM
+//une seule composante => gris direct comme un PGM (ratios à 1/3, pas couleur) ; NULL si fichier illisible
+//r_ratio NULL => ratios non voulus : seule la luma est décodée (IDCT des chromas sautée), is_color ignoré
+byte **load_jpeg_gray(const char *filename, long *nrl, long *nrh, long *ncl, long *nch,
+                      double *r_ratio, double *g_ratio, double *b_ratio, int *is_color);
+//pareil pour un png (png.c) : gris / gris + alpha => gris direct, RGB / RGBA / palette => comme un PPM
+byte **load_png_gray(const char *filename, long *nrl, long *nrh, long *ncl, long *nch,
+                     double *r_ratio, double *g_ratio, double *b_ratio, int *is_color);
+//pareil pour le cache QOI : canaux = 1 => gris direct, sinon comme un PPM
+byte **load_qoi_gray(const char *filename, long *nrl, long *nrh, long *ncl, long *nch,
+                     double *r_ratio, double *g_ratio, double *b_ratio, int *is_color);
+
 
 //sauvegarde format pgm ...
 void save_pgm_gray(const char *filename, byte **m, long nrl, long nrh, long ncl, long nch);
 
 //Applique un filtre moyenneur 3x3 (convolution avec masque uniforme) => évite pas de padding ici
-void filtre_moyenneur(byte **in, byte **out, long nrl, long nrh, long ncl, long nch);
+//retourne -1 si les tampons du filtre n'ont pas pu être alloués (out non rempli)
+int  filtre_moyenneur(byte **in, byte **out, long nrl, long nrh, long ncl, long nch);
+
+//même filtre avec un rayon au choix (1 => 3x3, 2 => 5x5, 3 => 7x7), bords de largeur rayon recopiés
+//retourne -1 si le rayon n'est pas supporté
+int filtre_moyenneur_rayon(byte **in, byte **out, long nrl, long nrh, long ncl, long nch, int rayon);
+
+//filtre boîte séparable par sommes glissantes : O(1) par pixel quel que soit le rayon
+//on pousse les lignes brutes dans l'ordre, les lignes filtrées ressortent dans l'ordre avec rayon lignes de retard
+//seules 2*rayon+1 lignes brutes sont gardées => peut alimenter le gradient sans image filtrée complète
+#define RAYON_FILTRE_MAX 3
+typedef struct {
+    long width, height;
+    int  rayon;
+    long recues, emises;     // lignes poussées / lignes ressorties
+    byte *anneau;            // 2*rayon+1 lignes brutes
+    uint16 *colonnes;        // somme verticale des 2*rayon+1 dernières lignes
+    uint16 *prefixe;         // préfixe horizontal des colonnes (width+1 entrées, modulo 2^16)
+    byte *sortie;            // ligne filtrée courante
+    uint16 mult;             // division par (2*rayon+1)² = mulhi(s, mult) >> decalage
+    int  decalage;
+} FiltreBoite;
+
+int  filtre_boite_init(FiltreBoite *fb, long width, long height, int rayon);
+//pousse une ligne brute, retourne la prochaine ligne filtrée disponible ou NULL
+const byte *filtre_boite_pousser(FiltreBoite *fb, const byte *ligne);
+//après la dernière ligne : retourne une à une les lignes restantes (bas de l'image) puis NULL
+const byte *filtre_boite_vider(FiltreBoite *fb);
+void filtre_boite_liberer(FiltreBoite *fb);
 
 // Calcule les gradients Sobel Ix (horizontal) et Iy (vertical) en int toujours sans padding
 //entrée matrice en niveaux de gris, 
@@ -67,16 +159,166 @@ double gradient_magnitude_norm(byte **gray, double **mag_norm,
 double detection_contours_hysterisis(double **mag_norm, byte **edges,
                       long nrl, long nrh, long ncl, long nch, double t_norm);
 
+//histogramme à 4 sous-histogrammes uint32 fusionnés à la fin (évite la sérialisation sur un même compteur)
+//les bancs sont vidés dans le total 64 bits avant de pouvoir déborder
+typedef struct {
+    uint32 bancs[4][256];
+    uint64_t total[256];
+    uint64_t depuis_vidage;
+} HistogrammeBancs;
+
+void histo_bancs_init(HistogrammeBancs *hb);
+void histo_bancs_ajouter(HistogrammeBancs *hb, const byte *p, long n); // n octets contigus
+uint64_t histo_bancs_fusionner(HistogrammeBancs *hb, uint64_t H[256]); // comptes totaux, retourne N
+
+//histogramme non normalisé (comptes) d'un buffer contigu ou d'une matrice NRC, retourne le nombre de pixels
+uint64_t histogramme256_buffer(const byte *p, long n, uint64_t H[256]);
+uint64_t histogramme256(byte **gray, long nrl, long nrh, long ncl, long nch, uint64_t H[256]);
+
 // Calcule l'histogramme des 256 niveaux de gris, normalisé (somme = 1)
 void histogramme256_normalise(byte **gray, long nrl, long nrh, long ncl, long nch, double hist[256]);
 
 
 // Fonction principale : extrait toutes les caractéristiques d'un fichier image (PGM/PPM auto-détecté)
+//passe par l'extracteur fusionné (une seule passe, mémoire en O(width))
 //si apply_filtre à 1 => on fait le filtre moyenneur sinon non
 //seuil_contour : seuil pour les contours (par défaut SEUIL_CONTOUR) 
 int extraire_features_from_file(const char *filename, ImageFeatures *feat,
                                int do_apply_filtre , double seuil_contour , int image_type); //pointeur ici sur le feature car on veut pas créer de copie
 
+// Version de référence en plusieurs passes (matrices NRC complètes : gris, ix, iy, mag_norm, edges)
+int extraire_features_multipasse(const char *filename, ImageFeatures *feat,
+                                 int do_apply_filtre, double seuil_contour, int image_type);
+
+//heuristique couleur / noir et blanc à partir des sommes de canaux
+int verifier_image_couleur_est_nb(uint64_t rsum, uint64_t gsum, uint64_t bsum,
+                                  long nrl, long nrh, long ncl, long nch);
+
+
+//aperçu décimé : moyenne de chaque bloc f x f calculée pendant la lecture des lignes (canaux moyennés
+//avant la conversion en gris), gradient et contours sur l'image réduite (f² fois moins de pixels)
+//ratios de couleur exacts (sommes sur tous les pixels), histogramme des blocs pondéré par leur surface
+//(blocs incomplets du bord droit/bas), dimensions de la source dans ImageFeatures
+//passe toujours par l'extracteur ligne à ligne (budget_bande et nb_threads ignorés)
+//mesures (seuil 0.25, sans filtre) : écarts max au plein format sur moyenne/densité/histogramme (L1),
+//recouvrement du top 10 de main.c (référence archive500ppm/2.ppm, 1re image pour archive10ppm), temps :
+//  archive10ppm  f=1 :                                            17 ms
+//                f=2 : moyenne 0.020, densité 0.018, L1 0.17, top 10 10/10, 10 ms
+//                f=4 : moyenne 0.041, densité 0.046, L1 0.32, top 10 10/10,  4 ms
+//  archive500ppm f=1 :                                           229 ms
+//                f=2 : moyenne 0.068, densité 0.129, L1 0.35, top 10  9/10, 139 ms
+//                f=4 : moyenne 0.115, densité 0.237, L1 0.61, top 10  8/10,  65 ms
+//=> les écarts sur la densité viennent du seuil appliqué à une échelle plus grossière (gradients lissés)
+#define DECIMATION_MAX 4
+
+//sommes partielles sur un ensemble de lignes (image entière ou bande) => les features s'en déduisent
+//tout est entier sauf somme_mag (mode exact) qui dépend de l'ordre de sommation
+typedef struct {
+    uint64_t hist[256];
+    uint64_t Rsum, Gsum, Bsum;
+    uint64_t somme_mag_q8;   // somme des normes en Q8 (mode entier)
+    uint64_t somme_mag_q16;  // somme des normes normalisées en 1/65535 (PRECISION_Q16)
+    double somme_mag;
+    long nb_interieur, nb_contours;
+} SommesBande;
+
+void sommes_bande_init(SommesBande *s);
+//total += b (histogramme, sommes de canaux, gradient, contours)
+void sommes_bande_fusionner(SommesBande *total, const SommesBande *b);
+
+//étage gradient : mode, précision, seuils précalculés et tampons d'une ligne (gx, gy, normes)
+typedef struct {
+    int mode_magnitude;
+    int precision;
+    double seuil_contour;
+    int32 seuil_carre;       // seuil de contour en domaine entier (gx²+gy²)
+    float seuil_f32;
+    uint32 seuil_q16;        // 65536 => jamais atteint
+    int16 *gx, *gy;          // gradients sobel de la ligne du milieu
+    void *normes;            // normes de la ligne en float ou uint16
+} EtageGradient;
+
+//extracteur fusionné en une seule passe : on pousse les lignes une par une (gris ou rgb)
+//fenêtre glissante de 3 lignes => mémoire en O(width) au lieu de ~21 octets par pixel
+typedef struct {
+    long width, height;      // dimensions traitées (réduites si décimation)
+    long largeur_source, hauteur_source;
+    int  appliquer_filtre;
+    int  decimation;
+    uint32 *acc;             // sommes des blocs de la ligne réduite en cours (3 canaux si rgb)
+    long lignes_acc;         // lignes source accumulées dans le bloc en cours
+    rgb8 *moyenne_rgb;       // ligne réduite en rgb avant conversion
+    long lignes_traitees;    // lignes entrées dans l'étage sobel/histogramme
+    FiltreBoite filtre;      // étage filtre (si appliquer_filtre)
+    byte *fen[3];            // fenêtre sobel
+    byte *tmp;               // ligne de travail (gris converti)
+    EtageGradient grad;
+    byte *bloc;              // allocation unique pour toutes les lignes
+    HistogrammeBancs hist;
+    int  est_rgb;
+    int  conversion_gris;
+    SommesBande sommes;      // canaux, gradient et contours (histogramme rempli à la fin depuis hist)
+} ExtracteurFlux;
+
+//retourne PNM_OK, PNM_ERR_DIMENSIONS (image vide, décimation hors bornes), PNM_ERR_FORMAT (rayon du filtre
+//hors bornes) ou PNM_ERR_MEMOIRE
+int  extracteur_init(ExtracteurFlux *ex, long width, long height, const OptionsExtraction *opt);
+void extracteur_ligne_gris(ExtracteurFlux *ex, const byte *ligne);
+void extracteur_ligne_rgb(ExtracteurFlux *ex, const rgb8 *ligne);
+void extracteur_terminer(ExtracteurFlux *ex, ImageFeatures *feat); //remplit feat et libère
+void extracteur_liberer(ExtracteurFlux *ex);
+
+//lit le fichier ligne par ligne et pousse dans l'extracteur, mêmes résultats que la version multipasse
+int extraire_features_fusionne(const char *filename, ImageFeatures *feat,
+                               int do_apply_filtre, double seuil_contour, int image_type);
+//même chose avec toutes les options (mode magnitude, ...), passe par les bandes si opt->budget_bande > 0
+//retourne 0, ou un code PNM_ERR_* de nrio.h (entête invalide, maxval > 255, fichier tronqué, ...) qu'on peut
+//afficher avec PNMerror ; aucune lecture n'appelle nrerror => l'appelant passe simplement à l'image suivante
+int extraire_features_avec_options(const char *filename, ImageFeatures *feat, const OptionsExtraction *opt);
+
+//lecture par lots de LIGNES_LOT_FLUX lignes avec le lecteur en flux de nrio (OpenPNMstream / NextPNMrows)
+//=> empreinte fixe (anneau + fenêtres de l'extracteur) quelle que soit la taille de l'image, le calcul
+//commence dès le premier lot ; chemin par défaut de extraire_features_avec_options
+#define LIGNES_LOT_FLUX 16
+int extraire_features_flux_pnm(const char *filename, ImageFeatures *feat, const OptionsExtraction *opt);
+
+//extraction sur une image déjà projetée (MapPNM) : gris sans filtre ni décimation => histogramme et sobel
+//directement sur les lignes projetées, sinon les lignes projetées sont poussées dans l'extracteur sans copie
+//intermédiaire ; mêmes résultats que la lecture par fread
+int extraire_features_vue(const PNMview *vue, ImageFeatures *feat, const OptionsExtraction *opt);
+//même chose sur un fichier P5/P6 complet déjà lu en mémoire (ViewPNM), donnees doit rester valide pendant l'appel
+//(jpeg / png / qoi selon opt->image_type) ; toujours un code PNM_* (PNMerror), type inconnu => PNM_ERR_FORMAT
+int extraire_features_tampon(const byte *donnees, size_t taille, ImageFeatures *feat, const OptionsExtraction *opt);
+
+//jpeg complet en mémoire : décodé à 1/opt->echelle_jpeg puis poussé ligne à ligne dans l'extracteur
+//(gris si une seule composante ou si opt->conversion_gris == GRIS_LUMA, rgb sinon), dimensions des features = dimensions de l'entête
+//écarts max sur archive500ppm recompressé en qualité 90 contre les PPM d'origine (500 images, seuil 0.25) :
+//  echelle 1 : moyenne 0.0012, densité 0.0017, L1 histogramme 0.23, ratios 0.004 (pertes jpeg seules)
+//  echelle 2 : moyenne 0.068,  densité 0.129,  L1 0.34 (mêmes écarts que la décimation f=2)
+//  echelle 4 : moyenne 0.115,  densité 0.236,  L1 0.60
+//  echelle 8 : moyenne 0.191,  densité 0.373,  L1 0.90
+int extraire_features_jpeg(const byte *donnees, size_t taille, ImageFeatures *feat, const OptionsExtraction *opt);
+
+//png complet en mémoire : chaque ligne est décompressée, défiltrée et poussée dans l'extracteur aussitôt
+//=> pas d'image décodée en mémoire ; mêmes features que le PPM d'origine (compression sans perte)
+int extraire_features_png(const byte *donnees, size_t taille, ImageFeatures *feat, const OptionsExtraction *opt);
+
+//flux QOI ouvert (ViewQOI sur un tampon, MapQOI sur un fichier) : lignes décodées poussées dans l'extracteur,
+//le flux reste à fermer par l'appelant ; mêmes features que le PPM / PGM d'origine
+int extraire_features_qoi(QOIstream *flux, ImageFeatures *feat, const OptionsExtraction *opt);
+
+//traitement par bandes horizontales : une lecture par bande, halo de 2 lignes gardé d'une bande à l'autre
+//pour sobel, sommes partielles de chaque bande fusionnées => mêmes résultats que la lecture ligne par ligne
+//mémoire de pointe <= opt->budget_bande octets (au minimum une ligne par bande)
+int extraire_features_par_bandes(const char *filename, ImageFeatures *feat, const OptionsExtraction *opt);
+
+//découpage en bandes de LIGNES_BANDE_PARALLELE lignes traitées en parallèle (chaque thread relit ses lignes
+//+ halo directement dans le fichier), sommes partielles fusionnées dans l'ordre des bandes
+//=> résultats identiques au bit près quel que soit opt->nb_threads
+//(le découpage fixe l'ordre de sommation de la moyenne en mode exact, identique au séquentiel en mode entier)
+#define LIGNES_BANDE_PARALLELE 64
+int extraire_features_parallele(const char *filename, ImageFeatures *feat, const OptionsExtraction *opt);
+
 // Écrit l'en-tête CSV (noms des colonnes)
 void ecrire_csv_header(FILE *fout);
 
@@ -0,0 +1,627 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include "jpeg.h"
+#include "nrc/nrio.h"
+#include "nrc/nralloc.h"
+
+//position naturelle (ligne * 8 + colonne) du k-ième coefficient dans l'ordre zigzag
+static const byte zigzag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+//codes huffman de 9 bits ou moins résolus par une seule lecture de table
+#define HUFF_RAPIDE 9
+#define HUFF_AUCUN  0xFFFF
+
+typedef struct {
+    uint16 rapide[1 << HUFF_RAPIDE];  // indice du symbole, HUFF_AUCUN si code plus long
+    byte   longueur[256];             // longueur du code de chaque symbole
+    byte   valeurs[256];
+    int32  maxcode[18];               // plus grand code de longueur l, -1 si aucun
+    int    delta[17];                 // indice du symbole = code + delta[l]
+    int32  ac_rapide[1 << HUFF_RAPIDE]; // tables AC : code + bits de valeur <= 9 bits décodés d'un coup
+                                        // (valeur << 8) | (saut << 4) | bits consommés, 0 sinon
+    int    presente;
+} TableHuffman;
+
+//flux de bits de l'entropie : tampon aligné à gauche, octets de bourrage FF 00 retirés
+//un marqueur arrête la lecture (des zéros sont injectés ensuite), p reste sur son FF
+typedef struct {
+    const byte *p, *fin;
+    uint32_t tampon;
+    int nbits;
+    int marqueur;
+    int zeros;       // octets inventés après la fin des données => fichier tronqué
+} LecteurBits;
+
+typedef struct {
+    int id, h, v, tq;
+    int td, ta;              // tables huffman du scan en cours
+    int pred;                // prédicteur DC
+    long blocs_x, blocs_y;   // blocs du plan (complétés au MCU)
+    long largeur, hauteur;   // plan décodé = blocs * (8 / echelle)
+    byte *plan;              // NULL si la composante n'est pas reconstruite
+} ComposanteJPEG;
+
+typedef struct {
+    uint16 q[4][64];         // tables de quantification en ordre zigzag
+    float  qf[4][64];        // mêmes tables en float, facteurs AAN et 1/8 inclus en pleine échelle
+    int q_presente[4];
+    TableHuffman dc[4], ac[4];
+    ComposanteJPEG comp[3];
+    int nb_comp, hmax, vmax;
+    long width, height, mcux, mcuy;
+    int intervalle;          // MCU entre deux marqueurs RST (0 = aucun)
+    int adobe;               // transformée couleur de l'APP14 Adobe (-1 si absent)
+    int sof_lu, nb_scans;
+    size_t taille;           // taille du fichier
+    int n;                   // pixels par côté de bloc en sortie (8 / echelle)
+    int luma_seule;
+    float idct[8][8];        // idct[k][u] : poids du coefficient u sur la sortie k (moyenne de echelle pixels)
+    float facteur_dc;        // coefficient DC déquantifié -> moyenne du bloc
+} DecodeurJPEG;
+
+static inline byte borne_octet(int v) {
+    if (v < 0) return 0;
+    if (v > 255) return 255;
+    return (byte)v;
+}
+
+int jpeg_signature(const byte *donnees, size_t taille) {
+    return taille >= 3 && donnees[0] == 0xFF && donnees[1] == 0xD8 && donnees[2] == 0xFF;
+}
+
+//base IDCT 1D moyennée sur les echelle sorties qui tombent dans le même pixel réduit (echelle 2 et 4)
+//echelle 8 => idct[0][0] = 1/(2 sqrt 2), le reste à 0 ; echelle 1 passe par l'AAN
+static void idct_preparer(DecodeurJPEG *d, int echelle) {
+    d->n = 8 / echelle;
+    d->facteur_dc = (d->n == 8) ? 1.0f : 0.125f; //1/8 déjà dans qf en pleine échelle
+    for (int k = 0; k < d->n; k++) {
+        for (int u = 0; u < 8; u++) {
+            double cu = (u == 0) ? sqrt(0.5) : 1.0, s = 0.0;
+            for (int x = k * echelle; x < (k + 1) * echelle; x++) s += cos((2 * x + 1) * u * M_PI / 16.0);
+            d->idct[k][u] = (float)(cu * 0.5 * s / echelle);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------------------
+//huffman
+
+static int huffman_construire(TableHuffman *t, const byte nb[16], const byte *vals, int total) {
+    int code = 0, k = 0;
+    for (int i = 0; i < (1 << HUFF_RAPIDE); i++) t->rapide[i] = HUFF_AUCUN;
+    for (int l = 1; l <= 16; l++) {
+        t->delta[l] = k - code;
+        //vérifié avant d'écrire : plus de codes que la longueur n'en permet, ou que de valeurs
+        if (code + nb[l - 1] > (1 << l) || k + nb[l - 1] > total) return -1;
+        for (int i = 0; i < nb[l - 1]; i++, k++) {
+            t->longueur[k] = (byte)l;
+            if (l <= HUFF_RAPIDE) {
+                int d = code << (HUFF_RAPIDE - l);
+                for (int r = 0; r < (1 << (HUFF_RAPIDE - l)); r++) t->rapide[d + r] = (uint16)k;
+            }
+            code++;
+        }
+        t->maxcode[l] = nb[l - 1] ? code - 1 : -1;
+        code <<= 1;
+    }
+    t->maxcode[17] = INT_MAX;
+    memcpy(t->valeurs, vals, (size_t)total);
+    t->presente = 1;
+    return 0;
+}
+
+static inline int etendre(int v, int s);
+
+//coefficient AC complet (saut, taille, valeur) quand code et bits de valeur tiennent dans HUFF_RAPIDE bits
+static void huffman_construire_ac(TableHuffman *t) {
+    for (int i = 0; i < (1 << HUFF_RAPIDE); i++) {
+        int k = t->rapide[i];
+        t->ac_rapide[i] = 0;
+        if (k == HUFF_AUCUN) continue;
+        int rs = t->valeurs[k], r = rs >> 4, s = rs & 15, l = t->longueur[k];
+        if (s == 0 || l + s > HUFF_RAPIDE) continue;
+        int v = (i >> (HUFF_RAPIDE - l - s)) & ((1 << s) - 1);
+        t->ac_rapide[i] = etendre(v, s) * 256 + (r << 4) + (l + s);
+    }
+}
+
+static void bits_remplir(LecteurBits *lb) {
+    while (lb->nbits <= 24) {
+        int c = 0;
+        if (!lb->marqueur && lb->p < lb->fin) {
+            c = *lb->p++;
+            if (c == 0xFF) {
+                int c2 = (lb->p < lb->fin) ? *lb->p : 0xD9;
+                if (c2 == 0x00) lb->p++;
+                else {
+                    lb->marqueur = c2;
+                    lb->p--;
+                    c = 0;
+                }
+            }
+        } else if (!lb->marqueur) {
+            lb->zeros++;
+        }
+        lb->tampon |= (uint32_t)c << (24 - lb->nbits);
+        lb->nbits += 8;
+    }
+}
+
+static inline int bits_lire(LecteurBits *lb, int n) {
+    if (n == 0) return 0;
+    if (lb->nbits < n) bits_remplir(lb);
+    int v = (int)(lb->tampon >> (32 - n));
+    lb->tampon <<= n;
+    lb->nbits -= n;
+    return v;
+}
+
+//valeur signée sur s bits (catégorie jpeg)
+static inline int etendre(int v, int s) {
+    return (v < (1 << (s - 1))) ? v - (1 << s) + 1 : v;
+}
+
+//symbole suivant, -1 si le code n'existe pas dans la table
+static inline int huffman_decoder(LecteurBits *lb, const TableHuffman *t) {
+    if (lb->nbits < 16) bits_remplir(lb);
+    int k = t->rapide[lb->tampon >> (32 - HUFF_RAPIDE)];
+    if (k != HUFF_AUCUN) {
+        int l = t->longueur[k];
+        lb->tampon <<= l;
+        lb->nbits -= l;
+        return t->valeurs[k];
+    }
+    int code = (int)(lb->tampon >> 16), l;
+    for (l = HUFF_RAPIDE + 1; l <= 16; l++) {
+        if ((code >> (16 - l)) <= t->maxcode[l]) break;
+    }
+    if (l > 16) return -1;
+    k = (code >> (16 - l)) + t->delta[l];
+    lb->tampon <<= l;
+    lb->nbits -= l;
+    return t->valeurs[k];
+}
+
+//------------------------------------------------------------------------------------------------
+//blocs
+
+//décode un bloc, coefficients déquantifiés en ordre naturel si coef != NULL (sinon on saute juste les bits)
+//*lignes : bit v à 1 si la ligne v contient un coefficient non nul ; dc_seul => les AC ne sont pas rangés
+static int bloc_decoder(DecodeurJPEG *d, LecteurBits *lb, ComposanteJPEG *c, float *coef, int *lignes, int dc_seul) {
+    const float *q = d->qf[c->tq];
+    int t = huffman_decoder(lb, &d->dc[c->td]);
+    if (t < 0 || t > 11) return -1;
+    c->pred += t ? etendre(bits_lire(lb, t), t) : 0;
+    if (coef) {
+        memset(coef, 0, 64 * sizeof(float));
+        coef[0] = (float)c->pred * q[0];
+        *lignes = 1;
+    }
+    for (int k = 1; k < 64; k++) {
+        const TableHuffman *ta = &d->ac[c->ta];
+        if (lb->nbits < 16) bits_remplir(lb);
+        int32 f = ta->ac_rapide[lb->tampon >> (32 - HUFF_RAPIDE)];
+        if (f) {
+            k += (f >> 4) & 15;
+            if (k > 63) return -1;
+            lb->tampon <<= f & 15;
+            lb->nbits -= f & 15;
+            if (coef && !dc_seul) {
+                int z = zigzag[k];
+                coef[z] = (float)(f >> 8) * q[k];
+                *lignes |= 1 << (z >> 3);
+            }
+            continue;
+        }
+        int rs = huffman_decoder(lb, ta);
+        if (rs < 0) return -1;
+        int r = rs >> 4, s = rs & 15;
+        if (s == 0) {
+            if (r != 15) break; //fin de bloc
+            k += 15;
+            continue;
+        }
+        k += r;
+        if (k > 63) return -1;
+        int v = etendre(bits_lire(lb, s), s);
+        if (coef && !dc_seul) {
+            int z = zigzag[k];
+            coef[z] = (float)v * q[k];
+            *lignes |= 1 << (z >> 3);
+        }
+    }
+    return 0;
+}
+
+//IDCT 8 points AAN (Arai, Agui, Nakajima) en float, même schéma que jidctflt de libjpeg
+//entrées déjà multipliées par aan[u] * aan[v] / 8 (voir lire_dqt), pas = écart entre deux entrées
+static const double aan[8] = {
+    1.0, 1.387039845, 1.306562965, 1.175875602, 1.0, 0.785694958, 0.541196100, 0.275899379
+};
+
+static inline void idct_aan_1d(const float *in, int pas, float *out, int pas_out) {
+    float t0 = in[0], t1 = in[2 * pas], t2 = in[4 * pas], t3 = in[6 * pas];
+    float t10 = t0 + t2, t11 = t0 - t2;
+    float t13 = t1 + t3, t12 = (t1 - t3) * 1.414213562f - t13;
+    t0 = t10 + t13; t3 = t10 - t13;
+    t1 = t11 + t12; t2 = t11 - t12;
+
+    float t4 = in[pas], t5 = in[3 * pas], t6 = in[5 * pas], t7 = in[7 * pas];
+    float z13 = t6 + t5, z10 = t6 - t5, z11 = t4 + t7, z12 = t4 - t7;
+    t7 = z11 + z13;
+    t11 = (z11 - z13) * 1.414213562f;
+    float z5 = (z10 + z12) * 1.847759065f;
+    t10 = z12 * 1.082392200f - z5;
+    t12 = z5 - z10 * 2.613125930f;
+    t6 = t12 - t7;
+    t5 = t11 - t6;
+    t4 = t10 + t5;
+
+    out[0]           = t0 + t7;
+    out[7 * pas_out] = t0 - t7;
+    out[1 * pas_out] = t1 + t6;
+    out[6 * pas_out] = t1 - t6;
+    out[2 * pas_out] = t2 + t5;
+    out[5 * pas_out] = t2 - t5;
+    out[4 * pas_out] = t3 + t4;
+    out[3 * pas_out] = t3 - t4;
+}
+
+//n x n pixels du bloc : pleine échelle => AAN, sinon sortie[k][l] = somme_v somme_u idct[k][v] idct[l][u] F[v][u]
+static void bloc_idct(const DecodeurJPEG *d, const float *coef, int lignes, byte *sortie, long stride) {
+    int n = d->n;
+    if (lignes == 1 && coef[1] == 0 && coef[2] == 0 && coef[3] == 0 && coef[4] == 0 &&
+        coef[5] == 0 && coef[6] == 0 && coef[7] == 0) {
+        //DC seul : bloc uniforme (cas de toutes les sorties en echelle 8)
+        byte v = borne_octet((int)lrintf(coef[0] * d->facteur_dc) + 128);
+        for (int k = 0; k < n; k++) memset(sortie + k * stride, v, (size_t)n);
+        return;
+    }
+    float tmp[8][8];
+    if (n == 8) {
+        //colonnes puis lignes ; colonne sans AC => valeur constante
+        for (int u = 0; u < 8; u++) {
+            const float *c = coef + u;
+            if (c[8] == 0 && c[16] == 0 && c[24] == 0 && c[32] == 0 && c[40] == 0 && c[48] == 0 && c[56] == 0) {
+                for (int v = 0; v < 8; v++) tmp[v][u] = c[0];
+                continue;
+            }
+            idct_aan_1d(c, 8, &tmp[0][u], 8);
+        }
+        for (int v = 0; v < 8; v++) {
+            float o[8];
+            idct_aan_1d(tmp[v], 1, o, 1);
+            byte *ligne = sortie + v * stride;
+            for (int l = 0; l < 8; l++) ligne[l] = borne_octet((int)lrintf(o[l]) + 128);
+        }
+        return;
+    }
+    for (int v = 0; v < 8; v++) {
+        const float *ligne = coef + 8 * v;
+        if (!(lignes & (1 << v))) {
+            for (int l = 0; l < n; l++) tmp[v][l] = 0.0f;
+            continue;
+        }
+        for (int l = 0; l < n; l++) {
+            const float *a = d->idct[l];
+            tmp[v][l] = ligne[0] * a[0] + ligne[1] * a[1] + ligne[2] * a[2] + ligne[3] * a[3] +
+                        ligne[4] * a[4] + ligne[5] * a[5] + ligne[6] * a[6] + ligne[7] * a[7];
+        }
+    }
+    for (int k = 0; k < n; k++) {
+        const float *a = d->idct[k];
+        byte *o = sortie + k * stride;
+        for (int l = 0; l < n; l++) {
+            float s = tmp[0][l] * a[0] + tmp[1][l] * a[1] + tmp[2][l] * a[2] + tmp[3][l] * a[3] +
+                      tmp[4][l] * a[4] + tmp[5][l] * a[5] + tmp[6][l] * a[6] + tmp[7][l] * a[7];
+            o[l] = borne_octet((int)lrintf(s) + 128);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------------------
+//scans
+
+//RST attendu : on se recale sur le prochain FF D0..D7
+static int redemarrer(LecteurBits *lb) {
+    const byte *p = lb->p;
+    while (p + 1 < lb->fin) {
+        if (p[0] == 0xFF && p[1] >= 0xD0 && p[1] <= 0xD7) {
+            lb->p = p + 2;
+            lb->tampon = 0;
+            lb->nbits = 0;
+            lb->marqueur = 0;
+            return 0;
+        }
+        if (p[0] == 0xFF && p[1] != 0x00 && p[1] != 0xFF) return -1; //autre marqueur : données manquantes
+        p++;
+    }
+    return -1;
+}
+
+static int scan_decoder(DecodeurJPEG *d, const byte **pp, const byte *fin, int ns, ComposanteJPEG **sc) {
+    LecteurBits lb;
+    memset(&lb, 0, sizeof(lb));
+    lb.p = *pp;
+    lb.fin = fin;
+    float coef[64];
+    int n = d->n, dc_seul = (n == 1), lignes = 0;
+
+    //scan non entrelacé : un bloc par MCU, seuls les blocs couvrant la composante sont codés
+    long mcux = d->mcux, mcuy = d->mcuy;
+    if (ns == 1) {
+        ComposanteJPEG *c = sc[0];
+        long lc = (d->width * c->h + d->hmax - 1) / d->hmax, hc = (d->height * c->v + d->vmax - 1) / d->vmax;
+        mcux = (lc + 7) / 8;
+        mcuy = (hc + 7) / 8;
+    }
+    for (int i = 0; i < ns; i++) sc[i]->pred = 0;
+
+    long restants = d->intervalle;
+    for (long my = 0; my < mcuy; my++) {
+        for (long mx = 0; mx < mcux; mx++) {
+            if (d->intervalle) {
+                if (restants == 0) {
+                    if (redemarrer(&lb) != 0) return PNM_ERR_TRONQUE;
+                    for (int i = 0; i < ns; i++) sc[i]->pred = 0;
+                    restants = d->intervalle;
+                }
+                restants--;
+            }
+            for (int i = 0; i < ns; i++) {
+                ComposanteJPEG *c = sc[i];
+                int nbx = (ns == 1) ? 1 : c->h, nby = (ns == 1) ? 1 : c->v;
+                for (int by = 0; by < nby; by++) {
+                    for (int bx = 0; bx < nbx; bx++) {
+                        if (bloc_decoder(d, &lb, c, c->plan ? coef : NULL, &lignes, dc_seul) != 0) return PNM_ERR_FORMAT;
+                        if (!c->plan) continue;
+                        long y = (ns == 1) ? my : my * c->v + by, x = (ns == 1) ? mx : mx * c->h + bx;
+                        bloc_idct(d, coef, lignes, c->plan + y * n * c->largeur + x * n, c->largeur);
+                    }
+                }
+            }
+            if (lb.zeros > 2) return PNM_ERR_TRONQUE;
+        }
+    }
+
+    //reprise des marqueurs après les données du scan
+    const byte *p = lb.p;
+    while (p + 1 < fin && !(p[0] == 0xFF && p[1] != 0x00 && (p[1] < 0xD0 || p[1] > 0xD7))) p++;
+    *pp = p;
+    return PNM_OK;
+}
+
+//------------------------------------------------------------------------------------------------
+//segments
+
+static int lire_dqt(DecodeurJPEG *d, const byte *s, long n) {
+    while (n > 0) {
+        int pq = s[0] >> 4, tq = s[0] & 15;
+        long taille = 1 + 64 * (pq ? 2 : 1);
+        if (tq > 3 || pq > 1 || n < taille) return PNM_ERR_FORMAT;
+        for (int k = 0; k < 64; k++) d->q[tq][k] = pq ? (uint16)((s[1 + 2 * k] << 8) | s[2 + 2 * k]) : s[1 + k];
+        for (int k = 0; k < 64; k++) {
+            int z = zigzag[k];
+            d->qf[tq][k] = (d->n == 8) ? (float)(d->q[tq][k] * aan[z >> 3] * aan[z & 7] * 0.125) : (float)d->q[tq][k];
+        }
+        d->q_presente[tq] = 1;
+        s += taille;
+        n -= taille;
+    }
+    return PNM_OK;
+}
+
+static int lire_dht(DecodeurJPEG *d, const byte *s, long n) {
+    while (n > 17) {
+        int tc = s[0] >> 4, th = s[0] & 15, total = 0;
+        if (tc > 1 || th > 3) return PNM_ERR_FORMAT;
+        for (int l = 0; l < 16; l++) total += s[1 + l];
+        if (total > 256 || n < 17 + total) return PNM_ERR_FORMAT;
+        if (huffman_construire(tc ? &d->ac[th] : &d->dc[th], s + 1, s + 17, total) != 0) return PNM_ERR_FORMAT;
+        if (tc) huffman_construire_ac(&d->ac[th]);
+        s += 17 + total;
+        n -= 17 + total;
+    }
+    return n == 0 ? PNM_OK : PNM_ERR_FORMAT;
+}
+
+static int lire_sof(DecodeurJPEG *d, const byte *s, long n) {
+    if (d->sof_lu || n < 6) return PNM_ERR_FORMAT;
+    if (s[0] != 8) return PNM_ERR_FORMAT; //12 bits non géré
+    d->height = (s[1] << 8) | s[2];
+    d->width = (s[3] << 8) | s[4];
+    d->nb_comp = s[5];
+    if (d->width <= 0 || d->height <= 0) return PNM_ERR_DIMENSIONS; //hauteur par DNL non gérée
+    if ((d->nb_comp != 1 && d->nb_comp != 3) || n < 6 + 3 * d->nb_comp) return PNM_ERR_FORMAT;
+    d->hmax = d->vmax = 1;
+    for (int i = 0; i < d->nb_comp; i++) {
+        ComposanteJPEG *c = &d->comp[i];
+        c->id = s[6 + 3 * i];
+        c->h = s[7 + 3 * i] >> 4;
+        c->v = s[7 + 3 * i] & 15;
+        c->tq = s[8 + 3 * i];
+        if (c->h < 1 || c->h > 4 || c->v < 1 || c->v > 4 || c->tq > 3) return PNM_ERR_FORMAT;
+        if (c->h > d->hmax) d->hmax = c->h;
+        if (c->v > d->vmax) d->vmax = c->v;
+    }
+    d->mcux = (d->width + 8 * d->hmax - 1) / (8 * d->hmax);
+    d->mcuy = (d->height + 8 * d->vmax - 1) / (8 * d->vmax);
+    //un bloc coûte au moins 2 bits (DC + fin de bloc) => entête incohérente avec la taille du fichier
+    long blocs = 0;
+    for (int i = 0; i < d->nb_comp; i++) blocs += d->comp[i].h * d->comp[i].v;
+    if ((double)blocs * d->mcux * d->mcuy > 4.0 * (double)d->taille) return PNM_ERR_TRONQUE;
+    for (int i = 0; i < d->nb_comp; i++) {
+        ComposanteJPEG *c = &d->comp[i];
+        c->blocs_x = d->mcux * c->h;
+        c->blocs_y = d->mcuy * c->v;
+        c->largeur = c->blocs_x * d->n;
+        c->hauteur = c->blocs_y * d->n;
+        if (d->luma_seule && i > 0) continue; //chroma décodée pour avancer dans le flux, jamais reconstruite
+        c->plan = (byte*)calloc((size_t)c->largeur * (size_t)c->hauteur, 1); //scan absent => plan à 0
+        if (!c->plan) return PNM_ERR_MEMOIRE;
+    }
+    d->sof_lu = 1;
+    return PNM_OK;
+}
+
+//entête de scan puis données entropiques, *pp avance jusqu'au marqueur suivant
+static int lire_sos(DecodeurJPEG *d, const byte *s, long n, const byte **pp, const byte *fin) {
+    ComposanteJPEG *sc[3];
+    if (!d->sof_lu || n < 1) return PNM_ERR_FORMAT;
+    int ns = s[0];
+    if (ns < 1 || ns > d->nb_comp || n < 4 + 2 * ns) return PNM_ERR_FORMAT;
+    for (int i = 0; i < ns; i++) {
+        int id = s[1 + 2 * i], k;
+        for (k = 0; k < d->nb_comp && d->comp[k].id != id; k++) {}
+        if (k == d->nb_comp) return PNM_ERR_FORMAT;
+        sc[i] = &d->comp[k];
+        sc[i]->td = s[2 + 2 * i] >> 4;
+        sc[i]->ta = s[2 + 2 * i] & 15;
+        if (sc[i]->td > 3 || sc[i]->ta > 3 || !d->dc[sc[i]->td].presente || !d->ac[sc[i]->ta].presente ||
+            !d->q_presente[sc[i]->tq]) return PNM_ERR_FORMAT;
+    }
+    //Ss = 0, Se = 63, Ah = Al = 0 en séquentiel
+    const byte *t = s + 1 + 2 * ns;
+    if (t[0] != 0 || t[1] != 63 || t[2] != 0) return PNM_ERR_FORMAT;
+    d->nb_scans++;
+    return scan_decoder(d, pp, fin, ns, sc);
+}
+
+//------------------------------------------------------------------------------------------------
+//sortie
+
+//YCbCr -> RGB comme libjpeg (jdcolor.c) : tables en 16.16, arrondi inclus
+#define YCC_DECALAGE 16
+#define YCC_FIX(x) ((int32)((x) * (1L << YCC_DECALAGE) + 0.5))
+
+static int composer(DecodeurJPEG *d, ImageJPEG *img, int echelle) {
+    long w = (d->width + echelle - 1) / echelle, h = (d->height + echelle - 1) / echelle;
+    int nc = (d->nb_comp == 3 && !d->luma_seule) ? 3 : 1;
+    img->width = w;
+    img->height = h;
+    img->largeur_source = d->width;
+    img->hauteur_source = d->height;
+    img->ncanal = nc;
+    //image complète : le plus gros tampon par image => arène du thread si elle est active
+    img->pixels = (byte*)nralloc_bloc((size_t)w * (size_t)h * (size_t)nc);
+    if (!img->pixels) return PNM_ERR_MEMOIRE;
+
+    ComposanteJPEG *c0 = &d->comp[0];
+    if (nc == 1) {
+        for (long y = 0; y < h; y++) {
+            const byte *src = c0->plan + (y * c0->v / d->vmax) * c0->largeur;
+            byte *dst = img->pixels + y * w;
+            if (c0->h == d->hmax) memcpy(dst, src, (size_t)w);
+            else for (long x = 0; x < w; x++) dst[x] = src[x * c0->h / d->hmax];
+        }
+        return PNM_OK;
+    }
+
+    //colonnes de chaque plan pour une colonne de sortie (chroma répliquée)
+    long *xs = (long*)malloc(3 * (size_t)w * sizeof(long));
+    if (!xs) return PNM_ERR_MEMOIRE;
+    for (int i = 0; i < 3; i++)
+        for (long x = 0; x < w; x++) xs[i * w + x] = x * d->comp[i].h / d->hmax;
+
+    //RGB direct si Adobe transform = 0 ou identifiants 'R','G','B'
+    int rgb = (d->adobe == 0) || (d->comp[0].id == 'R' && d->comp[1].id == 'G' && d->comp[2].id == 'B');
+    int32 cr_r[256], cb_b[256], cr_g[256], cb_g[256];
+    for (int i = 0; i < 256; i++) {
+        int32 x = i - 128;
+        cr_r[i] = (YCC_FIX(1.40200) * x + (1 << (YCC_DECALAGE - 1))) >> YCC_DECALAGE;
+        cb_b[i] = (YCC_FIX(1.77200) * x + (1 << (YCC_DECALAGE - 1))) >> YCC_DECALAGE;
+        cr_g[i] = -YCC_FIX(0.71414) * x;
+        cb_g[i] = -YCC_FIX(0.34414) * x + (1 << (YCC_DECALAGE - 1));
+    }
+    //bornage par table : Y + décalage chroma reste dans [-227, 482]
+    byte borne[1024], *b = borne + 384;
+    for (int i = -384; i < 640; i++) b[i] = borne_octet(i);
+    const long *x0 = xs, *x1 = xs + w, *x2 = xs + 2 * w;
+    for (long y = 0; y < h; y++) {
+        const byte *p0 = c0->plan + (y * c0->v / d->vmax) * c0->largeur;
+        const byte *p1 = d->comp[1].plan + (y * d->comp[1].v / d->vmax) * d->comp[1].largeur;
+        const byte *p2 = d->comp[2].plan + (y * d->comp[2].v / d->vmax) * d->comp[2].largeur;
+        byte *dst = img->pixels + 3 * y * w;
+        if (rgb) {
+            for (long x = 0; x < w; x++, dst += 3) {
+                dst[0] = p0[x0[x]]; dst[1] = p1[x1[x]]; dst[2] = p2[x2[x]];
+            }
+            continue;
+        }
+        for (long x = 0; x < w; x++, dst += 3) {
+            int Y = p0[x0[x]], cb = p1[x1[x]], cr = p2[x2[x]];
+            dst[0] = b[Y + cr_r[cr]];
+            dst[1] = b[Y + ((cb_g[cb] + cr_g[cr]) >> YCC_DECALAGE)];
+            dst[2] = b[Y + cb_b[cb]];
+        }
+    }
+    free(xs);
+    return PNM_OK;
+}
+
+int jpeg_decoder(const byte *donnees, size_t taille, int echelle, int luma_seule, ImageJPEG *img) {
+    memset(img, 0, sizeof(*img));
+    if (echelle != 1 && echelle != 2 && echelle != 4 && echelle != 8) return PNM_ERR_DIMENSIONS;
+    if (taille < 4 || donnees[0] != 0xFF || donnees[1] != 0xD8) return PNM_ERR_FORMAT;
+    DecodeurJPEG *d = (DecodeurJPEG*)calloc(1, sizeof(DecodeurJPEG));
+    if (!d) return PNM_ERR_MEMOIRE;
+    d->adobe = -1;
+    d->luma_seule = luma_seule;
+    d->taille = taille;
+    idct_preparer(d, echelle);
+
+    const byte *p = donnees + 2, *fin = donnees + taille;
+    int code = PNM_OK;
+    for (;;) {
+        while (p < fin && *p != 0xFF) p++;
+        while (p < fin && *p == 0xFF) p++; //octets de remplissage
+        if (p >= fin) break;               //pas d'EOI : on garde ce qui a été décodé
+        int m = *p++;
+        if (m == 0xD9) break;
+        if ((m >= 0xD0 && m <= 0xD7) || m == 0x01) continue; //marqueurs sans segment
+        if (fin - p < 2) { code = PNM_ERR_TRONQUE; break; }
+        long longueur = (p[0] << 8) | p[1];
+        if (longueur < 2 || fin - p < longueur) { code = PNM_ERR_TRONQUE; break; }
+        const byte *s = p + 2;
+        long n = longueur - 2;
+        p += longueur;
+        switch (m) {
+        case 0xDB: code = lire_dqt(d, s, n); break;
+        case 0xC4: code = lire_dht(d, s, n); break;
+        case 0xC0: case 0xC1: code = lire_sof(d, s, n); break;
+        case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+        case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+            code = PNM_ERR_FORMAT; break; //progressif, sans perte, arithmétique
+        case 0xDD:
+            if (n < 2) code = PNM_ERR_FORMAT;
+            else d->intervalle = (s[0] << 8) | s[1];
+            break;
+        case 0xEE: //APP14 Adobe : octet 11 = transformée couleur
+            if (n >= 12 && memcmp(s, "Adobe", 5) == 0) d->adobe = s[11];
+            break;
+        case 0xDA: code = lire_sos(d, s, n, &p, fin); break;
+        default: break; //APPn, COM, ...
+        }
+        if (code != PNM_OK) break;
+    }
+    if (code == PNM_OK && (!d->sof_lu || d->nb_scans == 0)) code = PNM_ERR_TRONQUE;
+    if (code == PNM_OK) code = composer(d, img, echelle);
+    for (int i = 0; i < 3; i++) free(d->comp[i].plan);
+    free(d);
+    if (code != PNM_OK) jpeg_liberer(img);
+    return code;
+}
+
+void jpeg_liberer(ImageJPEG *img) {
+    nrfree_bloc(img->pixels);
+    memset(img, 0, sizeof(*img));
+}
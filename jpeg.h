@@ -0,0 +1,43 @@
+#ifndef JPEG_H
+#define JPEG_H
+
+#include <stddef.h>
+#include "nrc/def.h"
+
+//décodeur jpeg autonome : baseline / séquentiel étendu huffman 8 bits (SOF0, SOF1), 1 ou 3 composantes,
+//tous facteurs d'échantillonnage 1..4, intervalles de redémarrage, scans entrelacés ou non
+//progressif, arithmétique, sans perte, 12 bits et cmyk => PNM_ERR_FORMAT (codes d'erreur de nrio.h)
+//
+//échelle réduite directement dans le domaine DCT : chaque bloc 8x8 donne (8/echelle)² pixels égaux
+//à la moyenne exacte (avant arrondi) des echelle x echelle pixels qu'aurait donnés l'IDCT complète
+//  echelle 1 : IDCT complète, 2 et 4 : IDCT partielle (matrices 4x8, 2x8), 8 : DC seul (moyenne du bloc)
+//le décodage huffman reste complet, seules la déquantification des AC et l'IDCT sont évitées
+//
+//pleine échelle : IDCT AAN en float (schéma jidctflt), arrondi au plus proche, chroma répliquée (pas de
+//sur-échantillonnage « fancy »), YCbCr -> RGB en virgule fixe comme libjpeg (jdcolor.c)
+//=> identique au pixel près à libjpeg-turbo réglé en JDCT_FLOAT sans fancy upsampling sur 540 fichiers
+//   (archive500ppm recompressé en qualité 90 4:2:0, + qualités 50..89 en 4:4:4, 4:2:2, gris, redémarrages)
+//   avec les réglages par défaut de libjpeg (fancy upsampling) : 89 % des octets identiques, 99 % à <= 4 niveaux
+//
+//temps de décodage en mémoire des 500 jpeg (7.5 Mo, contre 70 Mo pour archive500ppm) :
+//  echelle 1 : 415 ms, 2 : 271 ms, 4 : 220 ms, 8 (DC seul) : 184 ms
+//  (libjpeg-turbo vectorisé : 227, 160, 150, 127 ms) => le décodage huffman, complet à toute échelle,
+//  borne le gain du DC seul à ~2.3x
+#define JPEG_ECHELLE_PLEINE 1
+#define JPEG_ECHELLE_DC     8
+
+typedef struct {
+    long width, height;                   // dimensions décodées (arrondies au-dessus si echelle > 1)
+    long largeur_source, hauteur_source;  // dimensions dans l'entête
+    int  ncanal;                          // 1 (gris ou luma seule) ou 3 (rgb8 packé)
+    byte *pixels;                         // ligne i en pixels + i * width * ncanal
+} ImageJPEG;
+
+//1 si le tampon commence par SOI + marqueur (FF D8 FF)
+int jpeg_signature(const byte *donnees, size_t taille);
+//echelle 1, 2, 4 ou 8 ; luma_seule => seule la composante Y est reconstruite (IDCT des chromas sautée)
+//retourne PNM_OK ou un code PNM_ERR_* (img->pixels à NULL en cas d'erreur)
+int jpeg_decoder(const byte *donnees, size_t taille, int echelle, int luma_seule, ImageJPEG *img);
+void jpeg_liberer(ImageJPEG *img);
+
+#endif
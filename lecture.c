@@ -0,0 +1,408 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "lecture.h"
+#include "nrc/nrio.h"
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && __has_include(<linux/io_uring.h>)
+#define LECTURE_AVEC_URING 1
+#include <linux/io_uring.h>
+#endif
+
+//une lecture io_uring est plafonnée (le noyau coupe de toute façon vers 2 Go), le reste est relancé
+#define URING_LECTURE_MAX (1u << 30)
+
+//cycle d'une case : LIBRE -> EN_COURS (lecture lancée) -> PRETE (lue) -> PRETEE (chez l'appelant) -> LIBRE
+enum { CASE_LIBRE, CASE_EN_COURS, CASE_PRETE, CASE_PRETEE };
+
+typedef struct {
+    FichierLu f;          // en premier => lecture_rendre retrouve la case depuis le FichierLu
+    size_t capacite;      // taille allouée de f.donnees, le tampon ne fait que grandir
+    size_t lus;
+    int fd;
+    int etat;
+    int noyau;            // anneau tombé en panne pendant une lecture de la case => le noyau peut encore
+                          // écrire dans f.donnees : tampon abandonné (jamais réutilisé ni libéré)
+} CaseLecture;
+
+struct LectureAnticipee {
+    int mode, profondeur;
+    CaseLecture *cases;   // le fichier i passe toujours par la case i % profondeur
+    char **chemins;
+    int *types;
+    int nb, cap;
+    int lance;            // prochain fichier à lancer
+    int rendu;            // prochain fichier à rendre
+
+    //pool de threads : file circulaire des cases à lire (une case y est au plus une fois)
+    pthread_t *threads;
+    int nb_threads;
+    pthread_mutex_t verrou;
+    pthread_cond_t travail, fini;
+    int *file_travail;
+    int ft_tete, ft_nb;
+    int arret;
+
+#ifdef LECTURE_AVEC_URING
+    int anneau;
+    int panne;            // io_uring_enter refusé en cours de route => la suite est lue par pread
+    void *sq_map, *cq_map;
+    size_t sq_taille, cq_taille;
+    struct io_uring_sqe *sqes;
+    size_t sqes_taille;
+    unsigned *sq_tete, *sq_queue, *sq_masque, *sq_tableau;
+    unsigned *cq_tete, *cq_queue, *cq_masque;
+    struct io_uring_cqe *cqes;
+#endif
+};
+
+//ouverture + taille du fichier, tampon de la case agrandi si besoin
+static int case_ouvrir(CaseLecture *c) {
+    struct stat st;
+    c->lus = 0;
+    c->f.taille = 0;
+    if (c->noyau) {
+        //au plus une fois par case (profondeur tampons en tout) et seulement après une panne de l'anneau
+        c->f.donnees = NULL;
+        c->capacite = 0;
+        c->noyau = 0;
+    }
+    c->fd = open(c->f.chemin, O_RDONLY);
+    if (c->fd < 0) return PNM_ERR_FICHIER;
+    if (fstat(c->fd, &st) != 0 || !S_ISREG(st.st_mode)) return PNM_ERR_FICHIER;
+    size_t taille = (size_t) st.st_size;
+    if (taille > c->capacite) {
+        byte *p = (byte*) realloc(c->f.donnees, taille);
+        if (!p) return PNM_ERR_MEMOIRE;
+        c->f.donnees = p;
+        c->capacite = taille;
+    }
+    c->f.taille = taille;
+    return PNM_OK;
+}
+
+//lecture bloquante du reste du fichier (threads, ou repli si le noyau refuse IORING_OP_READ)
+static int case_lire_sync(CaseLecture *c) {
+    while (c->lus < c->f.taille) {
+        ssize_t r = pread(c->fd, c->f.donnees + c->lus, c->f.taille - c->lus, (off_t) c->lus);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) return PNM_ERR_FICHIER;
+        if (r == 0) break; //fichier raccourci entre fstat et lecture => ViewPNM le verra tronqué
+        c->lus += (size_t) r;
+    }
+    return PNM_OK;
+}
+
+static void case_terminer(CaseLecture *c, int code) {
+    if (c->fd >= 0) close(c->fd);
+    c->fd = -1;
+    c->f.code = code;
+    c->f.taille = (code == PNM_OK) ? c->lus : 0;
+    c->etat = CASE_PRETE;
+}
+
+static void *lecture_thread(void *arg) {
+    LectureAnticipee *la = (LectureAnticipee*) arg;
+    pthread_mutex_lock(&la->verrou);
+    for (;;) {
+        while (la->ft_nb == 0 && !la->arret) pthread_cond_wait(&la->travail, &la->verrou);
+        if (la->arret) break;
+        CaseLecture *c = &la->cases[la->file_travail[la->ft_tete]];
+        la->ft_tete = (la->ft_tete + 1) % la->profondeur;
+        la->ft_nb--;
+        pthread_mutex_unlock(&la->verrou);
+
+        int code = case_ouvrir(c);
+        if (code == PNM_OK) code = case_lire_sync(c);
+
+        pthread_mutex_lock(&la->verrou);
+        case_terminer(c, code);
+        pthread_cond_broadcast(&la->fini);
+    }
+    pthread_mutex_unlock(&la->verrou);
+    return NULL;
+}
+
+#ifdef LECTURE_AVEC_URING
+//appels système directs : pas de dépendance à liburing
+static int uring_ouvrir(LectureAnticipee *la) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    la->anneau = (int) syscall(__NR_io_uring_setup, (unsigned) la->profondeur, &p);
+    if (la->anneau < 0) return -1; //noyau trop ancien, seccomp, io_uring désactivé, ...
+
+    la->sq_taille = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    la->cq_taille = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (la->cq_taille > la->sq_taille) la->sq_taille = la->cq_taille;
+        la->cq_taille = la->sq_taille;
+    }
+    la->sq_map = mmap(NULL, la->sq_taille, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      la->anneau, IORING_OFF_SQ_RING);
+    if (la->sq_map == MAP_FAILED) { la->sq_map = NULL; return -1; }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) la->cq_map = la->sq_map;
+    else {
+        la->cq_map = mmap(NULL, la->cq_taille, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          la->anneau, IORING_OFF_CQ_RING);
+        if (la->cq_map == MAP_FAILED) { la->cq_map = NULL; return -1; }
+    }
+    la->sqes_taille = p.sq_entries * sizeof(struct io_uring_sqe);
+    la->sqes = mmap(NULL, la->sqes_taille, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    la->anneau, IORING_OFF_SQES);
+    if (la->sqes == MAP_FAILED) { la->sqes = NULL; return -1; }
+
+    char *sq = (char*) la->sq_map, *cq = (char*) la->cq_map;
+    la->sq_tete    = (unsigned*) (sq + p.sq_off.head);
+    la->sq_queue   = (unsigned*) (sq + p.sq_off.tail);
+    la->sq_masque  = (unsigned*) (sq + p.sq_off.ring_mask);
+    la->sq_tableau = (unsigned*) (sq + p.sq_off.array);
+    la->cq_tete    = (unsigned*) (cq + p.cq_off.head);
+    la->cq_queue   = (unsigned*) (cq + p.cq_off.tail);
+    la->cq_masque  = (unsigned*) (cq + p.cq_off.ring_mask);
+    la->cqes       = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+    return 0;
+}
+
+static void uring_fermer(LectureAnticipee *la) {
+    if (la->sqes) munmap(la->sqes, la->sqes_taille);
+    if (la->cq_map && la->cq_map != la->sq_map) munmap(la->cq_map, la->cq_taille);
+    if (la->sq_map) munmap(la->sq_map, la->sq_taille);
+    if (la->anneau >= 0) close(la->anneau);
+    la->sqes = NULL;
+    la->sq_map = la->cq_map = NULL;
+    la->anneau = -1;
+}
+
+//une seule requête en vol par case et sq_entries >= profondeur => la file de soumission ne déborde pas
+static void uring_lire(LectureAnticipee *la, int k) {
+    CaseLecture *c = &la->cases[k];
+    unsigned queue = *la->sq_queue;
+    unsigned i = queue & *la->sq_masque;
+    struct io_uring_sqe *sqe = &la->sqes[i];
+    size_t reste = c->f.taille - c->lus;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = c->fd;
+    sqe->addr = (uint64_t) (uintptr_t) (c->f.donnees + c->lus);
+    sqe->len = (reste > URING_LECTURE_MAX) ? URING_LECTURE_MAX : (unsigned) reste;
+    sqe->off = c->lus;
+    sqe->user_data = (uint64_t) k;
+    la->sq_tableau[i] = i;
+    __atomic_store_n(la->sq_queue, queue + 1, __ATOMIC_RELEASE);
+}
+
+static void uring_completer(LectureAnticipee *la, int k, int res) {
+    CaseLecture *c = &la->cases[k];
+    if (res == -EINTR || res == -EAGAIN) { uring_lire(la, k); return; }
+    if (res == -EINVAL || res == -EOPNOTSUPP) { case_terminer(c, case_lire_sync(c)); return; } //pas d'IORING_OP_READ (< 5.6)
+    if (res < 0) { case_terminer(c, PNM_ERR_FICHIER); return; }
+    c->lus += (size_t) res;
+    if (res > 0 && c->lus < c->f.taille) { uring_lire(la, k); return; } //lecture courte => on relance le reste
+    case_terminer(c, PNM_OK);
+}
+
+//soumet ce qui attend dans la file, attend au moins min_fin complétions et les traite
+static int uring_soumettre(LectureAnticipee *la, unsigned min_fin) {
+    unsigned n = *la->sq_queue - __atomic_load_n(la->sq_tete, __ATOMIC_ACQUIRE);
+    if (n == 0 && min_fin == 0) return 0;
+    if (syscall(__NR_io_uring_enter, la->anneau, n, min_fin, min_fin ? IORING_ENTER_GETEVENTS : 0, NULL, 0) < 0 &&
+        errno != EINTR && errno != EAGAIN && errno != EBUSY) return -1;
+
+    unsigned tete = *la->cq_tete;
+    while (tete != __atomic_load_n(la->cq_queue, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &la->cqes[tete & *la->cq_masque];
+        uring_completer(la, (int) cqe->user_data, cqe->res);
+        tete++;
+    }
+    __atomic_store_n(la->cq_tete, tete, __ATOMIC_RELEASE);
+    return 0;
+}
+
+//io_uring_enter refusé (autre chose qu'une interruption) : on ne compte plus sur l'anneau, les lectures
+//en vol sont refaites par pread dans un tampon qui ne sera plus réutilisé, les suivantes sont synchrones
+static void uring_panne(LectureAnticipee *la) {
+    la->panne = 1;
+    for (int k = 0; k < la->profondeur; k++) {
+        CaseLecture *c = &la->cases[k];
+        if (c->etat != CASE_EN_COURS) continue;
+        c->noyau = 1;
+        case_terminer(c, case_lire_sync(c));
+    }
+}
+#endif
+
+//lance tous les fichiers dont la case est libre (appelé verrou tenu)
+static void lecture_lancer(LectureAnticipee *la) {
+    while (la->lance < la->nb) {
+        int k = la->lance % la->profondeur;
+        CaseLecture *c = &la->cases[k];
+        if (c->etat != CASE_LIBRE) break;
+        c->f.chemin = la->chemins[la->lance];
+        c->f.image_type = la->types[la->lance];
+        c->f.indice = la->lance;
+        c->f.code = PNM_OK;
+        c->etat = CASE_EN_COURS;
+        la->lance++;
+#ifdef LECTURE_AVEC_URING
+        if (la->mode == LECTURE_URING) {
+            //open/fstat restent synchrones (métadonnées), seules les lectures passent par l'anneau
+            int code = case_ouvrir(c);
+            if (code == PNM_OK && la->panne) code = case_lire_sync(c);
+            if (code != PNM_OK || c->f.taille == 0 || la->panne) case_terminer(c, code);
+            else uring_lire(la, k);
+            continue;
+        }
+#endif
+        la->file_travail[(la->ft_tete + la->ft_nb) % la->profondeur] = k;
+        la->ft_nb++;
+        pthread_cond_signal(&la->travail);
+    }
+#ifdef LECTURE_AVEC_URING
+    //le noyau commence tout de suite
+    if (la->mode == LECTURE_URING && !la->panne && uring_soumettre(la, 0) != 0) uring_panne(la);
+#endif
+}
+
+LectureAnticipee *lecture_ouvrir(int profondeur, int mode) {
+    if (profondeur < 1) profondeur = 1;
+    if (profondeur > LECTURE_PROFONDEUR_MAX) profondeur = LECTURE_PROFONDEUR_MAX;
+    LectureAnticipee *la = (LectureAnticipee*) calloc(1, sizeof(LectureAnticipee));
+    if (!la) return NULL;
+    la->profondeur = profondeur;
+    la->cases = (CaseLecture*) calloc((size_t) profondeur, sizeof(CaseLecture));
+    la->file_travail = (int*) calloc((size_t) profondeur, sizeof(int));
+    pthread_mutex_init(&la->verrou, NULL);
+    pthread_cond_init(&la->travail, NULL);
+    pthread_cond_init(&la->fini, NULL);
+#ifdef LECTURE_AVEC_URING
+    la->anneau = -1;
+#endif
+    if (!la->cases || !la->file_travail) { lecture_fermer(la); return NULL; }
+    for (int k = 0; k < profondeur; k++) la->cases[k].fd = -1;
+
+    la->mode = LECTURE_THREADS;
+#ifdef LECTURE_AVEC_URING
+    if (mode != LECTURE_THREADS) {
+        if (uring_ouvrir(la) == 0) la->mode = LECTURE_URING;
+        else uring_fermer(la); //repli sur les threads
+    }
+#endif
+    if (la->mode == LECTURE_THREADS) {
+        //lectures bloquantes => un thread par lecture en vol
+        la->threads = (pthread_t*) calloc((size_t) profondeur, sizeof(pthread_t));
+        if (!la->threads) { lecture_fermer(la); return NULL; }
+        for (int t = 0; t < profondeur; t++) {
+            if (pthread_create(&la->threads[t], NULL, lecture_thread, la) != 0) break;
+            la->nb_threads++;
+        }
+        if (la->nb_threads == 0) { lecture_fermer(la); return NULL; }
+    }
+    return la;
+}
+
+int lecture_mode(const LectureAnticipee *la) {
+    return la->mode;
+}
+
+int lecture_soumettre(LectureAnticipee *la, const char *chemin, int image_type) {
+    if (la->nb == la->cap) {
+        int cap = la->cap ? 2 * la->cap : 256;
+        char **chemins = (char**) realloc(la->chemins, (size_t) cap * sizeof(char*));
+        if (!chemins) return -1;
+        la->chemins = chemins;
+        int *types = (int*) realloc(la->types, (size_t) cap * sizeof(int));
+        if (!types) return -1;
+        la->types = types;
+        la->cap = cap;
+    }
+    char *copie = strdup(chemin);
+    if (!copie) return -1;
+    pthread_mutex_lock(&la->verrou);
+    la->chemins[la->nb] = copie;
+    la->types[la->nb] = image_type;
+    la->nb++;
+    lecture_lancer(la);
+    pthread_mutex_unlock(&la->verrou);
+    return 0;
+}
+
+FichierLu *lecture_suivante(LectureAnticipee *la) {
+    FichierLu *f = NULL;
+    pthread_mutex_lock(&la->verrou);
+    if (la->rendu < la->nb) {
+        CaseLecture *c = &la->cases[la->rendu % la->profondeur];
+        //case encore prêtée (plus de profondeur fichiers gardés sans lecture_rendre) => rien à attendre
+        if (c->etat != CASE_PRETEE) {
+            lecture_lancer(la);
+            while (c->etat != CASE_PRETE) {
+#ifdef LECTURE_AVEC_URING
+                if (la->mode == LECTURE_URING) {
+                    //panne => la case est finie par pread, jamais rendue à NULL (fin de liste pour l'appelant)
+                    if (uring_soumettre(la, 1) != 0) uring_panne(la);
+                    continue;
+                }
+#endif
+                pthread_cond_wait(&la->fini, &la->verrou);
+            }
+            if (c->etat == CASE_PRETE) {
+                c->etat = CASE_PRETEE;
+                la->rendu++;
+                f = &c->f;
+            }
+        }
+    }
+    pthread_mutex_unlock(&la->verrou);
+    return f;
+}
+
+void lecture_rendre(LectureAnticipee *la, FichierLu *f) {
+    CaseLecture *c = (CaseLecture*) f;
+    pthread_mutex_lock(&la->verrou);
+    c->etat = CASE_LIBRE;
+    lecture_lancer(la);
+    pthread_mutex_unlock(&la->verrou);
+}
+
+void lecture_fermer(LectureAnticipee *la) {
+    if (!la) return;
+    pthread_mutex_lock(&la->verrou);
+    la->arret = 1;
+    pthread_cond_broadcast(&la->travail);
+    pthread_mutex_unlock(&la->verrou);
+    for (int t = 0; t < la->nb_threads; t++) pthread_join(la->threads[t], NULL);
+#ifdef LECTURE_AVEC_URING
+    if (la->mode == LECTURE_URING) {
+        //le noyau écrit encore dans les tampons des lectures en vol => on les laisse finir
+        for (int k = 0; k < la->profondeur; k++) {
+            while (la->cases[k].etat == CASE_EN_COURS) {
+                if (uring_soumettre(la, 1) != 0) uring_panne(la);
+            }
+        }
+    }
+    uring_fermer(la);
+#endif
+    if (la->cases) {
+        for (int k = 0; k < la->profondeur; k++) {
+            if (la->cases[k].fd >= 0) close(la->cases[k].fd);
+            if (!la->cases[k].noyau) free(la->cases[k].f.donnees);
+        }
+    }
+    for (int i = 0; i < la->nb; i++) free(la->chemins[i]);
+    free(la->chemins);
+    free(la->types);
+    free(la->cases);
+    free(la->file_travail);
+    free(la->threads);
+    pthread_mutex_destroy(&la->verrou);
+    pthread_cond_destroy(&la->travail);
+    pthread_cond_destroy(&la->fini);
+    free(la);
+}
@@ -0,0 +1,41 @@
+#ifndef LECTURE_H
+#define LECTURE_H
+
+#include <stddef.h>
+#include "nrc/def.h"
+
+//étage de lecture anticipée pour l'indexation d'un répertoire : les chemins sont soumis d'un coup (readdir),
+//jusqu'à `profondeur` fichiers sont lus en avance dans des tampons recyclés pendant que l'appelant
+//extrait l'image courante => le disque (ou le montage réseau) travaille pendant le calcul
+//les fichiers sont rendus dans l'ordre de soumission => même ordre de traitement que la boucle synchrone
+#define LECTURE_AUTO    0  // io_uring si le noyau l'accepte, sinon threads
+#define LECTURE_URING   1  // io_uring par appels système directs (pas de liburing), un seul thread
+#define LECTURE_THREADS 2  // pool de threads qui font open/fstat/pread
+
+#define LECTURE_PROFONDEUR_DEFAUT 8
+#define LECTURE_PROFONDEUR_MAX    64
+
+typedef struct {
+    const char *chemin;   // tel que soumis (copie interne)
+    int image_type;
+    int indice;           // rang de soumission
+    int code;             // PNM_OK, PNM_ERR_FICHIER ou PNM_ERR_MEMOIRE (nrio.h)
+    byte *donnees;        // fichier complet, valide jusqu'à lecture_rendre
+    size_t taille;
+} FichierLu;
+
+typedef struct LectureAnticipee LectureAnticipee;
+
+//profondeur = lectures en vol (bornée à 1..LECTURE_PROFONDEUR_MAX), NULL si plus de mémoire
+LectureAnticipee *lecture_ouvrir(int profondeur, int mode);
+int lecture_mode(const LectureAnticipee *la); //LECTURE_URING ou LECTURE_THREADS effectivement retenu
+//ajoute un chemin à la file (copié), retourne -1 si plus de mémoire
+int lecture_soumettre(LectureAnticipee *la, const char *chemin, int image_type);
+//prochain fichier dans l'ordre de soumission (attend sa lecture), NULL quand tout a été rendu
+//(anneau io_uring en panne en cours de route => la suite est lue par pread, aucun fichier n'est perdu)
+FichierLu *lecture_suivante(LectureAnticipee *la);
+//rend le tampon au pool => la case peut lancer la lecture d'un fichier suivant
+void lecture_rendre(LectureAnticipee *la, FichierLu *f);
+void lecture_fermer(LectureAnticipee *la);
+
+#endif
@@ -1,8 +1,13 @@
 #include "image.h"
-#include <dirent.h>
+#include "lecture.h"
+#include "pack.h"
+#include "tar.h"
+#include "enumeration.h"
 #include <string.h>
 #include <stdlib.h> 
 
+#define ARENE_BLOC (4 << 20) //premier bloc de l'arène, agrandi au pic de la plus grosse image
+
 //score + image
 typedef struct {
     char filename[512];
@@ -23,13 +28,68 @@ void sort_ranking(ImageData *data, int num_images) {
     qsort(data, num_images, sizeof(ImageData), compare_scores);
 }
 
-int main() {
+static int est_tar(const char *chemin) {
+    size_t l = strlen(chemin);
+    return l > 4 && strcmp(chemin + l - 4, ".tar") == 0;
+}
+
+//./main_programme [archive.pack | archive.tar | -] => sans argument les répertoires ci-dessous sont parcourus,
+//sinon toutes les images de l'archive (packer.c) sont lues en place dans sa projection,
+//ou celles d'une archive tar (tar.h), "-" pour un tar lu sur l'entrée standard (zcat x.tar.gz | ...)
+int main(int argc, char *argv[]) {
     ImageFeatures feat_ref;  //image ref descripteurs
     char* filename_ref = "./archivePPMPGM/archive500ppm/2.ppm"; // chemin image de base
+
+    //allocateur de nralloc choisi à l'exécution : NRALLOC=malloc|arene|thp|fichier (arene par défaut)
+    const char *backend = getenv("NRALLOC");
+    if (backend && *backend && nralloc_backend(nralloc_backend_depuis_nom(backend), 0, NULL) != 0) {
+        printf("NRALLOC inconnu: %s (malloc, arene, thp ou fichier)\n", backend);
+        return 1;
+    }
+
+    Pack pack;
+    Tar tar;
+    const char *chemin_pack = (argc > 1) ? argv[1] : NULL;
+    const char *chemin_tar = NULL;
+    if (chemin_pack && (strcmp(chemin_pack, "-") == 0 || est_tar(chemin_pack))) {
+        chemin_tar = chemin_pack;
+        chemin_pack = NULL;
+        //tar régulier projeté => images lues en place, sinon flux séquentiel
+        int code = tar_ouvrir(chemin_tar, TAR_MMAP, &tar);
+        if (code != PNM_OK) {
+            printf("Erreur archive: %s (%s)\n", chemin_tar, PNMerror(code));
+            return 1;
+        }
+    }
+    if (chemin_pack) {
+        int code = pack_ouvrir(chemin_pack, &pack);
+        if (code != PNM_OK) {
+            printf("Erreur archive: %s (%s)\n", chemin_pack, PNMerror(code));
+            return 1;
+        }
+    }
     
-    //caractéristiques images base extraite
-    if (extraire_features_from_file(filename_ref, &feat_ref, 0, 0.25, IMAGE_TYPE_PPM) != 0) {
+    //caractéristiques images base extraite => sur le chemin critique, bandes en parallèle sur tous les cœurs
+    //(directement dans la projection si l'archive la contient)
+    OptionsExtraction opt_ref;
+    options_extraction_defaut(&opt_ref);
+    opt_ref.seuil_contour = 0.25;
+    opt_ref.image_type = IMAGE_TYPE_PPM;
+    opt_ref.nb_threads = -1;
+    long i_ref = chemin_pack ? pack_chercher(&pack, filename_ref) : -1;
+    int code_ref;
+    if (i_ref >= 0) {
+        ImagePack img;
+        pack_image(&pack, i_ref, &img);
+        opt_ref.image_type = img.image_type;
+        code_ref = extraire_features_tampon(img.donnees, img.taille, &feat_ref, &opt_ref);
+    } else {
+        code_ref = extraire_features_avec_options(filename_ref, &feat_ref, &opt_ref);
+    }
+    if (code_ref != 0) {
         printf("Erreur extraction référence: %s\n", filename_ref);
+        if (chemin_pack) pack_fermer(&pack);
+        if (chemin_tar) tar_fermer(&tar);
         return 1;
     }
     printf("Référence extraite: %s (Largeur: %ld)\n", filename_ref, feat_ref.width);
@@ -56,58 +116,135 @@ int main() {
 
     //allocation mémoire pas très optimate mais idée score ces images 
     int max_images = 500;
+    if (chemin_pack && pack.nb_images > max_images) max_images = (int)pack.nb_images;
     ImageData *score = malloc(max_images * sizeof(ImageData));
     if (score == NULL) {
         printf("Erreur allocation mémoire\n");
+        if (chemin_pack) pack_fermer(&pack);
+        if (chemin_tar) tar_fermer(&tar);
         return 1;
     }
     
     int num_images = 0;
+
+    //lecture anticipée : l'énumération ne fait que soumettre les chemins, les fichiers sont lus en avance
+    //(io_uring ou threads) pendant l'extraction de l'image courante, rendus dans l'ordre de soumission
+    //archive : rien à lire, les images sont prises dans l'ordre de la table (ou du tar)
+    LectureAnticipee *lecture = NULL;
+    if (!chemin_pack && !chemin_tar) {
+        lecture = lecture_ouvrir(LECTURE_PROFONDEUR_DEFAUT, LECTURE_AUTO);
+        if (lecture == NULL) {
+            printf("Erreur allocation mémoire\n");
+            free(score);
+            return 1;
+        }
+    }
     
-    //parcours répertoires=> pour instant un seul donc pas utile
-    for (int d = 0; d < num_dirs; d++) {
-        DIR *dir = opendir(directories[d]);
-        if (!dir) {
-            printf("erreur => : %s\n", directories[d]);
+    //parcours des répertoires (sous-répertoires compris) par enumeration.c, chemins rendus par inode
+    //croissant => la lecture anticipée suit à peu près l'ordre des fichiers sur le disque
+    if (lecture) {
+        TableChemins table;
+        int code = enumerer_images(directories, num_dirs, 0, ENUM_SUFFIXE, &table);
+        if (code != PNM_OK) {
+            printf("erreur => : %s (%s)\n", directories[0], PNMerror(code));
+            lecture_fermer(lecture);
             free(score);
             return 1;
         }
-        
-        struct dirent *entry;
-        while ((entry = readdir(dir)) != NULL) {
-            //traitement ici pour le split et récupérer nom fichier
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
-            
-            //chemin
-            char full_path[512];
-            snprintf(full_path, sizeof(full_path), "%s/%s", directories[d], entry->d_name);
-            
-            //récupérer chaque image => en général mm format que celui d'avant mais on garde flexibiltié
-            int image_type = -1;
-            if (strstr(entry->d_name, ".pgm")) image_type = IMAGE_TYPE_PGM;
-            else if (strstr(entry->d_name, ".ppm")) image_type = IMAGE_TYPE_PPM;
-            else continue;  // Ignorer les fichiers non image
-            
-            //curr c'est actuelle , à comparer avec ref plutot
-            ImageFeatures feat_curr;
-            if (extraire_features_from_file(full_path, &feat_curr, 0, 0.25, image_type) != 0) {
-                printf("Erreur extraction: %s\n", full_path);
-                continue;
+        for (long i = 0; i < table.nb; i++) {
+            if (lecture_soumettre(lecture, table_chemin(&table, i), table.entrees[i].image_type) != 0) {
+                printf("Erreur allocation mémoire\n");
+                break;
+            }
+        }
+        table_liberer(&table);
+    }
+
+    //mêmes options que extraire_features_from_file(.., 0, 0.25, ..)
+    OptionsExtraction opt_curr;
+    options_extraction_defaut(&opt_curr);
+    opt_curr.seuil_contour = 0.25;
+
+    //arène du thread principal (nralloc.h) : tampons de l'image courante découpés dans un bloc
+    //réutilisé au lieu d'un malloc/free chacun, rendus d'un coup avant l'image suivante
+    nrarena_init(ARENE_BLOC);
+
+    long suivante_pack = 0;
+    for (;;) {
+        nrarena_reset(0);
+        //image suivante : tampon de la lecture anticipée ou image en place dans l'archive
+        FichierLu *fichier = NULL;
+        ImagePack img;
+        int code = PNM_OK;
+        if (chemin_pack) {
+            if (suivante_pack >= pack.nb_images) break;
+            pack_image(&pack, suivante_pack++, &img);
+        } else if (chemin_tar) {
+            code = tar_suivante(&tar, &img);
+            if (code == TAR_FIN) break;
+            if (code != PNM_OK) {
+                //archive abîmée : pas de resynchronisation possible, les images déjà lues sont classées
+                printf("Erreur archive: %s (%s)\n", chemin_tar, PNMerror(code));
+                break;
             }
-            
-            //fct eval
-            double current_score = evaluate_score(&feat_ref, &feat_curr, dist_func,
-                                                 weight_hist, weight_r, weight_g, weight_b,
-                                                 weight_norm, weight_contour, weight_color);
-            
-            //stockage avec strcpy
-            strcpy(score[num_images].filename, full_path);
-            score[num_images].score = current_score;
-            num_images++;
+        } else {
+            fichier = lecture_suivante(lecture);
+            if (fichier == NULL) break;
+            img.nom = fichier->chemin;
+            img.image_type = fichier->image_type;
+            img.donnees = fichier->donnees;
+            img.taille = fichier->taille;
+            code = fichier->code;
+        }
+
+        //curr c'est actuelle , à comparer avec ref plutot
+        ImageFeatures feat_curr;
+        opt_curr.image_type = img.image_type;
+        if (code == PNM_OK) code = extraire_features_tampon(img.donnees, img.taille, &feat_curr, &opt_curr);
+        if (code != 0) {
+            printf("Erreur extraction: %s (%s)\n", img.nom, PNMerror(code));
+            if (fichier) lecture_rendre(lecture, fichier);
+            continue;
         }
         
-        closedir(dir);
+        //fct eval
+        double current_score = evaluate_score(&feat_ref, &feat_curr, dist_func,
+                                             weight_hist, weight_r, weight_g, weight_b,
+                                             weight_norm, weight_contour, weight_color);
+        
+        //stockage avec strcpy (un tar n'annonce pas son nombre d'images => tableau agrandi au besoin)
+        if (num_images == max_images) {
+            ImageData *plus = realloc(score, 2 * (size_t)max_images * sizeof(ImageData));
+            if (plus == NULL) {
+                printf("Erreur allocation mémoire\n");
+                if (fichier) lecture_rendre(lecture, fichier);
+                break;
+            }
+            score = plus;
+            max_images *= 2;
+        }
+        snprintf(score[num_images].filename, sizeof(score[num_images].filename), "%s", img.nom);
+        score[num_images].score = current_score;
+        num_images++;
+        if (fichier) lecture_rendre(lecture, fichier);
+    }
+    if (lecture) lecture_fermer(lecture);
+    if (chemin_pack) pack_fermer(&pack);
+    if (chemin_tar) tar_fermer(&tar);
+    NRarenaStats arene;
+    nrarena_stats(&arene);
+    fprintf(stderr, "arène : pic %zu Ko, %ld allocations, %ld hors arène, %ld bloc(s) pour %zu Ko\n",
+            arene.pic >> 10, arene.nb_alloc, arene.nb_hors_arene, arene.nb_blocs, arene.reserve >> 10);
+    for (int b = 0; b < NR_NB_BACKENDS; b++) {
+        for (int t = 0; t < NR_NB_TYPES; t++) {
+            NRallocStats st;
+            nralloc_stats(b, t, &st);
+            if (st.nb_alloc == 0) continue;
+            fprintf(stderr, "nralloc %s/%s : %ld allocations, %zu Ko, pic %zu Ko\n",
+                    nralloc_nom_backend(b), nralloc_nom_type(t), st.nb_alloc, st.octets >> 10, st.pic >> 10);
+        }
     }
+    nrarena_release();
     
     //ranking
     sort_ranking(score, num_images);
@@ -18,6 +18,13 @@
 #include "nralloc.h"
 #include "nrarith.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#define NR_AVEC_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
 //NR_END est maintenant defini dans nrutil.h
 
 //#define NR_END 1
@@ -35,6 +42,541 @@ void nrerror(char error_text[])
   fprintf(stderr,"...now exiting to system...\n");
   exit(1);
 }
+/* ----------------------------------------------------------------------- */
+/* --- arene par thread pour les matrices de travail (une image a la fois) --- */
+/* ----------------------------------------------------------------------- */
+
+/* chaque bloc rendu par nralloc_bloc est precede d'un en-tete de NR_ENTETE octets qui dit  */
+/* d'ou il vient => nrfree_bloc sait quoi faire, quel que soit le thread qui libere          */
+#define NR_ENTETE        32
+#define NR_ALIGNEMENT    64
+#define NR_TAG_MALLOC    0x4E524D41 /* "NRMA" */
+#define NR_TAG_ARENE     0x4E524152 /* "NRAR" */
+#define NR_TAG_RENDU     0x4E525245 /* "NRRE" bloc d'arene deja passe par nrfree_bloc */
+#define NR_TAG_THP       0x4E524854 /* "NRHT" mmap anonyme, pages de 2 Mo conseillees */
+#define NR_TAG_FICHIER   0x4E524649 /* "NRFI" mmap d'un fichier temporaire efface */
+
+typedef struct {
+  uint32 tag;
+  uint32 decalage;  /* octets entre le debut du malloc / de la projection et le bloc */
+  uint32 classe;    /* classe de la reserve + 1, 0 : taille exacte, jamais gardee */
+  uint32 type;      /* NR_TYPE_* */
+  size_t taille;    /* octets demandes */
+  size_t longueur;  /* octets projetes */
+} NRentete;
+
+#define ENTETE(p) ((NRentete*) ((byte*) (p) - NR_ENTETE))
+
+typedef struct NRbloc {
+  struct NRbloc *prec;
+  size_t         base;     /* octets de l'arene avant ce bloc (marques cumulees) */
+  size_t         capacite;
+  size_t         pos;
+  byte          *brut;     /* rendu par malloc */
+  byte          *data;     /* brut aligne sur NR_ALIGNEMENT */
+} NRbloc;
+
+typedef struct {
+  NRbloc *courant;
+  size_t  taille_bloc;
+  NRarenaStats stats;
+} NRarena;
+
+PRIVATE __thread NRarena *arene = NULL;
+
+PRIVATE void nrstats_free(int backend, NRentete *e);
+
+/* ------------------------------------------------ */
+PRIVATE NRbloc* nrarena_nouveau_bloc(size_t capacite)
+/* ------------------------------------------------ */
+{
+  NRbloc *b = (NRbloc*) malloc(sizeof(NRbloc));
+  if(!b) return NULL;
+  b->brut = (byte*) malloc(capacite + NR_ALIGNEMENT);
+  if(!b->brut) { free(b); return NULL; }
+  b->data = b->brut + ((NR_ALIGNEMENT - ((size_t) b->brut & (NR_ALIGNEMENT - 1))) & (NR_ALIGNEMENT - 1));
+  b->capacite = capacite;
+  b->pos = 0;
+  b->base = 0;
+  b->prec = NULL;
+  return b;
+}
+/* ---------------------------------------- */
+PRIVATE void nrarena_liberer_bloc(NRbloc *b)
+/* ---------------------------------------- */
+{
+  free(b->brut);
+  free(b);
+}
+/* ------------------------------------------------ */
+IMAGE_EXPORT(int) nrarena_init(size_t taille_bloc)
+/* ------------------------------------------------ */
+/* active l'arene du thread courant : les matrices (b, i, d, rgb8) et les tampons de nralloc_bloc */
+/* y sont decoupes au lieu d'un malloc chacun ; retourne 0, -1 si l'allocation du bloc echoue     */
+{
+  if(arene) return 0;
+  if(taille_bloc < 4096) taille_bloc = 4096;
+  arene = (NRarena*) calloc(1, sizeof(NRarena));
+  if(!arene) return -1;
+  arene->taille_bloc = taille_bloc;
+  arene->courant = nrarena_nouveau_bloc(taille_bloc);
+  if(!arene->courant) { free(arene); arene = NULL; return -1; }
+  arene->stats.reserve = taille_bloc;
+  arene->stats.nb_blocs = 1;
+  return 0;
+}
+/* ------------------------------------------------ */
+PRIVATE void nrarena_stats_rendre(size_t marque)
+/* ------------------------------------------------ */
+/* blocs decoupes apres la marque et jamais passes par nrfree_bloc : sortis des stats du      */
+/* backend arene (en_cours) au moment ou l'arene les reprend ; les en-tetes se suivent dans   */
+/* chaque bloc, un decoupage finit exactement a debut + taille                               */
+{
+  NRbloc *b;
+  NRentete *e;
+  size_t pos, debut;
+  for(b = arene->courant; b && b->base + b->pos > marque; b = b->prec) {
+    pos = (marque > b->base) ? marque - b->base : 0;
+    while(pos < b->pos) {
+      debut = (pos + NR_ENTETE + NR_ALIGNEMENT - 1) & ~(size_t)(NR_ALIGNEMENT - 1);
+      e = ENTETE(b->data + debut);
+      if(e->tag == NR_TAG_ARENE) nrstats_free(NR_BACKEND_ARENE, e);
+      pos = debut + e->taille;
+    }
+  }
+}
+/* ---------------------------------- */
+IMAGE_EXPORT(void) nrarena_release(void)
+/* ---------------------------------- */
+/* les blocs encore decoupes deviennent invalides */
+{
+  NRbloc *b, *p;
+  if(!arene) return;
+  nrarena_stats_rendre(0);
+  for(b = arene->courant; b; b = p) { p = b->prec; nrarena_liberer_bloc(b); }
+  free(arene);
+  arene = NULL;
+}
+/* ---------------------------------- */
+IMAGE_EXPORT(size_t) nrarena_mark(void)
+/* ---------------------------------- */
+{
+  if(!arene) return 0;
+  return arene->courant->base + arene->courant->pos;
+}
+/* ------------------------------------------ */
+IMAGE_EXPORT(void) nrarena_reset(size_t marque)
+/* ------------------------------------------ */
+/* tout ce qui a ete decoupe apres la marque est rendu d'un coup (marque 0 : fin d'image)     */
+/* si l'image a demande plusieurs blocs, ils sont remplaces par un seul bloc de la taille du   */
+/* pic => les images suivantes de meme taille tiennent dans un bloc deja touche, sans fautes   */
+{
+  NRbloc *b;
+  if(!arene) return;
+  nrarena_stats_rendre(marque);
+  while(arene->courant->prec && arene->courant->base >= marque) {
+    b = arene->courant;
+    arene->courant = b->prec;
+    nrarena_liberer_bloc(b);
+    arene->stats.nb_blocs--;
+  }
+  arene->courant->pos = marque - arene->courant->base;
+  arene->stats.en_cours = marque;
+  arene->stats.nb_reset++;
+  if(marque == 0 && arene->stats.pic > arene->courant->capacite) {
+    b = nrarena_nouveau_bloc(arene->stats.pic);
+    if(b) {
+      nrarena_liberer_bloc(arene->courant);
+      arene->courant = b;
+    }
+  }
+  arene->stats.reserve = 0;
+  for(b = arene->courant; b; b = b->prec) arene->stats.reserve += b->capacite;
+}
+/* ------------------------------------------------ */
+IMAGE_EXPORT(void) nrarena_stats(NRarenaStats *stats)
+/* ------------------------------------------------ */
+{
+  if(arene) *stats = arene->stats;
+  else memset(stats, 0, sizeof(*stats));
+}
+/* ----------------------------------------------------------------- */
+/* --- reserve par thread des blocs malloc, par classe de capacite --- */
+/* ----------------------------------------------------------------- */
+
+/* classe c : (4 + c%4) << (6 + c/4) octets => 256, 320, 384, 448, 512, 640 ... ; au plus 25%   */
+/* de perte, et des images de dimensions voisines (640x480, 640x479) tombent dans la meme classe */
+/* un bloc rendu est chaine par son premier mot dans la liste de sa classe                     */
+#define NR_POOL_CLASSES  (4 * 56)
+
+typedef struct {
+  void  *libres[NR_POOL_CLASSES];
+  long   nb[NR_POOL_CLASSES];
+  size_t limite_octets;
+  long   limite_classe;
+  NRpoolStats stats;
+} NRpool;
+
+PRIVATE __thread NRpool *pool = NULL;
+
+/* ----------------------------------------- */
+PRIVATE size_t nrpool_taille_classe(long c)
+/* ----------------------------------------- */
+{
+  return (size_t)(4 + c % 4) << (6 + c / 4);
+}
+/* ----------------------------------------- */
+PRIVATE long nrpool_classe(size_t n)
+/* ----------------------------------------- */
+/* plus petite classe qui contient n octets, -1 si aucune */
+{
+  int k = 8;
+  long c;
+  if(n <= 256) return 0;
+  while(k < 63 && ((n - 1) >> (k + 1))) k++;
+  c = (long)(k - 8) * 4 + (long)(((n - 1) >> (k - 2)) & 3) + 1;
+  return (c < NR_POOL_CLASSES) ? c : -1;
+}
+/* ---------------------------------------------------------------------- */
+IMAGE_EXPORT(int) nrpool_init(size_t limite_octets, long limite_classe)
+/* ---------------------------------------------------------------------- */
+/* active la reserve du thread courant : les blocs malloc de nralloc_bloc (matrices b/i/d/rgb8, */
+/* halo, tampons) sont arrondis a leur classe et gardes par nrfree_bloc au lieu d'etre liberes, */
+/* dans la limite de limite_octets en tout et de limite_classe blocs par classe (0 => defaut)   */
+/* retourne 0, -1 si l'allocation echoue                                                        */
+{
+  if(pool) return 0;
+  pool = (NRpool*) calloc(1, sizeof(NRpool));
+  if(!pool) return -1;
+  pool->limite_octets = limite_octets ? limite_octets : NR_POOL_OCTETS;
+  pool->limite_classe = (limite_classe > 0) ? limite_classe : NR_POOL_PAR_CLASSE;
+  return 0;
+}
+/* ---------------------------------- */
+IMAGE_EXPORT(void) nrpool_vider(void)
+/* ---------------------------------- */
+/* rend au systeme les blocs gardes, la reserve reste active */
+{
+  long c;
+  byte *p;
+  if(!pool) return;
+  for(c = 0; c < NR_POOL_CLASSES; c++) {
+    while(pool->libres[c]) {
+      p = (byte*) pool->libres[c];
+      pool->libres[c] = *(void**) p;
+      free(p - ENTETE(p)->decalage);
+    }
+    pool->nb[c] = 0;
+  }
+  pool->stats.octets = 0;
+  pool->stats.nb_blocs = 0;
+}
+/* ------------------------------------ */
+IMAGE_EXPORT(void) nrpool_release(void)
+/* ------------------------------------ */
+/* les blocs encore en service restent valides et seront liberes normalement */
+{
+  if(!pool) return;
+  nrpool_vider();
+  free(pool);
+  pool = NULL;
+}
+/* -------------------------------------------------- */
+IMAGE_EXPORT(void) nrpool_stats(NRpoolStats *stats)
+/* -------------------------------------------------- */
+{
+  if(pool) *stats = pool->stats;
+  else memset(stats, 0, sizeof(*stats));
+}
+/* --------------------------------------------------- */
+/* --- backend d'allocation, statistiques par type --- */
+/* --------------------------------------------------- */
+
+#define NR_PAGE_ENORME   (2 << 20)
+
+PRIVATE int    nr_backend = NR_BACKEND_ARENE;
+PRIVATE size_t nr_seuil = NR_SEUIL_MMAP;
+PRIVATE char   nr_repertoire[1024] = "/var/tmp";
+PRIVATE NRallocStats nr_stats[NR_NB_BACKENDS][NR_NB_TYPES];
+
+PRIVATE const char *nr_noms_backend[NR_NB_BACKENDS] = {"malloc", "arene", "thp", "fichier"};
+PRIVATE const char *nr_noms_type[NR_NB_TYPES] = {"brut", "lignes", "byte", "int", "double", "rgb8"};
+
+/* ----------------------------------------------------------------------------------- */
+IMAGE_EXPORT(int) nralloc_backend(int backend, size_t seuil, const char *repertoire)
+/* ----------------------------------------------------------------------------------- */
+/* a appeler avant de lancer des threads qui allouent ; les blocs deja rendus restent valides  */
+/* seuil : taille a partir de laquelle NR_BACKEND_THP / FICHIER projettent (0 => NR_SEUIL_MMAP) */
+/* repertoire : fichiers de NR_BACKEND_FICHIER, sur disque (NULL => /var/tmp)                 */
+/* retourne 0, -1 si le backend est inconnu ou sans mmap sur ce systeme                        */
+{
+  if(backend < 0 || backend >= NR_NB_BACKENDS) return -1;
+#ifndef NR_AVEC_MMAP
+  if(backend == NR_BACKEND_THP || backend == NR_BACKEND_FICHIER) return -1;
+#endif
+  if(repertoire) {
+    if(strlen(repertoire) >= sizeof(nr_repertoire)) return -1;
+    strcpy(nr_repertoire, repertoire);
+  }
+  nr_backend = backend;
+  nr_seuil = seuil ? seuil : NR_SEUIL_MMAP;
+  return 0;
+}
+/* ------------------------------------------------------------ */
+IMAGE_EXPORT(int) nralloc_backend_depuis_nom(const char *nom)
+/* ------------------------------------------------------------ */
+/* "malloc", "arene", "thp", "fichier" => NR_BACKEND_*, -1 sinon */
+{
+  int b;
+  for(b = 0; b < NR_NB_BACKENDS; b++) {
+    if(strcmp(nom, nr_noms_backend[b]) == 0) return b;
+  }
+  return -1;
+}
+/* ---------------------------------------------------------- */
+IMAGE_EXPORT(const char*) nralloc_nom_backend(int backend)
+/* ---------------------------------------------------------- */
+{
+  return (backend >= 0 && backend < NR_NB_BACKENDS) ? nr_noms_backend[backend] : "?";
+}
+/* ---------------------------------------------------- */
+IMAGE_EXPORT(const char*) nralloc_nom_type(int type)
+/* ---------------------------------------------------- */
+{
+  return (type >= 0 && type < NR_NB_TYPES) ? nr_noms_type[type] : "?";
+}
+/* ---------------------------------------------------------------------------- */
+IMAGE_EXPORT(void) nralloc_stats(int backend, int type, NRallocStats *stats)
+/* ---------------------------------------------------------------------------- */
+/* compteurs communs a tous les threads (mis a jour sans verrou, lecture approchee en cours de route) */
+{
+  NRallocStats *s;
+  memset(stats, 0, sizeof(*stats));
+  if(backend < 0 || backend >= NR_NB_BACKENDS || type < 0 || type >= NR_NB_TYPES) return;
+  s = &nr_stats[backend][type];
+  stats->nb_alloc = __atomic_load_n(&s->nb_alloc, __ATOMIC_RELAXED);
+  stats->nb_free  = __atomic_load_n(&s->nb_free, __ATOMIC_RELAXED);
+  stats->octets   = __atomic_load_n(&s->octets, __ATOMIC_RELAXED);
+  stats->en_cours = __atomic_load_n(&s->en_cours, __ATOMIC_RELAXED);
+  stats->pic      = __atomic_load_n(&s->pic, __ATOMIC_RELAXED);
+}
+/* -------------------------------------------------------------- */
+PRIVATE void nrstats_alloc(int backend, int type, size_t n)
+/* -------------------------------------------------------------- */
+{
+  NRallocStats *s = &nr_stats[backend][type];
+  size_t en_cours, pic;
+  __atomic_fetch_add(&s->nb_alloc, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&s->octets, n, __ATOMIC_RELAXED);
+  en_cours = __atomic_add_fetch(&s->en_cours, n, __ATOMIC_RELAXED);
+  pic = __atomic_load_n(&s->pic, __ATOMIC_RELAXED);
+  while(en_cours > pic && !__atomic_compare_exchange_n(&s->pic, &pic, en_cours, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+/* ------------------------------------------------- */
+PRIVATE void nrstats_free(int backend, NRentete *e)
+/* ------------------------------------------------- */
+{
+  NRallocStats *s = &nr_stats[backend][e->type];
+  __atomic_fetch_add(&s->nb_free, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_sub(&s->en_cours, e->taille, __ATOMIC_RELAXED);
+}
+#ifdef NR_AVEC_MMAP
+/* ------------------------------------------------------ */
+PRIVATE byte* nralloc_projection(size_t n, int fichier)
+/* ------------------------------------------------------ */
+/* THP : zone anonyme alignee sur 2 Mo et conseillee au noyau => une entree de TLB pour 2 Mo   */
+/* au lieu de 512 sur les gros tampons d'image                                                 */
+/* fichier : fichier temporaire efface des sa creation et projete en partage => le noyau peut   */
+/* renvoyer les pages sur disque quand la memoire manque, au lieu de tuer le processus          */
+/* NULL si la projection echoue (l'appelant retombe sur le chemin habituel)                    */
+{
+  size_t longueur, total, page;
+  byte *base, *debut, *p;
+  char chemin[sizeof(nr_repertoire) + 16];
+  int fd;
+
+  if(!fichier) {
+    longueur = (n + NR_ALIGNEMENT + NR_PAGE_ENORME - 1) & ~(size_t)(NR_PAGE_ENORME - 1);
+    total = longueur + NR_PAGE_ENORME;
+    base = (byte*) mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(base == (byte*) MAP_FAILED) return NULL;
+    debut = (byte*) (((size_t) base + NR_PAGE_ENORME - 1) & ~(size_t)(NR_PAGE_ENORME - 1));
+    if(debut > base) munmap(base, (size_t)(debut - base));
+    if(base + total > debut + longueur) munmap(debut + longueur, (size_t)(base + total - (debut + longueur)));
+#ifdef MADV_HUGEPAGE
+    madvise(debut, longueur, MADV_HUGEPAGE);
+#endif
+  } else {
+    page = (size_t) sysconf(_SC_PAGESIZE);
+    longueur = (n + NR_ALIGNEMENT + page - 1) / page * page;
+    snprintf(chemin, sizeof(chemin), "%s/nrallocXXXXXX", nr_repertoire);
+    fd = mkstemp(chemin);
+    if(fd < 0) return NULL;
+    unlink(chemin);
+    if(ftruncate(fd, (off_t) longueur) != 0) {
+      close(fd);
+      return NULL;
+    }
+    debut = (byte*) mmap(NULL, longueur, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(debut == (byte*) MAP_FAILED) return NULL;
+  }
+  p = debut + NR_ALIGNEMENT;
+  ENTETE(p)->tag = fichier ? NR_TAG_FICHIER : NR_TAG_THP;
+  ENTETE(p)->decalage = NR_ALIGNEMENT;
+  ENTETE(p)->classe = 0;
+  ENTETE(p)->longueur = longueur;
+  return p;
+}
+#endif
+/* ------------------------------------------------------ */
+PRIVATE void* nralloc_bloc_type(size_t n, int type)
+/* ------------------------------------------------------ */
+/* n octets alignes sur NR_ALIGNEMENT, servis par le backend choisi :                         */
+/* THP / FICHIER au dela du seuil, sinon arene du thread si active (sauf NR_BACKEND_MALLOC), */
+/* sinon reserve du thread si active, sinon malloc                                            */
+{
+  byte *p, *q;
+  size_t debut, fin, cap, demande = n;
+  long c;
+  NRbloc *b;
+
+  if(n > (size_t) -1 - NR_PAGE_ENORME - 2 * NR_ALIGNEMENT) return NULL;
+#ifdef NR_AVEC_MMAP
+  if((nr_backend == NR_BACKEND_THP || nr_backend == NR_BACKEND_FICHIER) && n >= nr_seuil) {
+    p = nralloc_projection(n, nr_backend == NR_BACKEND_FICHIER);
+    if(p) {
+      ENTETE(p)->type = (uint32) type;
+      ENTETE(p)->taille = n;
+      nrstats_alloc(nr_backend, type, n);
+      return p;
+    }
+  }
+#endif
+  if(arene && nr_backend != NR_BACKEND_MALLOC) {
+    b = arene->courant;
+    /* en-tete juste avant la zone alignee */
+    debut = (b->pos + NR_ENTETE + NR_ALIGNEMENT - 1) & ~(size_t)(NR_ALIGNEMENT - 1);
+    fin = debut + n;
+    if(fin > b->capacite) {
+      cap = arene->taille_bloc;
+      if(cap < 2 * b->capacite) cap = 2 * b->capacite;
+      if(cap < n + NR_ENTETE + NR_ALIGNEMENT) cap = n + NR_ENTETE + NR_ALIGNEMENT;
+      b = nrarena_nouveau_bloc(cap);
+      if(b) {
+        b->base = arene->courant->base + arene->courant->pos;
+        b->prec = arene->courant;
+        arene->courant = b;
+        arene->stats.nb_blocs++;
+        arene->stats.reserve += cap;
+        debut = NR_ALIGNEMENT;
+        fin = debut + n;
+      }
+    }
+    if(b) {
+      p = b->data + debut;
+      ENTETE(p)->tag = NR_TAG_ARENE;
+      ENTETE(p)->type = (uint32) type;
+      ENTETE(p)->taille = n;
+      b->pos = fin;
+      arene->stats.en_cours = b->base + b->pos;
+      if(arene->stats.en_cours > arene->stats.pic) arene->stats.pic = arene->stats.en_cours;
+      arene->stats.nb_alloc++;
+      nrstats_alloc(NR_BACKEND_ARENE, type, n);
+      return p;
+    }
+    arene->stats.nb_hors_arene++;
+  }
+  c = -1;
+  if(pool) {
+    c = nrpool_classe(n);
+    if(c >= 0 && pool->libres[c]) {
+      /* deja touche par une image precedente : ni malloc ni faute de page */
+      p = (byte*) pool->libres[c];
+      pool->libres[c] = *(void**) p;
+      pool->nb[c]--;
+      pool->stats.octets -= nrpool_taille_classe(c);
+      pool->stats.nb_blocs--;
+      pool->stats.nb_succes++;
+      ENTETE(p)->type = (uint32) type;
+      ENTETE(p)->taille = n;
+      nrstats_alloc(NR_BACKEND_MALLOC, type, n);
+      return p;
+    }
+    pool->stats.nb_echecs++;
+    if(c >= 0) n = nrpool_taille_classe(c);
+  }
+  q = (byte*) malloc(n + NR_ENTETE + NR_ALIGNEMENT);
+  if(!q) return NULL;
+  /* meme alignement que dans l'arene, decalage garde dans l'en-tete pour free */
+  p = (byte*) (((size_t) (q + NR_ENTETE) + NR_ALIGNEMENT - 1) & ~(size_t)(NR_ALIGNEMENT - 1));
+  ENTETE(p)->tag = NR_TAG_MALLOC;
+  ENTETE(p)->decalage = (uint32) (p - q);
+  ENTETE(p)->classe = (uint32) (c + 1);
+  ENTETE(p)->type = (uint32) type;
+  ENTETE(p)->taille = demande;
+  nrstats_alloc(NR_BACKEND_MALLOC, type, demande);
+  return p;
+}
+/* ---------------------------------------- */
+IMAGE_EXPORT(void*) nralloc_bloc(size_t n)
+/* ---------------------------------------- */
+{
+  return nralloc_bloc_type(n, NR_TYPE_BRUT);
+}
+/* ---------------------------------- */
+IMAGE_EXPORT(void) nrfree_bloc(void *p)
+/* ---------------------------------- */
+/* sans effet pour un bloc d'arene : la place revient au prochain nrarena_reset */
+/* bloc malloc arrondi a sa classe : garde dans la reserve du thread s'il y a la place */
+{
+  NRentete *e;
+  long c;
+  size_t taille;
+  if(!p) return;
+  e = ENTETE(p);
+  if(e->tag == NR_TAG_ARENE) {
+    nrstats_free(NR_BACKEND_ARENE, e);
+    e->tag = NR_TAG_RENDU; /* deja compte, ignore au reset */
+    return;
+  }
+#ifdef NR_AVEC_MMAP
+  if(e->tag == NR_TAG_THP || e->tag == NR_TAG_FICHIER) {
+    nrstats_free(e->tag == NR_TAG_THP ? NR_BACKEND_THP : NR_BACKEND_FICHIER, e);
+    munmap((byte*) p - e->decalage, e->longueur);
+    return;
+  }
+#endif
+  if(e->tag != NR_TAG_MALLOC) return;
+  nrstats_free(NR_BACKEND_MALLOC, e);
+  c = (long) e->classe - 1;
+  if(pool && c >= 0) {
+    taille = nrpool_taille_classe(c);
+    if(pool->nb[c] < pool->limite_classe && pool->stats.octets + taille <= pool->limite_octets) {
+      *(void**) p = pool->libres[c];
+      pool->libres[c] = p;
+      pool->nb[c]++;
+      pool->stats.octets += taille;
+      if(pool->stats.octets > pool->stats.pic) pool->stats.pic = pool->stats.octets;
+      pool->stats.nb_blocs++;
+      pool->stats.nb_gardes++;
+      return;
+    }
+    pool->stats.nb_refus++;
+  }
+  free((byte*) p - e->decalage);
+}
+/* ----------------------------------------------------------------- */
+PRIVATE void* nrcalloc_bloc(size_t nb, size_t taille, int type)
+/* ----------------------------------------------------------------- */
+{
+  byte *p;
+  if(taille && nb > (size_t) -1 / taille) return NULL;
+  p = (byte*) nralloc_bloc_type(nb * taille, type);
+  /* projection neuve : deja a zero, rien a toucher (et rien a ecrire sur disque) */
+  if(p && ENTETE(p)->tag != NR_TAG_THP && ENTETE(p)->tag != NR_TAG_FICHIER) memset(p, 0, nb * taille);
+  return p;
+}
 /* ------------------------------------- */
 IMAGE_EXPORT(float*) vector(long nl, long nh)
 /* ------------------------------------- */
@@ -471,13 +1013,13 @@ IMAGE_EXPORT(double**) dmatrix(long nrl, long nrh, long ncl, long nch)
         double **m;
 
         /* allocate pointers to rows */
-        m=(double **) malloc((size_t)((nrow+NR_END)*sizeof(double*)));
+        m=(double **) nralloc_bloc_type((size_t)((nrow+NR_END)*sizeof(double*)), NR_TYPE_LIGNES);
         if (!m) nrerror("allocation failure 1 in dmatrix()");
         m += NR_END;
         m -= nrl;
 
         /* allocate rows and set pointers to them */
-        m[nrl]=(double *) malloc((size_t)((nrow*ncol+NR_END)*sizeof(double)));
+        m[nrl]=(double *) nralloc_bloc_type((size_t)((nrow*ncol+NR_END)*sizeof(double)), NR_TYPE_DOUBLE);
         if (!m[nrl]) nrerror("allocation failure 2 in dmatrix()");
         m[nrl] += NR_END;
         m[nrl] -= ncl;
@@ -497,13 +1039,13 @@ IMAGE_EXPORT(double**) dmatrix0(long nrl, long nrh, long ncl, long nch)
         double **m;
 
         /* allocate pointers to rows */
-        m=(double **) malloc((size_t)((nrow+NR_END)*sizeof(double*)));
+        m=(double **) nralloc_bloc_type((size_t)((nrow+NR_END)*sizeof(double*)), NR_TYPE_LIGNES);
         if (!m) nrerror("allocation failure 1 in dmatrix0()");
         m += NR_END;
         m -= nrl;
 
         /* allocate rows and set pointers to them */
-        m[nrl]=(double *) calloc( (size_t)(nrow*ncol+NR_END) , (size_t)(sizeof(double)) );
+        m[nrl]=(double *) nrcalloc_bloc( (size_t)(nrow*ncol+NR_END) , (size_t)(sizeof(double)), NR_TYPE_DOUBLE );
         if (!m[nrl]) nrerror("allocation failure 2 in dmatrix0()");
         m[nrl] += NR_END;
         m[nrl] -= ncl;
@@ -548,14 +1090,14 @@ IMAGE_EXPORT(byte**) bmatrix(long nrl, long nrh, long ncl, long nch)
         byte **m;
 
         /* allocate pointers to rows */
-        m=(byte **) malloc((size_t)((nrow+NR_END)*sizeof(byte*)));
+        m=(byte **) nralloc_bloc_type((size_t)((nrow+NR_END)*sizeof(byte*)), NR_TYPE_LIGNES);
         if (!m) nrerror("allocation failure 1 in bmatrix()");
         m += NR_END;
         m -= nrl;
 
 
         /* allocate rows and set pointers to them */
-        m[nrl]=(byte *) malloc((size_t)((nrow*ncol+NR_END)*sizeof(byte)));
+        m[nrl]=(byte *) nralloc_bloc_type((size_t)((nrow*ncol+NR_END)*sizeof(byte)), NR_TYPE_BYTE);
         if (!m[nrl]) nrerror("allocation failure 2 in bmatrix()");
         m[nrl] += NR_END;
         m[nrl] -= ncl;
@@ -574,14 +1116,14 @@ IMAGE_EXPORT(byte**) bmatrix0(long nrl, long nrh, long ncl, long nch)
         byte **m;
 
         /* allocate pointers to rows */
-        m=(byte **) malloc((size_t)((nrow+NR_END)*sizeof(byte*)));
+        m=(byte **) nralloc_bloc_type((size_t)((nrow+NR_END)*sizeof(byte*)), NR_TYPE_LIGNES);
         if (!m) nrerror("allocation failure 1 in bmatrix0()");
         m += NR_END;
         m -= nrl;
 
 
         /* allocate rows and set pointers to them */
-        m[nrl]=(byte *) calloc( (size_t)(nrow*ncol+NR_END), sizeof(byte));
+        m[nrl]=(byte *) nrcalloc_bloc( (size_t)(nrow*ncol+NR_END), sizeof(byte), NR_TYPE_BYTE);
         if (!m[nrl]) nrerror("allocation failure 2 in bmatrix0()");
         m[nrl] += NR_END;
         m[nrl] -= ncl;
@@ -698,14 +1240,14 @@ IMAGE_EXPORT(int**) imatrix(long nrl, long nrh, long ncl, long nch)
         int **m;
 
         /* allocate pointers to rows */
-        m=(int **) malloc((size_t)((nrow+NR_END)*sizeof(int*)));
+        m=(int **) nralloc_bloc_type((size_t)((nrow+NR_END)*sizeof(int*)), NR_TYPE_LIGNES);
         if (!m) nrerror("allocation failure 1 in imatrix()");
         m += NR_END;
         m -= nrl;
 
 
         /* allocate rows and set pointers to them */
-        m[nrl]=(int *) malloc((size_t)((nrow*ncol+NR_END)*sizeof(int)));
+        m[nrl]=(int *) nralloc_bloc_type((size_t)((nrow*ncol+NR_END)*sizeof(int)), NR_TYPE_INT);
         if (!m[nrl]) nrerror("allocation failure 2 in imatrix()");
         m[nrl] += NR_END;
         m[nrl] -= ncl;
@@ -724,13 +1266,13 @@ IMAGE_EXPORT(int**) imatrix0(long nrl, long nrh, long ncl, long nch)
         int **m;
 
         /* allocate pointers to rows */
-        m=(int **) malloc((size_t)((nrow+NR_END)*sizeof(int*)));
+        m=(int **) nralloc_bloc_type((size_t)((nrow+NR_END)*sizeof(int*)), NR_TYPE_LIGNES);
         if (!m) nrerror("allocation failure 1 in imatrix0()");
         m += NR_END;
         m -= nrl;
 
         /* allocate rows and set pointers to them */
-        m[nrl]=(int *) calloc((size_t)(nrow*ncol+NR_END),sizeof(int));
+        m[nrl]=(int *) nrcalloc_bloc((size_t)(nrow*ncol+NR_END),sizeof(int), NR_TYPE_INT);
         if (!m[nrl]) nrerror("allocation failure 2 in imatrix0()");
         m[nrl] += NR_END;
         m[nrl] -= ncl;
@@ -799,12 +1341,12 @@ IMAGE_EXPORT(rgb8**) rgb8matrix(long nrl, long nrh, long ncl, long nch)
   rgb8 **m;
 
   /* allocate pointers to rows */
-  m=(rgb8**) malloc((size_t)(nrow*sizeof(rgb8*)));
+  m=(rgb8**) nralloc_bloc_type((size_t)(nrow*sizeof(rgb8*)), NR_TYPE_LIGNES);
   if (!m) nrerror("allocation failure 1 in rgb8matrix()");
   m -= nrl;
 
   /* allocate rows and set pointers to them */
-  m[nrl]=(rgb8*) malloc((size_t)((nrow*ncol)*sizeof(rgb8)));
+  m[nrl]=(rgb8*) nralloc_bloc_type((size_t)((nrow*ncol)*sizeof(rgb8)), NR_TYPE_RGB8);
   if (!m[nrl]) nrerror("allocation failure 2 in rgb8matrix()");
   m[nrl] -= ncl;
 
@@ -968,12 +1510,12 @@ IMAGE_EXPORT(rgb8**) rgb8matrix0(long nrl, long nrh, long ncl, long nch)
   rgb8 **m;
 
   /* allocate pointers to rows */
-  m=(rgb8**) malloc((size_t)(nrow*sizeof(rgb8*)));
+  m=(rgb8**) nralloc_bloc_type((size_t)(nrow*sizeof(rgb8*)), NR_TYPE_LIGNES);
   if (!m) nrerror("allocation failure 1 in rgb8matrix0()");
   m -= nrl;
 
   /* allocate rows and set pointers to them */
-  m[nrl]=(rgb8*) calloc(nrow*ncol, sizeof(rgb8));
+  m[nrl]=(rgb8*) nrcalloc_bloc(nrow*ncol, sizeof(rgb8), NR_TYPE_RGB8);
   if (!m[nrl]) nrerror("allocation failure 2 in rgb8matrix0()");
   m[nrl] -= ncl;
 
@@ -1126,6 +1668,173 @@ IMAGE_EXPORT(void) shrink_lmatrix(long **m, long nrl, long nrh, long ncl, long n
 
   for(i=nrl+1;i<=nrh;i++) m[i]=m[i-1]+ncol;
 }
+/* ------------------------------------------------------------------- */
+/* --- matrices alignees, pas de ligne au choix, halo de 'halo' pixels --- */
+/* ------------------------------------------------------------------- */
+
+/* ligne i : [front octets][halo pixels][ncol pixels][halo pixels][bourrage jusqu'au pas]  */
+/* front complete le halo gauche a un multiple de NR_ALIGNEMENT => &m[i][ncl] aligne       */
+/* les lignes du halo haut/bas ont leur pointeur : m[nrl-halo .. nrh+halo]                 */
+/* ----------------------------------------------------------- */
+PRIVATE size_t matrix_halo_front(long halo, size_t taille)
+/* ----------------------------------------------------------- */
+{
+  return ((size_t) halo * taille + NR_ALIGNEMENT - 1) & ~(size_t)(NR_ALIGNEMENT - 1);
+}
+/* ----------------------------------------------------------------------------------------- */
+IMAGE_EXPORT(long) matrix_halo_pitch(long ncl, long nch, long halo, long taille, long pitch)
+/* ----------------------------------------------------------------------------------------- */
+/* pas effectif en octets : au moins la ligne complete, multiple de NR_ALIGNEMENT ; 0 si pitch < 0 */
+{
+  size_t min;
+
+  if(pitch < 0) return 0;
+  min = matrix_halo_front(halo, (size_t) taille) + (size_t)(nch - ncl + 1 + halo) * (size_t) taille;
+  if((size_t) pitch < min) pitch = (long) min;
+  return (long) (((size_t) pitch + NR_ALIGNEMENT - 1) & ~(size_t)(NR_ALIGNEMENT - 1));
+}
+/* --------------------------------------------------------------------------------------------------------------- */
+PRIVATE void** matrix_halo(long nrl, long nrh, long ncl, long nch, long halo, long pitch, size_t taille, int type, char *nom)
+/* --------------------------------------------------------------------------------------------------------------- */
+{
+  long i, nrow;
+  size_t front;
+  byte *data;
+  void **m;
+
+  if(pitch < 0) nrerror(nom);
+  if(halo < 0) halo = 0;
+  nrow = nrh - nrl + 1 + 2 * halo;
+  front = matrix_halo_front(halo, taille);
+  pitch = matrix_halo_pitch(ncl, nch, halo, (long) taille, pitch);
+
+  m = (void**) nralloc_bloc_type((size_t) nrow * sizeof(void*), NR_TYPE_LIGNES);
+  if(!m) nrerror(nom);
+  m -= nrl - halo;
+
+  data = (byte*) nralloc_bloc_type((size_t) nrow * (size_t) pitch, type);
+  if(!data) nrerror(nom);
+  for(i = nrl - halo; i <= nrh + halo; i++) {
+    m[i] = data + (size_t)(i - (nrl - halo)) * (size_t) pitch + front - (ptrdiff_t) ncl * (ptrdiff_t) taille;
+  }
+  return m;
+}
+/* ------------------------------------------------------------------------------------------ */
+PRIVATE void free_matrix_halo(void **m, long nrl, long nrh, long ncl, long nch, long halo, size_t taille)
+/* ------------------------------------------------------------------------------------------ */
+{
+  if(halo < 0) halo = 0;
+  nrfree_bloc((byte*) m[nrl - halo] + (ptrdiff_t) ncl * (ptrdiff_t) taille - matrix_halo_front(halo, taille));
+  nrfree_bloc(m + nrl - halo);
+}
+/* ------------------------------------------------------------------------------------------------- */
+PRIVATE void matrix_halo_remplir(void **m, long nrl, long nrh, long ncl, long nch, long halo, int mode, size_t taille)
+/* ------------------------------------------------------------------------------------------------- */
+/* NR_HALO_ZERO : halo a 0 ; NR_HALO_REPLIQUE : pixel de bord le plus proche (coins compris) */
+{
+  long i, k;
+  size_t ligne = (size_t)(nch - ncl + 1 + 2 * halo) * taille;
+  byte *p, *g, *d;
+
+  if(halo <= 0) return;
+  for(i = nrl; i <= nrh; i++) {
+    p = (byte*) m[i] + (ptrdiff_t) ncl * (ptrdiff_t) taille;
+    g = p - (size_t) halo * taille;
+    d = p + (size_t)(nch - ncl + 1) * taille;
+    if(mode == NR_HALO_ZERO) {
+      memset(g, 0, (size_t) halo * taille);
+      memset(d, 0, (size_t) halo * taille);
+    } else {
+      for(k = 0; k < halo; k++) {
+        memcpy(g + (size_t) k * taille, p, taille);
+        memcpy(d + (size_t) k * taille, d - taille, taille);
+      }
+    }
+  }
+  for(k = 1; k <= halo; k++) {
+    g = (byte*) m[nrl - k] + (ptrdiff_t)(ncl - halo) * (ptrdiff_t) taille;
+    d = (byte*) m[nrh + k] + (ptrdiff_t)(ncl - halo) * (ptrdiff_t) taille;
+    if(mode == NR_HALO_ZERO) {
+      memset(g, 0, ligne);
+      memset(d, 0, ligne);
+    } else {
+      memcpy(g, (byte*) m[nrl] + (ptrdiff_t)(ncl - halo) * (ptrdiff_t) taille, ligne);
+      memcpy(d, (byte*) m[nrh] + (ptrdiff_t)(ncl - halo) * (ptrdiff_t) taille, ligne);
+    }
+  }
+}
+/* -------------------------------------------------------------------------------------- */
+IMAGE_EXPORT(byte**) bmatrix_halo(long nrl, long nrh, long ncl, long nch, long halo, long pitch)
+/* -------------------------------------------------------------------------------------- */
+{
+  return (byte**) matrix_halo(nrl, nrh, ncl, nch, halo, pitch, sizeof(byte), NR_TYPE_BYTE, "allocation failure in bmatrix_halo()");
+}
+/* ------------------------------------------------------------------------------------- */
+IMAGE_EXPORT(int**) imatrix_halo(long nrl, long nrh, long ncl, long nch, long halo, long pitch)
+/* ------------------------------------------------------------------------------------- */
+{
+  return (int**) matrix_halo(nrl, nrh, ncl, nch, halo, pitch, sizeof(int), NR_TYPE_INT, "allocation failure in imatrix_halo()");
+}
+/* ---------------------------------------------------------------------------------------- */
+IMAGE_EXPORT(double**) dmatrix_halo(long nrl, long nrh, long ncl, long nch, long halo, long pitch)
+/* ---------------------------------------------------------------------------------------- */
+{
+  return (double**) matrix_halo(nrl, nrh, ncl, nch, halo, pitch, sizeof(double), NR_TYPE_DOUBLE, "allocation failure in dmatrix_halo()");
+}
+/* ----------------------------------------------------------------------------------------- */
+IMAGE_EXPORT(rgb8**) rgb8matrix_halo(long nrl, long nrh, long ncl, long nch, long halo, long pitch)
+/* ----------------------------------------------------------------------------------------- */
+{
+  return (rgb8**) matrix_halo(nrl, nrh, ncl, nch, halo, pitch, sizeof(rgb8), NR_TYPE_RGB8, "allocation failure in rgb8matrix_halo()");
+}
+/* ----------------------------------------------------------------------------------------------- */
+IMAGE_EXPORT(void) free_bmatrix_halo(byte **m, long nrl, long nrh, long ncl, long nch, long halo)
+/* ----------------------------------------------------------------------------------------------- */
+{
+  free_matrix_halo((void**) m, nrl, nrh, ncl, nch, halo, sizeof(byte));
+}
+/* ---------------------------------------------------------------------------------------------- */
+IMAGE_EXPORT(void) free_imatrix_halo(int **m, long nrl, long nrh, long ncl, long nch, long halo)
+/* ---------------------------------------------------------------------------------------------- */
+{
+  free_matrix_halo((void**) m, nrl, nrh, ncl, nch, halo, sizeof(int));
+}
+/* ------------------------------------------------------------------------------------------------- */
+IMAGE_EXPORT(void) free_dmatrix_halo(double **m, long nrl, long nrh, long ncl, long nch, long halo)
+/* ------------------------------------------------------------------------------------------------- */
+{
+  free_matrix_halo((void**) m, nrl, nrh, ncl, nch, halo, sizeof(double));
+}
+/* --------------------------------------------------------------------------------------------------- */
+IMAGE_EXPORT(void) free_rgb8matrix_halo(rgb8 **m, long nrl, long nrh, long ncl, long nch, long halo)
+/* --------------------------------------------------------------------------------------------------- */
+{
+  free_matrix_halo((void**) m, nrl, nrh, ncl, nch, halo, sizeof(rgb8));
+}
+/* ------------------------------------------------------------------------------------------------------ */
+IMAGE_EXPORT(void) bmatrix_halo_remplir(byte **m, long nrl, long nrh, long ncl, long nch, long halo, int mode)
+/* ------------------------------------------------------------------------------------------------------ */
+{
+  matrix_halo_remplir((void**) m, nrl, nrh, ncl, nch, halo, mode, sizeof(byte));
+}
+/* ----------------------------------------------------------------------------------------------------- */
+IMAGE_EXPORT(void) imatrix_halo_remplir(int **m, long nrl, long nrh, long ncl, long nch, long halo, int mode)
+/* ----------------------------------------------------------------------------------------------------- */
+{
+  matrix_halo_remplir((void**) m, nrl, nrh, ncl, nch, halo, mode, sizeof(int));
+}
+/* -------------------------------------------------------------------------------------------------------- */
+IMAGE_EXPORT(void) dmatrix_halo_remplir(double **m, long nrl, long nrh, long ncl, long nch, long halo, int mode)
+/* -------------------------------------------------------------------------------------------------------- */
+{
+  matrix_halo_remplir((void**) m, nrl, nrh, ncl, nch, halo, mode, sizeof(double));
+}
+/* ---------------------------------------------------------------------------------------------------------- */
+IMAGE_EXPORT(void) rgb8matrix_halo_remplir(rgb8 **m, long nrl, long nrh, long ncl, long nch, long halo, int mode)
+/* ---------------------------------------------------------------------------------------------------------- */
+{
+  matrix_halo_remplir((void**) m, nrl, nrh, ncl, nch, halo, mode, sizeof(rgb8));
+}
 /* ------------------------------------------------------------ */
 IMAGE_EXPORT(byte**) bmatrix_map(long nrl, long nrh, long ncl, long nch)
 /* ------------------------------------------------------------ */
@@ -2771,8 +3480,8 @@ IMAGE_EXPORT(void) free_dmatrix(double **m, long nrl, long nrh, long ncl, long n
 /* --------------------------------------------------------------- */
 /* free a double matrix allocated by dmatrix() */
 {
-        free((FREE_ARG) (m[nrl]+ncl-NR_END));
-        free((FREE_ARG) (m+nrl-NR_END));
+        nrfree_bloc(m[nrl]+ncl-NR_END);
+        nrfree_bloc(m+nrl-NR_END);
 }
 /* ---------------------------------------------------------------------- */
 IMAGE_EXPORT(void) free_cmatrix(unsigned char **m, long nrl, long nrh, long ncl, long nch)
@@ -2787,8 +3496,8 @@ IMAGE_EXPORT(void) free_bmatrix(byte **m, long nrl, long nrh, long ncl, long nch
 /* ------------------------------------------------------------- */
 /* free an uchar matrix allocated by bmatrix() */
 {
-        free((FREE_ARG) (m[nrl]+ncl-NR_END));
-        free((FREE_ARG) (m+nrl-NR_END));
+        nrfree_bloc(m[nrl]+ncl-NR_END);
+        nrfree_bloc(m+nrl-NR_END);
 }
 /* -------------------------------------------------------------- */
 IMAGE_EXPORT(void) free_smatrix(short **m, long nrl, long nrh, long ncl, long nch)
@@ -2811,8 +3520,8 @@ IMAGE_EXPORT(void) free_imatrix(int **m, long nrl, long nrh, long ncl, long nch)
 /* ------------------------------------------------------------ */
 /* free an int matrix allocated by imatrix() */
 {
-        free((FREE_ARG) (m[nrl]+ncl-NR_END));
-        free((FREE_ARG) (m+nrl-NR_END));
+        nrfree_bloc(m[nrl]+ncl-NR_END);
+        nrfree_bloc(m+nrl-NR_END);
 }
 /* -------------------------------------------------------------- */
 IMAGE_EXPORT(void) free_uimatrix(uint **m, long nrl, long nrh, long ncl, long nch)
@@ -2848,8 +3557,8 @@ IMAGE_EXPORT(void) free_lmatrix(long **m, long nrl, long nrh, long ncl, long nch
 IMAGE_EXPORT(void) free_rgb8matrix(rgb8 **m, long nrl, long nrh, long ncl, long nch)
 /* ------------------------------------------------------------------------ */
 {
-  free((FREE_ARG) (m[nrl]+ncl-NR_END));
-  free((FREE_ARG) (m+nrl-NR_END));
+  nrfree_bloc(m[nrl]+ncl-NR_END);
+  nrfree_bloc(m+nrl-NR_END);
 }
 /* ------------------------------------------------------------------------ */
 IMAGE_EXPORT(void) free_rgbx8matrix(rgbx8 **m, long nrl, long nrh, long ncl, long nch)
@@ -45,6 +45,105 @@ extern long nr_end;
 /* ------------- */
 void nrerror(char error_text[]);
 
+/* ----------------------- */
+/* --- arene par thread --- */
+/* ----------------------- */
+
+/* une fois nrarena_init appele par un thread, les matrices b/i/d/rgb8 (et leurs variantes 0) */
+/* et les tampons de nralloc_bloc de ce thread sont decoupes dans de gros blocs reutilises :   */
+/* les free_* correspondants ne font plus rien, nrarena_reset(0) rend tout a la fin de l'image */
+/* sans arene active, meme comportement qu'avant (un malloc / free par allocation)             */
+typedef struct {
+  size_t en_cours;      /* octets decoupes depuis le dernier reset */
+  size_t pic;           /* maximum de en_cours depuis nrarena_init */
+  size_t reserve;       /* octets des blocs gardes */
+  long   nb_alloc;      /* allocations servies par l'arene */
+  long   nb_hors_arene; /* allocations retombees sur malloc (bloc impossible a obtenir) */
+  long   nb_blocs;
+  long   nb_reset;
+} NRarenaStats;
+
+IMAGE_EXPORT(int)    nrarena_init   (size_t taille_bloc);
+IMAGE_EXPORT(void)   nrarena_release(void);
+IMAGE_EXPORT(size_t) nrarena_mark   (void);
+IMAGE_EXPORT(void)   nrarena_reset  (size_t marque);
+IMAGE_EXPORT(void)   nrarena_stats  (NRarenaStats *stats);
+
+/* ------------------------------------------- */
+/* --- reserve par thread, hors arene active --- */
+/* ------------------------------------------- */
+
+/* blocs malloc rendus par les free_* gardes par classe de capacite (pas de 25% au plus) et     */
+/* redonnes a la demande suivante de la meme classe => une suite d'images de tailles identiques */
+/* ou voisines ne fait plus ni malloc ni faute de premiere ecriture en regime etabli             */
+/* sert quand aucune arene n'est active (l'arene passe avant) ; limites : octets en tout et blocs */
+/* par classe, au-dela le bloc est libere normalement                                            */
+#define NR_POOL_OCTETS     (64 << 20)
+#define NR_POOL_PAR_CLASSE 8
+
+typedef struct {
+  long   nb_succes;     /* demandes servies par la reserve */
+  long   nb_echecs;     /* demandes passees a malloc */
+  long   nb_gardes;     /* blocs rendus gardes */
+  long   nb_refus;      /* blocs rendus liberes (limites atteintes) */
+  long   nb_blocs;      /* blocs gardes actuellement */
+  size_t octets;        /* octets gardes actuellement */
+  size_t pic;           /* maximum de octets */
+} NRpoolStats;
+
+IMAGE_EXPORT(int)    nrpool_init    (size_t limite_octets, long limite_classe);
+IMAGE_EXPORT(void)   nrpool_vider   (void);
+IMAGE_EXPORT(void)   nrpool_release (void);
+IMAGE_EXPORT(void)   nrpool_stats   (NRpoolStats *stats);
+
+/* ------------------------------------- */
+/* --- backend, choisi a l'execution --- */
+/* ------------------------------------- */
+
+/* toutes les allocations de nralloc_bloc (et donc des matrices b/i/d/rgb8, halo compris) passent */
+/* par le backend choisi ; nrfree_bloc reconnait chaque bloc a son en-tete, quel que soit le     */
+/* backend actif au moment de la liberation                                                      */
+/*   NR_BACKEND_MALLOC  : malloc (et reserve du thread si active), arene ignoree                  */
+/*   NR_BACKEND_ARENE   : arene du thread si active, sinon comme malloc (defaut)                  */
+/*   NR_BACKEND_THP     : au dela du seuil, mmap anonyme aligne sur 2 Mo + MADV_HUGEPAGE => moins */
+/*                        de defauts de TLB sur les tampons de 100 Mo et plus ; arene en dessous  */
+/*   NR_BACKEND_FICHIER : au dela du seuil, mmap partage d'un fichier temporaire efface => les    */
+/*                        matrices plus grosses que la RAM vont sur disque au lieu d'un OOM       */
+#define NR_BACKEND_MALLOC  0
+#define NR_BACKEND_ARENE   1
+#define NR_BACKEND_THP     2
+#define NR_BACKEND_FICHIER 3
+#define NR_NB_BACKENDS     4
+
+#define NR_SEUIL_MMAP      (8 << 20)
+
+/* statistiques par backend et par type d'allocation */
+#define NR_TYPE_BRUT       0 /* nralloc_bloc */
+#define NR_TYPE_LIGNES     1 /* tableaux de pointeurs de lignes */
+#define NR_TYPE_BYTE       2
+#define NR_TYPE_INT        3
+#define NR_TYPE_DOUBLE     4
+#define NR_TYPE_RGB8       5
+#define NR_NB_TYPES        6
+
+typedef struct {
+  long   nb_alloc;
+  long   nb_free;
+  size_t octets;        /* cumul des octets demandes */
+  size_t en_cours;      /* octets pas encore rendus (nrfree_bloc, nrarena_reset pour l'arene) */
+  size_t pic;           /* maximum de en_cours */
+} NRallocStats;
+
+IMAGE_EXPORT(int)    nralloc_backend           (int backend, size_t seuil, const char *repertoire);
+IMAGE_EXPORT(int)    nralloc_backend_depuis_nom(const char *nom);
+IMAGE_EXPORT(const char*) nralloc_nom_backend  (int backend);
+IMAGE_EXPORT(const char*) nralloc_nom_type     (int type);
+IMAGE_EXPORT(void)   nralloc_stats             (int backend, int type, NRallocStats *stats);
+
+/* tampon brut aligne sur 64 octets, backend courant ; a rendre par nrfree_bloc */
+IMAGE_EXPORT(void*)  nralloc_bloc   (size_t n);
+IMAGE_EXPORT(void)   nrfree_bloc    (void *p);
+
 IMAGE_EXPORT(float*)            vector  (long nl, long nh);
 IMAGE_EXPORT(float*)            vector0 (long nl, long nh);
 IMAGE_EXPORT(double*)          dvector  (long nl, long nh);
@@ -122,6 +221,36 @@ IMAGE_EXPORT(int32***)          i32cube (long ndl, long ndh, long nrl, long nrh,
 IMAGE_EXPORT(uint32***)        ui32cube (long ndl, long ndh, long nrl, long nrh, long ncl, long nch);
 IMAGE_EXPORT(float32***)        f32cube (long ndl, long ndh, long nrl, long nrh, long ncl, long nch);
 
+/* -------------------------- */
+/* --- matrices avec halo --- */
+/* -------------------------- */
+
+/* &m[i][ncl] aligne sur 64 octets pour toute ligne, pas (octets entre deux lignes) au choix :  */
+/* pitch = 0 => le plus petit multiple de 64 qui contient la ligne, sinon arrondi au dessus     */
+/* (pitch < 0 refuse : nrerror a l'allocation, 0 rendu par matrix_halo_pitch)                   */
+/* m[nrl-halo..nrh+halo][ncl-halo..nch+halo] adressable => les noyaux lisent leurs voisins sans */
+/* cas particulier au bord, indexation NRC habituelle sur [nrl..nrh][ncl..nch]                  */
+/* contenu non initialise : *_halo_remplir met le halo a 0 ou y replique les pixels de bord     */
+#define NR_HALO_ZERO     0
+#define NR_HALO_REPLIQUE 1
+
+IMAGE_EXPORT(long)     matrix_halo_pitch(long ncl, long nch, long halo, long taille, long pitch);
+
+IMAGE_EXPORT(byte**)      bmatrix_halo(long nrl, long nrh, long ncl, long nch, long halo, long pitch);
+IMAGE_EXPORT(int**)       imatrix_halo(long nrl, long nrh, long ncl, long nch, long halo, long pitch);
+IMAGE_EXPORT(double**)    dmatrix_halo(long nrl, long nrh, long ncl, long nch, long halo, long pitch);
+IMAGE_EXPORT(rgb8**)   rgb8matrix_halo(long nrl, long nrh, long ncl, long nch, long halo, long pitch);
+
+IMAGE_EXPORT(void) free_bmatrix_halo   (byte   **m, long nrl, long nrh, long ncl, long nch, long halo);
+IMAGE_EXPORT(void) free_imatrix_halo   (int    **m, long nrl, long nrh, long ncl, long nch, long halo);
+IMAGE_EXPORT(void) free_dmatrix_halo   (double **m, long nrl, long nrh, long ncl, long nch, long halo);
+IMAGE_EXPORT(void) free_rgb8matrix_halo(rgb8   **m, long nrl, long nrh, long ncl, long nch, long halo);
+
+IMAGE_EXPORT(void) bmatrix_halo_remplir   (byte   **m, long nrl, long nrh, long ncl, long nch, long halo, int mode);
+IMAGE_EXPORT(void) imatrix_halo_remplir   (int    **m, long nrl, long nrh, long ncl, long nch, long halo, int mode);
+IMAGE_EXPORT(void) dmatrix_halo_remplir   (double **m, long nrl, long nrh, long ncl, long nch, long halo, int mode);
+IMAGE_EXPORT(void) rgb8matrix_halo_remplir(rgb8   **m, long nrl, long nrh, long ncl, long nch, long halo, int mode);
+
 /* --------------- */
 /* --- Mapping --- */
 /* --------------- */
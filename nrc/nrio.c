@@ -15,6 +15,11 @@
 #include <stdlib.h>
 #include <ctype.h> /* isdigit */
 #include <string.h> /* memcpy */
+#include <limits.h> /* LONG_MAX */
+#include <fcntl.h>     /* open */
+#include <unistd.h>    /* close */
+#include <sys/mman.h>  /* mmap */
+#include <sys/stat.h>  /* fstat */
 /*#include <memory.h> /* memcpy */
 
 #include "def.h"
@@ -3319,51 +3324,274 @@ IMAGE_EXPORT(void) save_imatrix2(int **m, long nrl, long nrh, long ncl, long nch
 /* -- PGM IO for bmatrix -- */
 /* ------------------------ */
 
-PRIVATE char *readitem   (FILE *file, char *buffer);
-PRIVATE void  ReadPGMrow (FILE *file, long width, byte  *line);
+PRIVATE const byte *readitem_mem(const byte *p, const byte *fin, char *buffer, int taille);
+PRIVATE long  ReadPGMrow (FILE *file, long width, byte  *line);
 PRIVATE void  WritePGMrow(byte *line, long width, FILE  *file);
 
-/* ----------------------------------------- */
-PRIVATE char *readitem(FILE *file,char *buffer)
-/* ----------------------------------------- */
-/* lecture d'un mot */
-{
-  char *aux;
-  int k;
-
-  k=0;
-  aux=buffer;
-  while (!feof(file))
-    {
-      *aux=fgetc(file);
-      switch(k)
-        {
-        case 0:
-          if (*aux=='#') k=1;
-          if (isalnum(*aux)) k=2,aux++;
-          break;
-        case 1:
-          if (*aux==0xA) k=0;
-          break;
-        case 2:
-          if (!isalnum(*aux))
-            {
-              *aux=0;
-              return buffer;
-            }
-          aux++;
-          break;
-        }
+/* -------------------------------------------------------------------------- */
+PRIVATE const byte *readitem_mem(const byte *p, const byte *fin, char *buffer, int taille)
+/* -------------------------------------------------------------------------- */
+/* lecture d'un mot dans un tampon : saute blancs et commentaires (# jusqu'a la fin */
+/* de ligne), lit un mot puis consomme le separateur qui le suit.                   */
+/* retourne NULL si le tampon se termine avant la fin du mot                        */
+{
+  int k = 0, n = 0;
+
+  while(p < fin) {
+    char c = (char) *p++;
+    switch(k) {
+    case 0:
+      if(c == '#') k = 1;
+      if(isalnum((unsigned char) c)) { k = 2; buffer[n++] = c; }
+      break;
+    case 1:
+      if(c == 0xA) k = 0;
+      break;
+    case 2:
+      if(!isalnum((unsigned char) c)) { buffer[n] = 0; return p; }
+      if(n < taille - 1) buffer[n++] = c;
+      break;
     }
-  *aux=0;
-  return buffer;
+  }
+  return NULL;
+}
+/* ------------------------------------------------------------------ */
+IMAGE_EXPORT(int) ParsePNMheader(const byte *buf, size_t n, PNMheader *h)
+/* ------------------------------------------------------------------ */
+/* entete P5/P6 lu dans un tampon memoire, h->offset = position du premier pixel */
+{
+  const byte *p = buf, *fin = buf + n;
+  char buffer[80];
+
+  memset(h, 0, sizeof(*h));
+  if((p = readitem_mem(p, fin, buffer, sizeof(buffer))) == NULL) return n < 3 ? PNM_ERR_TRONQUE : PNM_ERR_FORMAT;
+  if     (strcmp(buffer, "P5") == 0) h->ncanal = 1;
+  else if(strcmp(buffer, "P6") == 0) h->ncanal = 3;
+  else return PNM_ERR_FORMAT;
+
+  if((p = readitem_mem(p, fin, buffer, sizeof(buffer))) == NULL) return PNM_ERR_TRONQUE;
+  h->width = atol(buffer);
+  if((p = readitem_mem(p, fin, buffer, sizeof(buffer))) == NULL) return PNM_ERR_TRONQUE;
+  h->height = atol(buffer);
+  if((p = readitem_mem(p, fin, buffer, sizeof(buffer))) == NULL) return PNM_ERR_TRONQUE;
+  h->maxval = atol(buffer);
+
+  /* stride et taille des pixels doivent tenir dans un long */
+  if(h->width <= 0 || h->height <= 0 || h->width > LONG_MAX / 3 / h->height) return PNM_ERR_DIMENSIONS;
+  if(h->maxval <= 0 || h->maxval > 255) return PNM_ERR_MAXVAL;
+  h->offset = (long) (p - buf);
+  return PNM_OK;
+}
+/* --------------------------------------------------------------------------------------- */
+IMAGE_EXPORT(int) ReadPNMheader(FILE *file, int *ncanal, long *width, long *height, long *maxval)
+/* --------------------------------------------------------------------------------------- */
+/* lecture de l'entete P5 ou P6 par blocs (un fread le plus souvent), le fichier reste */
+/* positionne sur le premier pixel. la taille des pixels est verifiee contre celle du   */
+/* fichier quand c'est un fichier regulier. retourne PNM_OK ou un code PNM_ERR_*        */
+/* (entete limite a PNM_ENTETE_BLOC octets sur un pipe)                                  */
+{
+  byte bloc[PNM_ENTETE_BLOC], *buf = bloc, *plus;
+  size_t n = 0, cap = sizeof(bloc), lus;
+  long debut = ftell(file);
+  struct stat st;
+  PNMheader h;
+  int code;
+
+  if(debut < 0) {
+    /* flux non positionnable (pipe) : octet par octet, on s'arrete juste apres maxval */
+    int c;
+    code = PNM_ERR_TRONQUE;
+    while(n < cap && (c = fgetc(file)) != EOF) {
+      buf[n++] = (byte) c;
+      if(isspace(c) && (code = ParsePNMheader(buf, n, &h)) != PNM_ERR_TRONQUE) break;
+    }
+    if(code != PNM_OK) return code;
+    *ncanal = h.ncanal;
+    *width  = h.width;
+    *height = h.height;
+    *maxval = h.maxval;
+    return PNM_OK;
+  }
+  for(;;) {
+    lus = fread(buf + n, 1, cap - n, file);
+    n += lus;
+    code = ParsePNMheader(buf, n, &h);
+    /* entete plus long que le bloc (commentaires) => on agrandit jusqu'a PNM_ENTETE_MAX */
+    if(code != PNM_ERR_TRONQUE || n < cap || cap >= PNM_ENTETE_MAX) break;
+    plus = (byte*) malloc(2 * cap);
+    if(!plus) { code = PNM_ERR_MEMOIRE; break; }
+    memcpy(plus, buf, n);
+    if(buf != bloc) free(buf);
+    buf = plus;
+    cap *= 2;
+  }
+  if(buf != bloc) free(buf);
+  if(code != PNM_OK) return code;
+
+  if(fseek(file, debut + h.offset, SEEK_SET) != 0) return PNM_ERR_FICHIER;
+  if(fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode)) {
+    long reste = (long) st.st_size - (debut + h.offset);
+    if(reste < 0 || reste / (h.width * h.ncanal) < h.height) return PNM_ERR_TRONQUE;
+  }
+  *ncanal = h.ncanal;
+  *width  = h.width;
+  *height = h.height;
+  *maxval = h.maxval;
+  return PNM_OK;
+}
+/* ------------------------- */
+IMAGE_EXPORT(char *) PNMerror(int code)
+/* ------------------------- */
+{
+  switch(code) {
+  case PNM_OK:             return "ok";
+  case PNM_ERR_FICHIER:    return "fichier illisible";
+  case PNM_ERR_FORMAT:     return "format non P5/P6";
+  case PNM_ERR_DIMENSIONS: return "dimensions invalides";
+  case PNM_ERR_MAXVAL:     return "maxval hors 1..255";
+  case PNM_ERR_TRONQUE:    return "fichier tronque";
+  case PNM_ERR_MEMOIRE:    return "memoire insuffisante";
+  }
+  return "erreur inconnue";
+}
+/* ----------------------------------------------------------------- */
+IMAGE_EXPORT(int) ViewPNM(const byte *buf, size_t taille, PNMview *view)
+/* ----------------------------------------------------------------- */
+/* vue sur un fichier P5/P6 deja en memoire (tampon de lecture, projection, ...) */
+/* les lignes pointent dans buf qui doit survivre a la vue, map reste a NULL     */
+/* retourne PNM_OK ou un code PNM_ERR_*                                          */
+{
+  PNMheader h;
+  long i;
+  int code;
+
+  memset(view, 0, sizeof(*view));
+  code = ParsePNMheader(buf, taille, &h);
+  if(code != PNM_OK) return code;
+  view->taille = taille;
+  view->ncanal = h.ncanal;
+  view->width  = h.width;
+  view->height = h.height;
+  view->stride = view->width * view->ncanal;
+  if((taille - (size_t) h.offset) / (size_t) view->stride < (size_t) view->height) return PNM_ERR_TRONQUE;
+  view->base = (byte*) buf + h.offset;
+
+  view->row = (byte**) nralloc_bloc((size_t) view->height * sizeof(byte*));
+  if(!view->row) return PNM_ERR_MEMOIRE;
+  for(i = 0; i < view->height; i++) view->row[i] = view->base + i * view->stride;
+  return PNM_OK;
+}
+/* ------------------------------------------------------- */
+IMAGE_EXPORT(int) MapPNM(char *filename, PNMview *view)
+/* ------------------------------------------------------- */
+/* projection en lecture seule d'un fichier P5/P6 8 bits : entete lu en place, */
+/* pixels jamais copies. retourne PNM_OK ou un code PNM_ERR_* (jamais nrerror) */
+{
+  struct stat st;
+  size_t taille;
+  void *map;
+  int fd, code;
+
+  memset(view, 0, sizeof(*view));
+  fd = open(filename, O_RDONLY);
+  if(fd < 0) return PNM_ERR_FICHIER;
+  if(fstat(fd, &st) != 0 || st.st_size <= 0) { close(fd); return PNM_ERR_FICHIER; }
+
+  taille = (size_t) st.st_size;
+  map = mmap(NULL, taille, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); /* la projection reste valide apres fermeture */
+  if(map == MAP_FAILED) return PNM_ERR_FICHIER;
+
+  code = ViewPNM((const byte*) map, taille, view);
+  if(code != PNM_OK) {
+    UnmapPNM(view);
+    munmap(map, taille);
+    return code;
+  }
+  view->map = map;
+
+  /* lecture sequentielle => lecture anticipee plus agressive du noyau */
+  madvise(view->map, view->taille, MADV_SEQUENTIAL);
+  return PNM_OK;
+}
+/* ------------------------------------ */
+IMAGE_EXPORT(void) UnmapPNM(PNMview *view)
+/* ------------------------------------ */
+{
+  if(view->row) nrfree_bloc(view->row);
+  if(view->map) munmap(view->map, view->taille);
+  memset(view, 0, sizeof(*view));
+}
+/* -------------------------------------------------------------------- */
+IMAGE_EXPORT(int) OpenPNMstream(char *filename, long capacite, PNMstream *s)
+/* -------------------------------------------------------------------- */
+/* lecteur P5/P6 en flux : anneau de capacite lignes reutilise, seule l'entete est lue ici */
+/* retourne PNM_OK ou un code PNM_ERR_* (jamais nrerror)                                  */
+{
+  long maxval;
+  int ncanal, code;
+
+  memset(s, 0, sizeof(*s));
+  if(capacite < 1) return PNM_ERR_DIMENSIONS;
+  s->file = fopen(filename, "rb");
+  if(!s->file) return PNM_ERR_FICHIER;
+  code = ReadPNMheader(s->file, &ncanal, &s->width, &s->height, &maxval);
+  if(code != PNM_OK) {
+    ClosePNMstream(s);
+    return code;
+  }
+  s->ncanal   = ncanal;
+  s->stride   = s->width * ncanal;
+  s->capacite = capacite;
+  s->anneau   = (byte*)  malloc((size_t) capacite * (size_t) s->stride);
+  s->lot      = (byte**) malloc((size_t) capacite * sizeof(byte*));
+  if(!s->anneau || !s->lot) {
+    ClosePNMstream(s);
+    return PNM_ERR_MEMOIRE;
+  }
+  return PNM_OK;
+}
+/* ---------------------------------------------------------- */
+IMAGE_EXPORT(long) NextPNMrows(PNMstream *s, long n, byte ***rows)
+/* ---------------------------------------------------------- */
+/* lit jusqu'a n lignes (au plus capacite) dans l'anneau, *rows[0..k-1] dans l'ordre de l'image */
+/* retourne k, 0 en fin d'image, PNM_ERR_TRONQUE si le fichier est tronque                     */
+/* les lignes des lots precedents restent valides tant que moins de capacite lignes ont ete    */
+/* lues depuis => un consommateur qui garde h lignes de halo prend capacite >= n + h            */
+{
+  long k, fait, bloc;
+
+  if(n > s->capacite) n = s->capacite;
+  if(n > s->height - s->lues) n = s->height - s->lues;
+  if(n <= 0) { *rows = s->lot; return 0; }
+
+  /* un fread par morceau contigu de l'anneau (au plus deux) */
+  for(fait = 0; fait < n; fait += bloc) {
+    bloc = s->capacite - s->tete;
+    if(bloc > n - fait) bloc = n - fait;
+    if(fread(s->anneau + s->tete * s->stride, (size_t) s->stride, (size_t) bloc, s->file) != (size_t) bloc) return PNM_ERR_TRONQUE;
+    for(k = 0; k < bloc; k++) s->lot[fait + k] = s->anneau + (s->tete + k) * s->stride;
+    s->tete = (s->tete + bloc) % s->capacite;
+  }
+  s->lues += n;
+  *rows = s->lot;
+  return n;
+}
+/* ---------------------------------------- */
+IMAGE_EXPORT(void) ClosePNMstream(PNMstream *s)
+/* ---------------------------------------- */
+{
+  if(s->file) fclose(s->file);
+  if(s->anneau) free(s->anneau);
+  if(s->lot) free(s->lot);
+  memset(s, 0, sizeof(*s));
 }
 /* ------------------------------------------------------- */
-PRIVATE void ReadPGMrow(FILE  *file, long width, byte  *line)
+PRIVATE long ReadPGMrow(FILE  *file, long width, byte  *line)
 /* ------------------------------------------------------- */
 {
     /* Le fichier est ouvert (en lecture) et ne sera pas ferme a la fin */
-     fread(&(line[0]), sizeof(byte), width, file);
+     return (long) fread(&(line[0]), sizeof(byte), width, file);
 }
 /* -------------------------------------------------------- */
 PRIVATE void WritePGMrow(byte  *line, long width, FILE  *file)
@@ -3377,34 +3605,25 @@ PRIVATE void WritePGMrow(byte  *line, long width, FILE  *file)
 IMAGE_EXPORT(byte **) LoadPGM_bmatrix(char *filename, long *nrl, long *nrh, long *ncl, long *nch)
 /* ------------------------------------------------------------------------------------------- */
 {
-  /* cette version ne lit plus que le type P5 */
+  /* cette version ne lit que le type P5                                        */
+  /* retourne NULL (sans nrerror) si le fichier est absent, d'un autre type,     */
+  /* d'entete invalide ou tronque : l'appelant peut passer a l'image suivante    */
 
-  long height, width, gris;
+  long height, width, gris, i;
   byte **m;
   FILE *file;
-  /*int   format;/**/
+  int ncanal;
 
-  char *buffer;
-  /*char  c;/**/
-  int i;
-  
-  buffer = (char*) calloc(80, sizeof(char));
   /* ouverture du fichier */
   file = fopen(filename,"rb");
   if (file==NULL)
-    nrerror("ouverture du fichier impossible\n");
-    //nrerror("ouverture du fichier %s impossible\n", filename);
-
-  /* lecture de l'entete du fichier pgm */
-  readitem(file, buffer);
-  /*fscanf(fichier, "%s", buffer);*/
-  if(strcmp(buffer, "P5") != 0)
-    nrerror("entete du fichier %s invalide\n");
-    //nrerror("entete du fichier %s invalide\n", filename);
+    return NULL;
 
-  width  = atoi(readitem(file, buffer));
-  height = atoi(readitem(file, buffer));
-  gris   = atoi(readitem(file, buffer));
+  /* lecture de l'entete (validee contre la taille du fichier) */
+  if(ReadPNMheader(file, &ncanal, &width, &height, &gris) != PNM_OK || ncanal != 1) {
+    fclose(file);
+    return NULL;
+  }
 
   *nrl = 0;
   *nrh = height - 1;
@@ -3413,11 +3632,14 @@ IMAGE_EXPORT(byte **) LoadPGM_bmatrix(char *filename, long *nrl, long *nrh, long
   m = bmatrix(*nrl, *nrh, *ncl, *nch);
   
   for(i=0; i<height; i++) {
-    ReadPGMrow(file, width, m[i]);
+    if(ReadPGMrow(file, width, m[i]) != width) {
+      free_bmatrix(m, *nrl, *nrh, *ncl, *nch);
+      fclose(file);
+      return NULL;
+    }
   }
 
   fclose(file);
-  free(buffer);
 
   return m;
 }
@@ -3453,11 +3675,11 @@ IMAGE_EXPORT(void) SavePGM_bmatrix(byte **m, long nrl, long nrh, long ncl, long
 /* --------------------------- */
 
 /* ------------------------------------------------------- */
-PRIVATE void ReadPNMrow(FILE  *file, long width, byte  *line)
+PRIVATE long ReadPNMrow(FILE  *file, long width, byte  *line)
 /* ------------------------------------------------------- */
 {
     /* Le fichier est ouvert (en lecture) et ne sera pas ferme a la fin */
-     fread(&(line[0]), sizeof(byte), 3*sizeof(byte)*width, file);
+     return (long) fread(&(line[0]), sizeof(byte), 3*sizeof(byte)*width, file);
 }
 /* -------------------------------------------------------- */
 PRIVATE void WritePNMrow(byte  *line, long width, FILE  *file)
@@ -3471,34 +3693,25 @@ PRIVATE void WritePNMrow(byte  *line, long width, FILE  *file)
 IMAGE_EXPORT(rgb8 **) LoadPPM_rgb8matrix(char *filename, long *nrl, long *nrh, long *ncl, long *nch)
 /* ---------------------------------------------------------------------------------------------- */
 {
-  /* cette version ne lit plus que le type P6 */
+  /* cette version ne lit que le type P6                                        */
+  /* retourne NULL (sans nrerror) si le fichier est absent, d'un autre type,     */
+  /* d'entete invalide ou tronque : l'appelant peut passer a l'image suivante    */
 
-  long height, width, gris;
+  long height, width, gris, i;
   rgb8 **m;
   FILE *file;
-  /*int   format;/**/
+  int ncanal;
 
-  char *buffer;
-  /*char  c;/**/
-  int i;
-  
-  buffer = (char*) calloc(80, sizeof(char));
   /* ouverture du fichier */
   file = fopen(filename,"rb");
   if (file==NULL)
-    nrerror("ouverture du fichier impossible\n");
-    //nrerror("ouverture du fichier %s impossible\n", filename);
+    return NULL;
 
-  /* lecture de l'entete du fichier pgm */
-  readitem(file, buffer);
-  /*fscanf(fichier, "%s", buffer);*/
-  if(strcmp(buffer, "P6") != 0)
-    nrerror("entete du fichier %s invalide\n");
-    //nrerror("entete du fichier %s invalide\n", filename);
-
-  width  = atoi(readitem(file, buffer));
-  height = atoi(readitem(file, buffer));
-  gris   = atoi(readitem(file, buffer));
+  /* lecture de l'entete (validee contre la taille du fichier) */
+  if(ReadPNMheader(file, &ncanal, &width, &height, &gris) != PNM_OK || ncanal != 3) {
+    fclose(file);
+    return NULL;
+  }
 
   *nrl = 0;
   *nrh = height - 1;
@@ -3507,11 +3720,14 @@ IMAGE_EXPORT(rgb8 **) LoadPPM_rgb8matrix(char *filename, long *nrl, long *nrh, l
   m = rgb8matrix(*nrl, *nrh, *ncl, *nch);
   
   for(i=0; i<height; i++) {
-    ReadPNMrow(file, width, (byte*)m[i]);
+    if(ReadPNMrow(file, width, (byte*)m[i]) != 3*width) {
+      free_rgb8matrix(m, *nrl, *nrh, *ncl, *nch);
+      fclose(file);
+      return NULL;
+    }
   }
 
   fclose(file);
-  free(buffer);
 
   return m;
 }
@@ -3542,3 +3758,346 @@ IMAGE_EXPORT(void) SavePPM_rgb8matrix(rgb8 **m, long nrl, long nrh, long ncl, lo
   /* fermeture du fichier */
   fclose(file);
 }
+/* ----------------------------------- */
+/* -- codec sans perte famille QOI -- */
+/* ----------------------------------- */
+
+/* ops QOI (qoiformat.org) ; la variante gris reprend INDEX et RUN, DIFF passe a 6 bits */
+/* et LUMA devient PAIRE : deux ecarts successifs de 3 bits dans un seul octet           */
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_PAIRE 0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_OP_RGB   0xfe
+#define QOI_OP_RGBA  0xff
+#define QOI_MASQUE   0xc0
+#define QOI_HASH(r, g, b, a) (((r) * 3 + (g) * 5 + (b) * 7 + (a) * 11) & 63)
+#define QOI_TAMPON   65536
+
+typedef struct {
+  FILE *file;
+  long  n;
+  int   erreur;
+  byte  buf[QOI_TAMPON + 16]; /* marge : une op ecrite sans test (5 octets au plus) */
+} QOIsortie;
+
+/* ------------------------------------- */
+PRIVATE void QOIvider(QOIsortie *o)
+/* ------------------------------------- */
+{
+  if(o->n > 0 && fwrite(o->buf, 1, (size_t) o->n, o->file) != (size_t) o->n) o->erreur = 1;
+  o->n = 0;
+}
+/* ------------------------------------------------------------------------------ */
+PRIVATE int EncodeQOI(byte **rows, long width, long height, int ncanal, char *filename)
+/* ------------------------------------------------------------------------------ */
+/* rows[i] = premier pixel de la ligne i (gris ou rgb8 packe), image vue comme une seule suite */
+{
+  QOIsortie *o;
+  byte index[64][4], px[4], *b;
+  long i, x, run = 0;
+  int h, code;
+
+  o = (QOIsortie*) malloc(sizeof(QOIsortie));
+  if(!o) return PNM_ERR_MEMOIRE;
+  o->n = 0;
+  o->erreur = 0;
+  o->file = fopen(filename, "wb");
+  if(!o->file) { free(o); return PNM_ERR_FICHIER; }
+
+  b = o->buf;
+  memcpy(b, "qoif", 4);
+  b[4] = (byte) (width >> 24);  b[5] = (byte) (width >> 16);  b[6]  = (byte) (width >> 8);  b[7]  = (byte) width;
+  b[8] = (byte) (height >> 24); b[9] = (byte) (height >> 16); b[10] = (byte) (height >> 8); b[11] = (byte) height;
+  b[12] = (byte) ncanal;
+  b[13] = 0; /* sRGB */
+  o->n = QOI_ENTETE;
+
+  memset(index, 0, sizeof(index));
+  px[0] = px[1] = px[2] = 0;
+  px[3] = 255;
+
+  if(ncanal == 3) {
+    for(i = 0; i < height; i++) {
+      byte *l = rows[i];
+      for(x = 0; x < width; x++, l += 3) {
+        if(o->n >= QOI_TAMPON) QOIvider(o);
+        if(l[0] == px[0] && l[1] == px[1] && l[2] == px[2]) {
+          if(++run == 62) { o->buf[o->n++] = (byte) (QOI_OP_RUN | 61); run = 0; }
+          continue;
+        }
+        if(run > 0) { o->buf[o->n++] = (byte) (QOI_OP_RUN | (run - 1)); run = 0; }
+        h = QOI_HASH(l[0], l[1], l[2], 255);
+        if(index[h][0] == l[0] && index[h][1] == l[1] && index[h][2] == l[2] && index[h][3] == 255) {
+          o->buf[o->n++] = (byte) (QOI_OP_INDEX | h);
+        } else {
+          signed char dr = (signed char) (l[0] - px[0]);
+          signed char dg = (signed char) (l[1] - px[1]);
+          signed char db = (signed char) (l[2] - px[2]);
+          signed char dr_dg = (signed char) (dr - dg), db_dg = (signed char) (db - dg);
+          index[h][0] = l[0]; index[h][1] = l[1]; index[h][2] = l[2]; index[h][3] = 255;
+          if(dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+            o->buf[o->n++] = (byte) (QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+          } else if(dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+            o->buf[o->n++] = (byte) (QOI_OP_LUMA | (dg + 32));
+            o->buf[o->n++] = (byte) (((dr_dg + 8) << 4) | (db_dg + 8));
+          } else {
+            o->buf[o->n++] = QOI_OP_RGB;
+            o->buf[o->n++] = l[0];
+            o->buf[o->n++] = l[1];
+            o->buf[o->n++] = l[2];
+          }
+        }
+        px[0] = l[0]; px[1] = l[1]; px[2] = l[2];
+      }
+    }
+  } else {
+    int prec = 0, saut = 0;
+    for(i = 0; i < height; i++) {
+      byte *l = rows[i];
+      for(x = 0; x < width; x++) {
+        int v = l[x], suivant = -1, d1, d2;
+        if(saut) { saut = 0; continue; } /* second pixel d'une PAIRE deja emise */
+        if(o->n >= QOI_TAMPON) QOIvider(o);
+        if(v == prec) {
+          if(++run == 62) { o->buf[o->n++] = (byte) (QOI_OP_RUN | 61); run = 0; }
+          continue;
+        }
+        if(run > 0) { o->buf[o->n++] = (byte) (QOI_OP_RUN | (run - 1)); run = 0; }
+        if(x + 1 < width) suivant = l[x + 1];
+        else if(i + 1 < height) suivant = rows[i + 1][0];
+        d1 = (signed char) (v - prec);
+        d2 = (signed char) (suivant - v);
+        h = QOI_HASH(v, v, v, 255);
+        if(suivant >= 0 && d1 >= -4 && d1 <= 3 && d2 >= -4 && d2 <= 3) {
+          o->buf[o->n++] = (byte) (QOI_OP_PAIRE | ((d1 + 4) << 3) | (d2 + 4));
+          index[h][0] = (byte) v;
+          index[QOI_HASH(suivant, suivant, suivant, 255)][0] = (byte) suivant;
+          v = suivant;
+          saut = 1;
+        } else if(index[h][0] == v) {
+          o->buf[o->n++] = (byte) (QOI_OP_INDEX | h);
+        } else {
+          index[h][0] = (byte) v;
+          if(d1 >= -32 && d1 <= 31) o->buf[o->n++] = (byte) (QOI_OP_DIFF | (d1 + 32));
+          else { o->buf[o->n++] = QOI_OP_RGB; o->buf[o->n++] = (byte) v; }
+        }
+        prec = v;
+      }
+    }
+  }
+  if(o->n >= QOI_TAMPON) QOIvider(o);
+  if(run > 0) o->buf[o->n++] = (byte) (QOI_OP_RUN | (run - 1));
+  /* marqueur de fin : 7 x 00 puis 01 */
+  memset(o->buf + o->n, 0, QOI_FIN - 1);
+  o->buf[o->n + QOI_FIN - 1] = 1;
+  o->n += QOI_FIN;
+  QOIvider(o);
+  code = o->erreur ? PNM_ERR_FICHIER : PNM_OK;
+  if(fclose(o->file) != 0) code = PNM_ERR_FICHIER;
+  if(code != PNM_OK) remove(filename);
+  free(o);
+  return code;
+}
+/* ------------------------------------------------------------------------------------------ */
+IMAGE_EXPORT(int) SaveQOI_bmatrix(byte **m, long nrl, long nrh, long ncl, long nch, char *filename)
+/* ------------------------------------------------------------------------------------------ */
+{
+  byte **rows;
+  long i;
+  int code;
+
+  rows = (byte**) malloc((size_t) (nrh - nrl + 1) * sizeof(byte*));
+  if(!rows) return PNM_ERR_MEMOIRE;
+  for(i = nrl; i <= nrh; i++) rows[i - nrl] = &m[i][ncl];
+  code = EncodeQOI(rows, nch - ncl + 1, nrh - nrl + 1, 1, filename);
+  free(rows);
+  return code;
+}
+/* --------------------------------------------------------------------------------------------- */
+IMAGE_EXPORT(int) SaveQOI_rgb8matrix(rgb8 **m, long nrl, long nrh, long ncl, long nch, char *filename)
+/* --------------------------------------------------------------------------------------------- */
+{
+  byte **rows;
+  long i;
+  int code;
+
+  rows = (byte**) malloc((size_t) (nrh - nrl + 1) * sizeof(byte*));
+  if(!rows) return PNM_ERR_MEMOIRE;
+  for(i = nrl; i <= nrh; i++) rows[i - nrl] = (byte*) &m[i][ncl];
+  code = EncodeQOI(rows, nch - ncl + 1, nrh - nrl + 1, 3, filename);
+  free(rows);
+  return code;
+}
+/* ----------------------------------------------------------------- */
+IMAGE_EXPORT(int) ViewQOI(const byte *buf, size_t taille, QOIstream *s)
+/* ----------------------------------------------------------------- */
+/* flux de lignes sur un fichier QOI deja en memoire, buf doit survivre au flux */
+/* retourne PNM_OK ou un code PNM_ERR_*                                         */
+{
+  unsigned long w, h;
+  int canaux;
+
+  memset(s, 0, sizeof(*s));
+  if(taille < QOI_ENTETE) return PNM_ERR_TRONQUE;
+  if(memcmp(buf, "qoif", 4) != 0) return PNM_ERR_FORMAT;
+  w = ((unsigned long) buf[4] << 24) | ((unsigned long) buf[5] << 16) | ((unsigned long) buf[6] << 8) | buf[7];
+  h = ((unsigned long) buf[8] << 24) | ((unsigned long) buf[9] << 16) | ((unsigned long) buf[10] << 8) | buf[11];
+  canaux = buf[12];
+  if(canaux != 1 && canaux != 3 && canaux != 4) return PNM_ERR_FORMAT;
+  if(w == 0 || h == 0 || w > LONG_MAX / 3 || h > LONG_MAX / 3) return PNM_ERR_DIMENSIONS;
+  /* un octet code au plus 62 pixels => entete incoherente avec la taille du fichier */
+  if((double) w * (double) h > 62.0 * (double) (taille - QOI_ENTETE)) return PNM_ERR_TRONQUE;
+
+  s->width  = (long) w;
+  s->height = (long) h;
+  s->canaux = canaux;
+  s->ncanal = (canaux == 1) ? 1 : 3;
+  s->taille = taille;
+  s->p      = buf + QOI_ENTETE;
+  s->fin    = buf + taille;
+  s->attente = -1;
+  s->px[3]  = 255;
+  s->ligne  = (byte*) malloc((size_t) s->width * s->ncanal);
+  if(!s->ligne) return PNM_ERR_MEMOIRE;
+  return PNM_OK;
+}
+/* ---------------------------------------------------- */
+IMAGE_EXPORT(int) MapQOI(char *filename, QOIstream *s)
+/* ---------------------------------------------------- */
+{
+  struct stat st;
+  size_t taille;
+  void *map;
+  int fd, code;
+
+  memset(s, 0, sizeof(*s));
+  fd = open(filename, O_RDONLY);
+  if(fd < 0) return PNM_ERR_FICHIER;
+  if(fstat(fd, &st) != 0 || st.st_size <= 0) { close(fd); return PNM_ERR_FICHIER; }
+  taille = (size_t) st.st_size;
+  map = mmap(NULL, taille, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED) return PNM_ERR_FICHIER;
+
+  code = ViewQOI((const byte*) map, taille, s);
+  if(code != PNM_OK) {
+    CloseQOI(s);
+    munmap(map, taille);
+    return code;
+  }
+  s->map = map;
+  madvise(s->map, s->taille, MADV_SEQUENTIAL);
+  return PNM_OK;
+}
+/* ------------------------------------------------- */
+IMAGE_EXPORT(int) NextQOIrow(QOIstream *s, byte **row)
+/* ------------------------------------------------- */
+/* decode la ligne suivante dans s->ligne (rgb8* si ncanal=3)               */
+/* retourne PNM_OK, PNM_ERR_TRONQUE (plus d'ops) ou PNM_ERR_FORMAT (op 0xff en gris) */
+{
+  const byte *p = s->p, *fin = s->fin;
+  byte *o = s->ligne;
+  long x, w = s->width, run = s->run;
+  int code = PNM_OK;
+
+  if(s->lues >= s->height) return PNM_ERR_TRONQUE;
+
+  if(s->canaux != 1) {
+    byte r = s->px[0], g = s->px[1], b = s->px[2], a = s->px[3];
+    byte index[64][4];
+    memcpy(index, s->index, sizeof(index)); /* copie locale : pas d'alias avec la ligne ecrite */
+    for(x = 0; x < w; x++, o += 3) {
+      if(run > 0) {
+        run--;
+      } else {
+        int b1, h;
+        if(p >= fin) { code = PNM_ERR_TRONQUE; break; }
+        b1 = *p++;
+        if(b1 == QOI_OP_RGB) {
+          if(fin - p < 3) { code = PNM_ERR_TRONQUE; break; }
+          r = p[0]; g = p[1]; b = p[2];
+          p += 3;
+        } else if(b1 == QOI_OP_RGBA) {
+          if(fin - p < 4) { code = PNM_ERR_TRONQUE; break; }
+          r = p[0]; g = p[1]; b = p[2]; a = p[3];
+          p += 4;
+        } else if((b1 & QOI_MASQUE) == QOI_OP_INDEX) {
+          r = index[b1][0]; g = index[b1][1]; b = index[b1][2]; a = index[b1][3];
+        } else if((b1 & QOI_MASQUE) == QOI_OP_DIFF) {
+          r += ((b1 >> 4) & 3) - 2;
+          g += ((b1 >> 2) & 3) - 2;
+          b += (b1 & 3) - 2;
+        } else if((b1 & QOI_MASQUE) == QOI_OP_LUMA) {
+          int b2, vg;
+          if(p >= fin) { code = PNM_ERR_TRONQUE; break; }
+          b2 = *p++;
+          vg = (b1 & 0x3f) - 32;
+          r += vg - 8 + ((b2 >> 4) & 0x0f);
+          g += vg;
+          b += vg - 8 + (b2 & 0x0f);
+        } else {
+          run = b1 & 0x3f;
+        }
+        h = QOI_HASH(r, g, b, a);
+        index[h][0] = r; index[h][1] = g; index[h][2] = b; index[h][3] = a;
+      }
+      o[0] = r; o[1] = g; o[2] = b; /* alpha ignore */
+    }
+    memcpy(s->index, index, sizeof(index));
+    s->px[0] = r; s->px[1] = g; s->px[2] = b; s->px[3] = a;
+  } else {
+    int v = s->px[0], attente = s->attente;
+    for(x = 0; x < w; x++) {
+      if(run > 0) {
+        run--;
+      } else if(attente >= 0) {
+        v = attente;
+        attente = -1;
+      } else {
+        int b1;
+        if(p >= fin) { code = PNM_ERR_TRONQUE; break; }
+        b1 = *p++;
+        if(b1 == QOI_OP_RGB) {
+          if(p >= fin) { code = PNM_ERR_TRONQUE; break; }
+          v = *p++;
+        } else if(b1 == QOI_OP_RGBA) {
+          code = PNM_ERR_FORMAT;
+          break;
+        } else if((b1 & QOI_MASQUE) == QOI_OP_INDEX) {
+          v = s->index[b1][0];
+        } else if((b1 & QOI_MASQUE) == QOI_OP_DIFF) {
+          v = (v + (b1 & 0x3f) - 32) & 255;
+        } else if((b1 & QOI_MASQUE) == QOI_OP_PAIRE) {
+          v = (v + ((b1 >> 3) & 7) - 4) & 255;
+          attente = (v + (b1 & 7) - 4) & 255;
+        } else {
+          run = b1 & 0x3f;
+          o[x] = (byte) v;
+          continue;
+        }
+        /* meme ordre que l'encodeur : pixel courant puis second pixel de la PAIRE */
+        s->index[QOI_HASH(v, v, v, 255)][0] = (byte) v;
+        if(attente >= 0) s->index[QOI_HASH(attente, attente, attente, 255)][0] = (byte) attente;
+      }
+      o[x] = (byte) v;
+    }
+    s->px[0] = (byte) v;
+    s->attente = attente;
+  }
+  s->p = p;
+  s->run = run;
+  if(code != PNM_OK) return code;
+  s->lues++;
+  *row = s->ligne;
+  return PNM_OK;
+}
+/* ------------------------------------- */
+IMAGE_EXPORT(void) CloseQOI(QOIstream *s)
+/* ------------------------------------- */
+{
+  if(s->ligne) free(s->ligne);
+  if(s->map) munmap(s->map, s->taille);
+  memset(s, 0, sizeof(*s));
+}
@@ -339,12 +339,101 @@ IMAGE_EXPORT(void) save_imatrix2(int  **m, long nrl, long nrh, long ncl, long nc
 /* -- PGM and PNM binary format -- */
 /* ------------------------------- */
 
+/* codes d'erreur des lecteurs P5/P6 : aucun n'appelle nrerror, l'appelant decide */
+#define PNM_OK              0
+#define PNM_ERR_FICHIER    -1  /* ouverture ou lecture impossible */
+#define PNM_ERR_FORMAT     -2  /* nombre magique autre que P5/P6 */
+#define PNM_ERR_DIMENSIONS -3  /* largeur/hauteur <= 0 ou trop grandes */
+#define PNM_ERR_MAXVAL     -4  /* maxval hors 1..255 (16 bits non gere) */
+#define PNM_ERR_TRONQUE    -5  /* entete incomplet ou pixels manquants */
+#define PNM_ERR_MEMOIRE    -6
+
+#define PNM_ENTETE_BLOC  4096  /* premier fread de l'entete */
+#define PNM_ENTETE_MAX  65536  /* entete + commentaires au dela => PNM_ERR_TRONQUE */
+
+/* entete decode depuis un tampon : offset = position du premier pixel */
+typedef struct {
+  int  ncanal;   /* 1 (P5) ou 3 (P6) */
+  long width, height, maxval;
+  long offset;
+} PNMheader;
+
+IMAGE_EXPORT(int)     ParsePNMheader(const byte *buf, size_t n, PNMheader *h);
+IMAGE_EXPORT(int)     ReadPNMheader (FILE *file, int *ncanal, long *width, long *height, long *maxval);
+IMAGE_EXPORT(char *)  PNMerror      (int code);
+
+/* vue en lecture seule sur un P5/P6 projete en memoire (mmap), pixels jamais copies          */
+/* row[0..height-1] est empruntee : les lignes pointent dans la projection (rgb8* si ncanal=3) */
+/* ecrire dans les lignes provoque une erreur de segmentation                                 */
+typedef struct {
+  void   *map;     /* projection complete, entete compris (NULL pour ViewPNM) */
+  size_t  taille;
+  byte   *base;    /* premier pixel */
+  long    stride;  /* octets entre deux lignes */
+  long    width, height;
+  int     ncanal;  /* 1 (P5) ou 3 (P6) */
+  byte  **row;
+} PNMview;
+
+IMAGE_EXPORT(int)     MapPNM  (char *filename, PNMview *view);
+IMAGE_EXPORT(int)     ViewPNM (const byte *buf, size_t taille, PNMview *view); /* tampon deja lu, map = NULL */
+IMAGE_EXPORT(void)    UnmapPNM(PNMview *view);
+
+/* lecteur P5/P6 en flux : lots de lignes tires a la demande dans un anneau de taille fixe     */
+/* => empreinte constante quelle que soit la taille de l'image (rgb8* par ligne si ncanal=3)     */
+typedef struct {
+  FILE   *file;
+  long    width, height;
+  int     ncanal;
+  long    stride;    /* octets par ligne */
+  long    lues;      /* lignes deja rendues */
+  long    capacite;  /* lignes dans l'anneau */
+  long    tete;      /* prochaine case de l'anneau */
+  byte   *anneau;
+  byte  **lot;       /* lignes du dernier lot */
+} PNMstream;
+
+IMAGE_EXPORT(int)     OpenPNMstream (char *filename, long capacite, PNMstream *s);
+IMAGE_EXPORT(long)    NextPNMrows   (PNMstream *s, long n, byte ***rows);
+IMAGE_EXPORT(void)    ClosePNMstream(PNMstream *s);
+
 IMAGE_EXPORT(byte **) LoadPGM_bmatrix(char *filename, long *nrl, long *nrh, long *ncl, long *nch);
 IMAGE_EXPORT(void)    SavePGM_bmatrix(byte **m,       long  nrl, long  nrh, long  ncl, long  nch, char *filename);
 
 IMAGE_EXPORT(rgb8 **) LoadPPM_rgb8matrix(char *filename, long *nrl, long *nrh, long *ncl, long *nch);
 IMAGE_EXPORT(void)    SavePPM_rgb8matrix(rgb8 **m,       long  nrl, long  nrh, long  ncl, long  nch, char *filename);
 
+/* codec sans perte de la famille QOI (qoiformat.org) pour le cache d'images normalisees :       */
+/* rgb => flux QOI standard (canaux = 3), gris => variante canaux = 1 (DIFF sur 6 bits, PAIRE de   */
+/* deux ecarts de 3 bits a la place de LUMA) ; les fichiers QOI RGBA se lisent aussi, alpha ignore */
+/* decodage ligne a ligne : seul l'etat du codec (pixel precedent, cache de 64 couleurs) est garde */
+#define QOI_ENTETE 14
+#define QOI_FIN     8  /* 7 x 00 puis 01 */
+
+typedef struct {
+  void       *map;     /* projection (MapQOI), NULL pour ViewQOI */
+  size_t      taille;
+  const byte *p, *fin; /* prochaine op */
+  long        width, height;
+  int         canaux;  /* canaux de l'entete : 1, 3 ou 4 */
+  int         ncanal;  /* lignes rendues : 1 (gris) ou 3 (rgb8) */
+  long        lues;
+  long        run;     /* repetitions restantes du pixel courant */
+  int         attente; /* gris : second pixel d'une PAIRE pas encore rendu, -1 sinon */
+  byte        px[4];
+  byte        index[64][4];
+  byte       *ligne;
+} QOIstream;
+
+IMAGE_EXPORT(int)     ViewQOI   (const byte *buf, size_t taille, QOIstream *s);
+IMAGE_EXPORT(int)     MapQOI    (char *filename, QOIstream *s);
+IMAGE_EXPORT(int)     NextQOIrow(QOIstream *s, byte **row);
+IMAGE_EXPORT(void)    CloseQOI  (QOIstream *s);
+
+/* retournent PNM_OK, PNM_ERR_FICHIER ou PNM_ERR_MEMOIRE (pas de nrerror) */
+IMAGE_EXPORT(int)     SaveQOI_bmatrix   (byte **m, long nrl, long nrh, long ncl, long nch, char *filename);
+IMAGE_EXPORT(int)     SaveQOI_rgb8matrix(rgb8 **m, long nrl, long nrh, long ncl, long nch, char *filename);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "pack.h"
+#include "nrc/nrio.h"
+
+static inline uint32_t lire_le32(const byte *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t lire_le64(const byte *p) {
+    return (uint64_t)lire_le32(p) | ((uint64_t)lire_le32(p + 4) << 32);
+}
+
+static void ecrire_le32(byte *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (byte)(v >> (8 * i));
+}
+
+static void ecrire_le64(byte *p, uint64_t v) {
+    ecrire_le32(p, (uint32_t)v);
+    ecrire_le32(p + 4, (uint32_t)(v >> 32));
+}
+
+static inline uint64_t aligner(uint64_t v, uint64_t a) {
+    return (v + a - 1) / a * a;
+}
+
+int pack_ouvrir(const char *chemin, Pack *pk) {
+    memset(pk, 0, sizeof(*pk));
+    int fd = open(chemin, O_RDONLY);
+    if (fd < 0) return PNM_ERR_FICHIER;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return PNM_ERR_FICHIER;
+    }
+    size_t taille = (size_t)st.st_size;
+    void *map = mmap(NULL, taille, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return PNM_ERR_FICHIER;
+    const byte *m = (const byte*)map;
+
+    int code = PNM_OK;
+    uint32_t nb = 0, taille_noms = 0;
+    uint64_t debut = 0, fin_table = 0;
+    if (taille < PACK_ENTETE) code = PNM_ERR_TRONQUE;
+    else if (memcmp(m, PACK_MAGIE, 8) != 0) code = PNM_ERR_FORMAT;
+    if (code == PNM_OK) {
+        nb = lire_le32(m + 8);
+        taille_noms = lire_le32(m + 12);
+        debut = lire_le64(m + 16);
+        fin_table = PACK_ENTETE + (uint64_t)nb * PACK_ENTREE + taille_noms;
+        if (fin_table > taille || debut > taille) code = PNM_ERR_TRONQUE;
+        else if (debut < fin_table) code = PNM_ERR_FORMAT;
+        else if (nb > 0 && (taille_noms == 0 || m[fin_table - 1] != '\0')) code = PNM_ERR_FORMAT;
+    }
+    const byte *table = m + PACK_ENTETE;
+    for (uint32_t i = 0; code == PNM_OK && i < nb; i++) {
+        const byte *e = table + (size_t)i * PACK_ENTREE;
+        uint64_t off = lire_le64(e), n = lire_le64(e + 8);
+        if (off < debut || off > taille || n > taille - off) code = PNM_ERR_TRONQUE;
+        else if (lire_le32(e + 16) >= taille_noms) code = PNM_ERR_FORMAT;
+    }
+    if (code != PNM_OK) {
+        munmap(map, taille);
+        return code;
+    }
+    pk->map = (byte*)map;
+    pk->taille = taille;
+    pk->nb_images = (long)nb;
+    pk->table = table;
+    pk->noms = (const char*)(table + (size_t)nb * PACK_ENTREE);
+    //images lues dans l'ordre de la table => lecture anticipée plus agressive du noyau
+    madvise(map, taille, MADV_SEQUENTIAL);
+    return PNM_OK;
+}
+
+void pack_image(const Pack *pk, long i, ImagePack *img) {
+    const byte *e = pk->table + (size_t)i * PACK_ENTREE;
+    img->donnees = pk->map + lire_le64(e);
+    img->taille = (size_t)lire_le64(e + 8);
+    img->nom = pk->noms + lire_le32(e + 16);
+    img->image_type = (int)lire_le32(e + 20);
+}
+
+long pack_chercher(const Pack *pk, const char *nom) {
+    for (long i = 0; i < pk->nb_images; i++) {
+        const byte *e = pk->table + (size_t)i * PACK_ENTREE;
+        if (strcmp(pk->noms + lire_le32(e + 16), nom) == 0) return i;
+    }
+    return -1;
+}
+
+void pack_fermer(Pack *pk) {
+    if (pk->map) munmap(pk->map, pk->taille);
+    memset(pk, 0, sizeof(*pk));
+}
+
+//------------------------------------------------------------------------------------------------
+//écriture : tailles relevées par stat => table écrite d'un coup avant les données
+
+static int copier_fichier(FILE *out, const char *chemin, uint64_t attendu, byte *tampon, size_t cap) {
+    FILE *f = fopen(chemin, "rb");
+    if (!f) return PNM_ERR_FICHIER;
+    uint64_t copies = 0;
+    size_t n;
+    while ((n = fread(tampon, 1, cap, f)) > 0) {
+        copies += n;
+        if (copies > attendu || fwrite(tampon, 1, n, out) != n) break;
+    }
+    fclose(f);
+    return (copies == attendu) ? PNM_OK : PNM_ERR_FICHIER; //fichier modifié pendant l'empaquetage
+}
+
+int pack_ecrire(const char *chemin, const char *const *fichiers, const int *types, long n) {
+    if (n < 0 || n > (long)UINT32_MAX) return PNM_ERR_DIMENSIONS;
+    uint64_t *tailles = (uint64_t*)malloc((size_t)(n ? n : 1) * sizeof(uint64_t));
+    if (!tailles) return PNM_ERR_MEMOIRE;
+    uint64_t taille_noms = 0;
+    for (long i = 0; i < n; i++) {
+        struct stat st;
+        if (stat(fichiers[i], &st) != 0 || !S_ISREG(st.st_mode)) {
+            free(tailles);
+            return PNM_ERR_FICHIER;
+        }
+        tailles[i] = (uint64_t)st.st_size;
+        taille_noms += strlen(fichiers[i]) + 1;
+    }
+    if (taille_noms > UINT32_MAX) {
+        free(tailles);
+        return PNM_ERR_DIMENSIONS;
+    }
+
+    size_t octets_table = PACK_ENTETE + (size_t)n * PACK_ENTREE + (size_t)taille_noms;
+    uint64_t debut = aligner(octets_table, PACK_ALIGNEMENT_DONNEES);
+    byte *entete = (byte*)calloc((size_t)debut, 1);
+    size_t cap = 1 << 20;
+    byte *tampon = (byte*)malloc(cap);
+    if (!entete || !tampon) {
+        free(tailles); free(entete); free(tampon);
+        return PNM_ERR_MEMOIRE;
+    }
+    memcpy(entete, PACK_MAGIE, 8);
+    ecrire_le32(entete + 8, (uint32_t)n);
+    ecrire_le32(entete + 12, (uint32_t)taille_noms);
+    ecrire_le64(entete + 16, debut);
+    char *noms = (char*)entete + PACK_ENTETE + (size_t)n * PACK_ENTREE;
+    uint64_t off = debut;
+    uint32_t nom = 0;
+    for (long i = 0; i < n; i++) {
+        byte *e = entete + PACK_ENTETE + (size_t)i * PACK_ENTREE;
+        ecrire_le64(e, off);
+        ecrire_le64(e + 8, tailles[i]);
+        ecrire_le32(e + 16, nom);
+        ecrire_le32(e + 20, (uint32_t)types[i]);
+        size_t l = strlen(fichiers[i]) + 1;
+        memcpy(noms + nom, fichiers[i], l);
+        nom += (uint32_t)l;
+        off = aligner(off + tailles[i], PACK_ALIGNEMENT_IMAGE);
+    }
+
+    int code = PNM_OK;
+    FILE *out = fopen(chemin, "wb");
+    if (!out) code = PNM_ERR_FICHIER;
+    else if (fwrite(entete, 1, (size_t)debut, out) != (size_t)debut) code = PNM_ERR_FICHIER;
+    static const byte zeros[PACK_ALIGNEMENT_IMAGE];
+    for (long i = 0; code == PNM_OK && i < n; i++) {
+        code = copier_fichier(out, fichiers[i], tailles[i], tampon, cap);
+        size_t bourrage = (size_t)(aligner(tailles[i], PACK_ALIGNEMENT_IMAGE) - tailles[i]);
+        if (code == PNM_OK && bourrage && fwrite(zeros, 1, bourrage, out) != bourrage) code = PNM_ERR_FICHIER;
+    }
+    if (out && fclose(out) != 0) code = PNM_ERR_FICHIER;
+    if (out && code != PNM_OK) remove(chemin); //pas d'archive à moitié écrite
+    free(tailles);
+    free(entete);
+    free(tampon);
+    return code;
+}
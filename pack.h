@@ -0,0 +1,52 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <stddef.h>
+#include "nrc/def.h"
+
+//archive empaquetée : toutes les images (PNM, jpeg, png) concaténées dans un seul fichier avec une table
+//offset / taille / nom / type en tête => un open + un mmap pour toute l'archive au lieu d'un
+//opendir / readdir / fopen / fclose par image, les images sont lues en place dans la projection
+//
+//format (entiers petit-boutistes) :
+//  0   "ISPACK01"
+//  8   uint32 nombre d'images
+//  12  uint32 taille du bloc de noms
+//  16  uint64 début des données (aligné sur PACK_ALIGNEMENT_DONNEES)
+//  24  table : par image uint64 offset, uint64 taille, uint32 offset du nom, uint32 type (IMAGE_TYPE_*)
+//      puis les noms terminés par '\0'
+//  données : chaque image alignée sur PACK_ALIGNEMENT_IMAGE, dans l'ordre de la table
+#define PACK_MAGIE              "ISPACK01"
+#define PACK_ENTETE             24
+#define PACK_ENTREE             24
+#define PACK_ALIGNEMENT_DONNEES 4096
+#define PACK_ALIGNEMENT_IMAGE   64
+
+typedef struct {
+    byte *map;
+    size_t taille;
+    long nb_images;
+    const byte *table;
+    const char *noms;
+} Pack;
+
+typedef struct {
+    const char *nom;      // chemin donné à l'empaquetage
+    int image_type;
+    const byte *donnees;  // dans la projection, valide jusqu'à pack_fermer
+    size_t taille;
+} ImagePack;
+
+//projette l'archive et vérifie toute la table (offsets, noms) => pack_image n'a plus rien à vérifier
+//retourne PNM_OK ou un code PNM_ERR_* (nrio.h)
+int  pack_ouvrir(const char *chemin, Pack *pk);
+void pack_image(const Pack *pk, long i, ImagePack *img);
+//indice de l'image de ce nom, -1 si absente (parcours linéaire)
+long pack_chercher(const Pack *pk, const char *nom);
+void pack_fermer(Pack *pk);
+
+//écrit l'archive : n fichiers, noms = chemins tels que donnés, types IMAGE_TYPE_*
+//retourne PNM_OK, PNM_ERR_FICHIER (lecture / écriture) ou PNM_ERR_MEMOIRE
+int  pack_ecrire(const char *chemin, const char *const *fichiers, const int *types, long n);
+
+#endif
@@ -0,0 +1,45 @@
+#include "image.h"
+#include "pack.h"
+#include "enumeration.h"
+#include <string.h>
+#include <stdlib.h>
+
+//empaqueteur : ./packer archive.pack repertoire [repertoire ...]
+//toutes les images des répertoires, sous-répertoires compris (enumeration.h), dans une seule archive (pack.h),
+//triées par nom => archive identique d'une exécution à l'autre
+
+static int comparer_chemins(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        printf("usage : %s archive.pack repertoire [repertoire ...]\n", argv[0]);
+        return 1;
+    }
+    TableChemins table;
+    int code = enumerer_images((const char *const *)argv + 2, argc - 2, 0, ENUM_SUFFIXE, &table);
+    if (code != PNM_OK) {
+        printf("erreur => : %s\n", PNMerror(code));
+        return 1;
+    }
+    long nb = table.nb;
+    const char **chemins = malloc((nb ? nb : 1) * sizeof(char*));
+    int *types = malloc((nb ? nb : 1) * sizeof(int));
+    if (!chemins || !types) {
+        printf("Erreur allocation mémoire\n");
+        return 1;
+    }
+    for (long i = 0; i < nb; i++) chemins[i] = table_chemin(&table, i);
+    qsort(chemins, nb, sizeof(char*), comparer_chemins);
+    for (long i = 0; i < nb; i++) types[i] = image_type_depuis_nom(chemins[i]);
+
+    code = pack_ecrire(argv[1], (const char *const *)chemins, types, nb);
+    if (code != PNM_OK) printf("Erreur écriture %s (%s)\n", argv[1], PNMerror(code));
+    else printf("%ld images => %s\n", nb, argv[1]);
+
+    free(chemins);
+    table_liberer(&table);
+    free(types);
+    return code != PNM_OK;
+}
@@ -0,0 +1,499 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "png.h"
+#include "nrc/nrio.h"
+
+//------------------------------------------------------------------------------------------------
+//inflate (RFC 1950 / 1951) : les IDAT successifs forment un seul flux zlib, lu à travers les chunks
+
+#define INF_RAPIDE  10             // codes de 10 bits ou moins résolus par une seule lecture de table
+#define INF_FENETRE 32768
+#define INF_MASQUE  (INF_FENETRE - 1)
+
+#define INF_ENTETE  0              // prochain entête de bloc
+#define INF_STOCKE  1
+#define INF_HUFFMAN 2
+
+typedef struct {
+    uint16 rapide[1 << INF_RAPIDE]; // (symbole << 4) | longueur, 0 si code plus long
+    short  nombre[16];              // codes par longueur
+    short  symboles[288];           // triés par longueur puis par valeur
+} TableInflate;
+
+typedef struct {
+    const byte *p, *fin;            // IDAT courant
+    const byte *suite, *fin_fichier;// chunk qui suit l'IDAT courant
+    uint64_t tampon;                // bits de poids faible d'abord
+    int nbits;
+    long zeros;                     // octets inventés après le dernier IDAT => flux tronqué
+    int etat, dernier;
+    long reste;                     // octets restants du bloc stocké
+    int copie, distance;            // recopie en attente (longueur / distance)
+    uint64_t total;                 // octets produits depuis le début du flux
+    TableInflate lit, dist;
+    byte fenetre[INF_FENETRE];
+} Inflate;
+
+static const short longueur_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const byte longueur_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const short distance_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const byte distance_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static inline uint32_t lire_be32(const byte *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+//passe à l'IDAT suivant s'il suit directement, 0 sinon (les IDAT d'un png sont consécutifs)
+static int idat_suivant(Inflate *z) {
+    while (z->fin_fichier - z->suite >= 12) {
+        uint32_t n = lire_be32(z->suite);
+        if (memcmp(z->suite + 4, "IDAT", 4) != 0) return 0;
+        if (n > (uint32_t)(z->fin_fichier - z->suite - 12)) n = (uint32_t)(z->fin_fichier - z->suite - 12);
+        z->p = z->suite + 8;
+        z->fin = z->p + n;
+        z->suite = z->fin + 4;
+        if (n > 0) return 1;
+    }
+    return 0;
+}
+
+//au moins 57 bits dans le tampon, des zéros au-delà de la fin des données
+static void inflate_remplir(Inflate *z) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (z->fin - z->p >= 8) {
+        uint64_t v;
+        memcpy(&v, z->p, 8);
+        z->tampon |= v << z->nbits;
+        z->p += (63 - z->nbits) >> 3;
+        z->nbits |= 56;
+        return;
+    }
+#endif
+    while (z->nbits <= 56) {
+        if (z->p == z->fin && !idat_suivant(z)) {
+            z->zeros++;
+            z->nbits += 8;
+            continue;
+        }
+        z->tampon |= (uint64_t)*z->p++ << z->nbits;
+        z->nbits += 8;
+    }
+}
+
+static inline uint32_t inflate_bits(Inflate *z, int n) {
+    if (z->nbits < n) inflate_remplir(z);
+    uint32_t v = (uint32_t)(z->tampon & ((1u << n) - 1));
+    z->tampon >>= n;
+    z->nbits -= n;
+    return v;
+}
+
+//bits de données réelles consommés au-delà du dernier IDAT
+static inline int inflate_deborde(const Inflate *z) {
+    return z->nbits < 8 * z->zeros;
+}
+
+//codes canoniques : sur-souscrit => -1 ; incomplet accepté (un code absent échoue au décodage)
+static int table_construire(TableInflate *t, const byte *longueurs, int n) {
+    short offs[16];
+    memset(t->nombre, 0, sizeof(t->nombre));
+    memset(t->rapide, 0, sizeof(t->rapide));
+    for (int s = 0; s < n; s++) t->nombre[longueurs[s]]++;
+    t->nombre[0] = 0;
+    int reste = 1;
+    for (int l = 1; l < 16; l++) {
+        reste = (reste << 1) - t->nombre[l];
+        if (reste < 0) return -1;
+    }
+    offs[1] = 0;
+    for (int l = 1; l < 15; l++) offs[l + 1] = (short)(offs[l] + t->nombre[l]);
+    for (int s = 0; s < n; s++) if (longueurs[s]) t->symboles[offs[longueurs[s]]++] = (short)s;
+
+    //table rapide : code canonique inversé (le flux deflate commence par le bit de poids fort du code)
+    int code = 0, k = 0;
+    for (int l = 1; l <= INF_RAPIDE; l++) {
+        for (int i = 0; i < t->nombre[l]; i++, k++, code++) {
+            int inv = 0;
+            for (int b = 0; b < l; b++) inv |= ((code >> b) & 1) << (l - 1 - b);
+            for (int j = inv; j < (1 << INF_RAPIDE); j += 1 << l) t->rapide[j] = (uint16)((t->symboles[k] << 4) | l);
+        }
+        code <<= 1;
+    }
+    return 0;
+}
+
+//codes plus longs que INF_RAPIDE : parcours bit à bit des longueurs (schéma de puff.c)
+static int symbole_lent(Inflate *z, const TableInflate *t) {
+    int code = 0, premier = 0, indice = 0;
+    uint64_t bits = z->tampon;
+    for (int l = 1; l < 16; l++) {
+        code |= (int)(bits & 1);
+        bits >>= 1;
+        int nb = t->nombre[l];
+        if (code - nb < premier) {
+            z->tampon >>= l;
+            z->nbits -= l;
+            return t->symboles[indice + (code - premier)];
+        }
+        indice += nb;
+        premier = (premier + nb) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static inline int inflate_symbole(Inflate *z, const TableInflate *t) {
+    if (z->nbits < 15) inflate_remplir(z);
+    int e = t->rapide[z->tampon & ((1 << INF_RAPIDE) - 1)];
+    if (e) {
+        z->tampon >>= e & 15;
+        z->nbits -= e & 15;
+        return e >> 4;
+    }
+    return symbole_lent(z, t);
+}
+
+static void tables_fixes(Inflate *z) {
+    byte l[288];
+    memset(l, 8, 144);
+    memset(l + 144, 9, 112);
+    memset(l + 256, 7, 24);
+    memset(l + 280, 8, 8);
+    table_construire(&z->lit, l, 288);
+    memset(l, 5, 30);
+    table_construire(&z->dist, l, 30);
+}
+
+static int tables_dynamiques(Inflate *z) {
+    static const byte ordre[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    int nlit = (int)inflate_bits(z, 5) + 257;
+    int ndist = (int)inflate_bits(z, 5) + 1;
+    int ncode = (int)inflate_bits(z, 4) + 4;
+    if (nlit > 286 || ndist > 30) return PNM_ERR_FORMAT;
+    byte l[320];
+    memset(l, 0, 19);
+    for (int i = 0; i < ncode; i++) l[ordre[i]] = (byte)inflate_bits(z, 3);
+    if (table_construire(&z->lit, l, 19) != 0) return PNM_ERR_FORMAT;
+
+    int i = 0;
+    while (i < nlit + ndist) {
+        int s = inflate_symbole(z, &z->lit);
+        if (s < 0) return PNM_ERR_FORMAT;
+        if (s < 16) {
+            l[i++] = (byte)s;
+            continue;
+        }
+        int v = 0, r;
+        if (s == 16) {
+            if (i == 0) return PNM_ERR_FORMAT;
+            v = l[i - 1];
+            r = 3 + (int)inflate_bits(z, 2);
+        } else if (s == 17) {
+            r = 3 + (int)inflate_bits(z, 3);
+        } else {
+            r = 11 + (int)inflate_bits(z, 7);
+        }
+        if (i + r > nlit + ndist) return PNM_ERR_FORMAT;
+        while (r--) l[i++] = (byte)v;
+    }
+    if (l[256] == 0) return PNM_ERR_FORMAT; //pas de fin de bloc
+    if (table_construire(&z->lit, l, nlit) != 0) return PNM_ERR_FORMAT;
+    if (table_construire(&z->dist, l + nlit, ndist) != 0) return PNM_ERR_FORMAT;
+    return PNM_OK;
+}
+
+static int inflate_entete_bloc(Inflate *z) {
+    if (z->dernier) return PNM_ERR_TRONQUE; //flux terminé avant la dernière ligne
+    z->dernier = (int)inflate_bits(z, 1);
+    int type = (int)inflate_bits(z, 2);
+    if (type == 0) {
+        inflate_bits(z, z->nbits & 7); //alignement sur l'octet
+        uint32_t n = inflate_bits(z, 16), nn = inflate_bits(z, 16);
+        if ((n ^ 0xFFFF) != nn) return PNM_ERR_FORMAT;
+        z->reste = n;
+        z->etat = INF_STOCKE;
+        return PNM_OK;
+    }
+    if (type == 1) tables_fixes(z);
+    else if (type == 2) {
+        int code = tables_dynamiques(z);
+        if (code != PNM_OK) return code;
+    } else return PNM_ERR_FORMAT;
+    z->etat = INF_HUFFMAN;
+    return PNM_OK;
+}
+
+//exactement n octets décompressés dans dst ; chaque octet est aussi gardé dans la fenêtre pour les recopies
+static int inflate_lire(Inflate *z, byte *dst, long n) {
+    byte *fen = z->fenetre;
+    long k = 0;
+    while (k < n) {
+        if (z->copie > 0) {
+            long m = n - k;
+            if (m > z->copie) m = z->copie;
+            uint32_t src = (uint32_t)(z->total - (uint64_t)z->distance), pos = (uint32_t)z->total;
+            for (long i = 0; i < m; i++) {
+                byte b = fen[(src + i) & INF_MASQUE];
+                dst[k++] = b;
+                fen[(pos + i) & INF_MASQUE] = b;
+            }
+            z->copie -= (int)m;
+            z->total += (uint64_t)m;
+            continue;
+        }
+        if (z->etat == INF_ENTETE) {
+            int code = inflate_entete_bloc(z);
+            if (code != PNM_OK) return code;
+            if (inflate_deborde(z)) return PNM_ERR_TRONQUE;
+        } else if (z->etat == INF_STOCKE) {
+            if (z->reste == 0) {
+                z->etat = INF_ENTETE;
+                continue;
+            }
+            byte b = (byte)inflate_bits(z, 8); //aligné depuis l'entête du bloc
+            if (inflate_deborde(z)) return PNM_ERR_TRONQUE;
+            dst[k++] = b;
+            fen[(uint32_t)z->total & INF_MASQUE] = b;
+            z->total++;
+            z->reste--;
+        } else {
+            while (k < n) {
+                int s = inflate_symbole(z, &z->lit);
+                if (s < 256) {
+                    if (s < 0) return PNM_ERR_FORMAT;
+                    dst[k++] = (byte)s;
+                    fen[(uint32_t)z->total & INF_MASQUE] = (byte)s;
+                    z->total++;
+                    continue;
+                }
+                if (s == 256) {
+                    z->etat = INF_ENTETE;
+                    break;
+                }
+                s -= 257;
+                if (s >= 29) return PNM_ERR_FORMAT;
+                int longueur = longueur_base[s] + (int)inflate_bits(z, longueur_extra[s]);
+                int d = inflate_symbole(z, &z->dist);
+                if (d < 0 || d >= 30) return PNM_ERR_FORMAT;
+                int distance = distance_base[d] + (int)inflate_bits(z, distance_extra[d]);
+                if ((uint64_t)distance > z->total) return PNM_ERR_FORMAT;
+                z->copie = longueur;
+                z->distance = distance;
+                break;
+            }
+            if (inflate_deborde(z)) return PNM_ERR_TRONQUE;
+        }
+    }
+    return PNM_OK;
+}
+
+//------------------------------------------------------------------------------------------------
+//png
+
+struct DecodeurPNG {
+    Inflate z;
+    int type_couleur, profondeur;
+    int bpp;                 // octets par pixel pour les filtres (1 minimum)
+    long octets_ligne;       // ligne filtrée sans l'octet de type de filtre
+    byte *prec, *cour;       // lignes défiltrées précédente / courante
+    byte *sortie;            // ligne convertie en gris ou rgb8
+    rgb8 palette[256];
+    int nb_palette;
+};
+
+int png_signature(const byte *donnees, size_t taille) {
+    static const byte sig[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+    return taille >= 8 && memcmp(donnees, sig, 8) == 0;
+}
+
+static int lire_ihdr(struct DecodeurPNG *d, const byte *s, uint32_t n, PNGflux *flux) {
+    if (n != 13) return PNM_ERR_FORMAT;
+    uint32_t w = lire_be32(s), h = lire_be32(s + 4);
+    int prof = s[8], type = s[9];
+    if (w == 0 || h == 0 || w > 0x7FFFFFFF || h > 0x7FFFFFFF) return PNM_ERR_DIMENSIONS;
+    if (s[10] != 0 || s[11] != 0) return PNM_ERR_FORMAT;  //compression / filtres inconnus
+    if (s[12] != 0) return PNM_ERR_FORMAT;                //Adam7
+    int canaux;
+    switch (type) {
+    case 0: canaux = 1; if (prof != 1 && prof != 2 && prof != 4 && prof != 8) return PNM_ERR_FORMAT; break;
+    case 3: canaux = 1; if (prof != 1 && prof != 2 && prof != 4 && prof != 8) return PNM_ERR_FORMAT; break;
+    case 2: canaux = 3; if (prof != 8) return PNM_ERR_FORMAT; break;
+    case 4: canaux = 2; if (prof != 8) return PNM_ERR_FORMAT; break;
+    case 6: canaux = 4; if (prof != 8) return PNM_ERR_FORMAT; break;
+    default: return PNM_ERR_FORMAT;
+    }
+    d->type_couleur = type;
+    d->profondeur = prof;
+    d->bpp = (canaux * prof + 7) / 8;
+    d->octets_ligne = ((long)w * canaux * prof + 7) / 8;
+    flux->width = (long)w;
+    flux->height = (long)h;
+    flux->ncanal = (type == 0 || type == 4) ? 1 : 3;
+    return PNM_OK;
+}
+
+int png_ouvrir(const byte *donnees, size_t taille, PNGflux *flux) {
+    memset(flux, 0, sizeof(*flux));
+    if (!png_signature(donnees, taille)) return PNM_ERR_FORMAT;
+    struct DecodeurPNG *d = (struct DecodeurPNG*)calloc(1, sizeof(struct DecodeurPNG));
+    if (!d) return PNM_ERR_MEMOIRE;
+
+    const byte *p = donnees + 8, *fin = donnees + taille;
+    int code = PNM_OK, ihdr = 0, idat = 0;
+    while (code == PNM_OK && !idat) {
+        if (fin - p < 12) { code = PNM_ERR_TRONQUE; break; }
+        uint32_t n = lire_be32(p);
+        const byte *type = p + 4, *s = p + 8;
+        if (n > (uint32_t)(fin - s)) { code = PNM_ERR_TRONQUE; break; }
+        if (!ihdr && memcmp(type, "IHDR", 4) != 0) { code = PNM_ERR_FORMAT; break; }
+        if (memcmp(type, "IHDR", 4) == 0) {
+            code = ihdr ? PNM_ERR_FORMAT : lire_ihdr(d, s, n, flux);
+            ihdr = 1;
+        } else if (memcmp(type, "PLTE", 4) == 0) {
+            if (n % 3 != 0 || n > 768) code = PNM_ERR_FORMAT;
+            else {
+                d->nb_palette = (int)(n / 3);
+                memcpy(d->palette, s, n);
+            }
+        } else if (memcmp(type, "IDAT", 4) == 0) {
+            idat = 1;
+            d->z.suite = p;
+            d->z.fin_fichier = fin;
+        } else if (memcmp(type, "IEND", 4) == 0) {
+            code = PNM_ERR_TRONQUE;
+        } else if (!(type[0] & 0x20)) {
+            code = PNM_ERR_FORMAT; //chunk critique inconnu
+        }
+        if ((size_t)(fin - s) < (size_t)n + 4) p = fin; //CRC manquant : le prochain chunk sera tronqué
+        else p = s + n + 4;
+    }
+    if (code == PNM_OK && d->type_couleur == 3 && d->nb_palette == 0) code = PNM_ERR_FORMAT;
+    //deflate ne dépasse pas ~1032:1 => entête incohérente avec la taille du fichier
+    if (code == PNM_OK && (double)flux->height * (d->octets_ligne + 1) > 1100.0 * (double)taille + 65536.0)
+        code = PNM_ERR_TRONQUE;
+    if (code == PNM_OK) {
+        d->prec = (byte*)calloc((size_t)d->octets_ligne, 1);
+        d->cour = (byte*)malloc((size_t)d->octets_ligne);
+        d->sortie = (byte*)malloc((size_t)flux->width * flux->ncanal);
+        if (!d->prec || !d->cour || !d->sortie) code = PNM_ERR_MEMOIRE;
+    }
+    if (code == PNM_OK) {
+        //entête zlib : deflate, fenêtre <= 32 Ko, pas de dictionnaire
+        Inflate *z = &d->z;
+        if (!idat_suivant(z)) code = PNM_ERR_TRONQUE;
+        else {
+            uint32_t cmf = inflate_bits(z, 8), flg = inflate_bits(z, 8);
+            if ((cmf & 15) != 8 || (cmf >> 4) > 7 || (cmf * 256 + flg) % 31 != 0 || (flg & 0x20)) code = PNM_ERR_FORMAT;
+            else if (inflate_deborde(z)) code = PNM_ERR_TRONQUE;
+        }
+    }
+    flux->dec = d;
+    if (code != PNM_OK) png_fermer(flux);
+    return code;
+}
+
+static inline byte paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return (byte)a;
+    if (pb <= pc) return (byte)b;
+    return (byte)c;
+}
+
+static int defiltrer(byte *c, const byte *p, long n, int bpp, int filtre) {
+    long i;
+    switch (filtre) {
+    case 0: break;
+    case 1: for (i = bpp; i < n; i++) c[i] = (byte)(c[i] + c[i - bpp]); break;
+    case 2: for (i = 0; i < n; i++) c[i] = (byte)(c[i] + p[i]); break;
+    case 3:
+        for (i = 0; i < bpp; i++) c[i] = (byte)(c[i] + (p[i] >> 1));
+        for (; i < n; i++) c[i] = (byte)(c[i] + ((c[i - bpp] + p[i]) >> 1));
+        break;
+    case 4:
+        for (i = 0; i < bpp; i++) c[i] = (byte)(c[i] + p[i]);
+        for (; i < n; i++) c[i] = (byte)(c[i] + paeth(c[i - bpp], p[i], p[i - bpp]));
+        break;
+    default: return PNM_ERR_FORMAT;
+    }
+    return PNM_OK;
+}
+
+int png_ligne_suivante(PNGflux *flux, const byte **ligne) {
+    struct DecodeurPNG *d = flux->dec;
+    if (!d || flux->ligne >= flux->height) return PNM_ERR_TRONQUE;
+    byte filtre;
+    int code = inflate_lire(&d->z, &filtre, 1);
+    if (code == PNM_OK) code = inflate_lire(&d->z, d->cour, d->octets_ligne);
+    if (code == PNM_OK) code = defiltrer(d->cour, d->prec, d->octets_ligne, d->bpp, filtre);
+    if (code != PNM_OK) return code;
+
+    const byte *c = d->cour;
+    byte *o = d->sortie;
+    long w = flux->width;
+    int prof = d->profondeur;
+    switch (d->type_couleur) {
+    case 0:
+        if (prof == 8) {
+            o = d->cour; //déjà au bon format
+        } else {
+            int par = 8 / prof, masque = (1 << prof) - 1, gain = 255 / masque;
+            for (long x = 0; x < w; x++) {
+                int v = (c[x / par] >> (8 - prof * (int)(x % par + 1))) & masque;
+                o[x] = (byte)(v * gain);
+            }
+        }
+        break;
+    case 2:
+        o = d->cour;
+        break;
+    case 3: {
+        int par = 8 / prof, masque = (1 << prof) - 1;
+        rgb8 *r = (rgb8*)o;
+        for (long x = 0; x < w; x++) {
+            int v = (prof == 8) ? c[x] : (c[x / par] >> (8 - prof * (int)(x % par + 1))) & masque;
+            r[x] = d->palette[v]; //indice hors palette => noir
+        }
+        break;
+    }
+    case 4:
+        for (long x = 0; x < w; x++) o[x] = c[2 * x];
+        break;
+    case 6:
+        for (long x = 0; x < w; x++) {
+            o[3 * x]     = c[4 * x];
+            o[3 * x + 1] = c[4 * x + 1];
+            o[3 * x + 2] = c[4 * x + 2];
+        }
+        break;
+    }
+    //la ligne défiltrée devient la référence de la suivante
+    byte *t = d->prec;
+    d->prec = d->cour;
+    d->cour = t;
+    flux->ligne++;
+    *ligne = o;
+    return PNM_OK;
+}
+
+void png_fermer(PNGflux *flux) {
+    struct DecodeurPNG *d = flux->dec;
+    if (d) {
+        free(d->prec);
+        free(d->cour);
+        free(d->sortie);
+        free(d);
+    }
+    flux->dec = NULL;
+}
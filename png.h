@@ -0,0 +1,28 @@
+#ifndef PNG_H
+#define PNG_H
+
+#include <stddef.h>
+#include "nrc/def.h"
+
+//lecteur png autonome (inflate et défiltrage dans png.c, ni zlib ni libpng), ligne par ligne :
+//seules deux lignes filtrées et une fenêtre de 32 Ko sont gardées => les lignes vont directement dans l'extracteur
+//  gris 1/2/4/8 bits, gris + alpha, RGB, RGBA 8 bits, palette 1/2/4/8 bits
+//  alpha et tRNS ignorés (couleurs telles quelles), 16 bits et entrelacement Adam7 => PNM_ERR_FORMAT
+//  CRC des chunks et adler32 du flux zlib non vérifiés (un flux abîmé est presque toujours rejeté par l'inflate)
+//codes d'erreur de nrio.h
+typedef struct {
+    long width, height;
+    int  ncanal;               // 1 (gris, gris + alpha) ou 3 (rgb8 packé : RGB, RGBA, palette)
+    long ligne;                // prochaine ligne rendue par png_ligne_suivante
+    struct DecodeurPNG *dec;
+} PNGflux;
+
+//1 si le tampon commence par la signature png (89 'PNG' 0D 0A 1A 0A)
+int png_signature(const byte *donnees, size_t taille);
+//lit les chunks jusqu'au premier IDAT et prépare l'inflate, `donnees` doit rester valide jusqu'à png_fermer
+int png_ouvrir(const byte *donnees, size_t taille, PNGflux *flux);
+//ligne suivante (width * ncanal octets), valide jusqu'au prochain appel ; PNM_ERR_TRONQUE si flux incomplet
+int png_ligne_suivante(PNGflux *flux, const byte **ligne);
+void png_fermer(PNGflux *flux);
+
+#endif
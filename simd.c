@@ -0,0 +1,563 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+static int niveau_cpu = SIMD_SCALAIRE;   // ce que le processeur supporte
+static int niveau_actif = SIMD_SCALAIRE; // ce qui est réellement utilisé
+
+//bords à 0 comme dans sobel_ix_iy
+static inline void sobel_bords(int16 *gx, int16 *gy, long width) {
+    gx[0] = gy[0] = 0;
+    gx[width - 1] = gy[width - 1] = 0;
+}
+
+//reste de la ligne en scalaire (queue des versions vectorielles)
+static inline void sobel_ligne_partielle(const byte *h, const byte *m, const byte *b,
+                                         int16 *gx, int16 *gy, long j0, long width) {
+    for (long j = j0; j <= width - 2; j++) {
+        gx[j] = (int16)(-h[j-1] + h[j+1] - 2 * m[j-1] + 2 * m[j+1] - b[j-1] + b[j+1]);
+        gy[j] = (int16)(-h[j-1] - 2 * h[j] - h[j+1] + b[j-1] + 2 * b[j] + b[j+1]);
+    }
+}
+
+void sobel_ligne_scalaire(const byte *h, const byte *m, const byte *b, int16 *gx, int16 *gy, long width) {
+    if (width < 1) return;
+    if (width >= 3) sobel_ligne_partielle(h, m, b, gx, gy, 1, width);
+    sobel_bords(gx, gy, width);
+}
+
+long contours_ligne_scalaire(const int16 *gx, const int16 *gy, long width, int32 seuil_carre) {
+    long n = 0;
+    for (long j = 1; j <= width - 2; j++) {
+        int32 s = (int32)gx[j] * gx[j] + (int32)gy[j] * gy[j];
+        n += (s >= seuil_carre) ? 1 : 0;
+    }
+    return n;
+}
+
+//norme en Q8 : sqrt simple précision de l'entier exact gx²+gy² (< 2^24 donc exact en float)
+//arrondi au plus proche pair comme cvtps_epi32 => toutes les versions donnent la même somme
+static inline uint32 norme_q8(int32 s) {
+    return (uint32)lrintf(sqrtf((float)s) * 256.0f);
+}
+
+uint64_t magnitude_ligne_q8_scalaire(const int16 *gx, const int16 *gy, long width) {
+    uint64_t somme = 0;
+    for (long j = 1; j <= width - 2; j++) {
+        somme += norme_q8((int32)gx[j] * gx[j] + (int32)gy[j] * gy[j]);
+    }
+    return somme;
+}
+
+//norme normalisée en simple précision : sqrt et division IEEE (arrondi correct) => identique en vectoriel
+void norme_ligne_f32_scalaire(const int16 *gx, const int16 *gy, float *mn, long width) {
+    for (long j = 1; j <= width - 2; j++) {
+        mn[j] = sqrtf((float)((int32)gx[j] * gx[j] + (int32)gy[j] * gy[j])) / NORME_F32_MAX;
+    }
+    if (width >= 1) mn[0] = mn[width - 1] = 0.0f;
+}
+
+static inline uint16 norme_q16(int32 s) {
+    return (uint16)lrintf(sqrtf((float)s) * NORME_Q16_ECHELLE);
+}
+
+void norme_ligne_q16_scalaire(const int16 *gx, const int16 *gy, uint16 *mn, long width) {
+    for (long j = 1; j <= width - 2; j++) {
+        mn[j] = norme_q16((int32)gx[j] * gx[j] + (int32)gy[j] * gy[j]);
+    }
+    if (width >= 1) mn[0] = mn[width - 1] = 0;
+}
+
+void rgb_vers_gris_ligne_scalaire(const rgb8 *src, byte *gris, long width, uint64_t sommes[3]) {
+    uint64_t rs = 0, gs = 0, bs = 0;
+    for (long j = 0; j < width; j++) {
+        uint32 r = src[j].r, g = src[j].g, b = src[j].b;
+        rs += r; gs += g; bs += b;
+        gris[j] = (byte)((19595 * r + 38470 * g + 7471 * b) >> 16);
+    }
+    sommes[0] += rs; sommes[1] += gs; sommes[2] += bs;
+}
+
+void boite_ligne_scalaire(const uint16 *prefixe, byte *out, long j0, long j1, int rayon, uint16 mult, int decalage) {
+    for (long j = j0; j <= j1; j++) {
+        uint16 somme = (uint16)(prefixe[j + rayon + 1] - prefixe[j - rayon]);
+        out[j] = (byte)(((uint32)somme * mult >> 16) >> decalage);
+    }
+}
+
+#ifdef SIMD_X86
+
+//gx = (droite - gauche) haut + 2*(droite - gauche) milieu + (droite - gauche) bas
+//gy = (gauche + 2*centre + droite) bas - (gauche + 2*centre + droite) haut
+//16 pixels par itération : 16 octets chargés, dépliés en 2x8 lanes int16
+__attribute__((target("sse2")))
+static void sobel_ligne_sse2(const byte *h, const byte *m, const byte *b, int16 *gx, int16 *gy, long width) {
+    if (width < 1) return;
+    const __m128i zero = _mm_setzero_si128();
+    long j = 1;
+    for (; j + 16 <= width - 1; j += 16) {
+        __m128i hg = _mm_loadu_si128((const __m128i*)(h + j - 1));
+        __m128i hc = _mm_loadu_si128((const __m128i*)(h + j));
+        __m128i hd = _mm_loadu_si128((const __m128i*)(h + j + 1));
+        __m128i mg = _mm_loadu_si128((const __m128i*)(m + j - 1));
+        __m128i md = _mm_loadu_si128((const __m128i*)(m + j + 1));
+        __m128i bg = _mm_loadu_si128((const __m128i*)(b + j - 1));
+        __m128i bc = _mm_loadu_si128((const __m128i*)(b + j));
+        __m128i bd = _mm_loadu_si128((const __m128i*)(b + j + 1));
+        for (int moitie = 0; moitie < 2; moitie++) {
+            __m128i a0, a1, a2, a3, a4, a5, a6, a7;
+            if (moitie == 0) {
+                a0 = _mm_unpacklo_epi8(hg, zero); a1 = _mm_unpacklo_epi8(hc, zero);
+                a2 = _mm_unpacklo_epi8(hd, zero); a3 = _mm_unpacklo_epi8(mg, zero);
+                a4 = _mm_unpacklo_epi8(md, zero); a5 = _mm_unpacklo_epi8(bg, zero);
+                a6 = _mm_unpacklo_epi8(bc, zero); a7 = _mm_unpacklo_epi8(bd, zero);
+            } else {
+                a0 = _mm_unpackhi_epi8(hg, zero); a1 = _mm_unpackhi_epi8(hc, zero);
+                a2 = _mm_unpackhi_epi8(hd, zero); a3 = _mm_unpackhi_epi8(mg, zero);
+                a4 = _mm_unpackhi_epi8(md, zero); a5 = _mm_unpackhi_epi8(bg, zero);
+                a6 = _mm_unpackhi_epi8(bc, zero); a7 = _mm_unpackhi_epi8(bd, zero);
+            }
+            __m128i dm = _mm_sub_epi16(a4, a3);
+            __m128i vx = _mm_add_epi16(_mm_add_epi16(_mm_sub_epi16(a2, a0), _mm_sub_epi16(a7, a5)),
+                                       _mm_add_epi16(dm, dm));
+            __m128i sh = _mm_add_epi16(_mm_add_epi16(a0, a2), _mm_add_epi16(a1, a1));
+            __m128i sb = _mm_add_epi16(_mm_add_epi16(a5, a7), _mm_add_epi16(a6, a6));
+            __m128i vy = _mm_sub_epi16(sb, sh);
+            _mm_storeu_si128((__m128i*)(gx + j + 8 * moitie), vx);
+            _mm_storeu_si128((__m128i*)(gy + j + 8 * moitie), vy);
+        }
+    }
+    sobel_ligne_partielle(h, m, b, gx, gy, j, width);
+    sobel_bords(gx, gy, width);
+}
+
+//16 pixels par itération : 16 octets élargis en 16 lanes int16 (cvtepu8 évite le croisement de lanes)
+__attribute__((target("avx2")))
+static void sobel_ligne_avx2(const byte *h, const byte *m, const byte *b, int16 *gx, int16 *gy, long width) {
+    if (width < 1) return;
+    long j = 1;
+    for (; j + 16 <= width - 1; j += 16) {
+        __m256i a0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(h + j - 1)));
+        __m256i a1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(h + j)));
+        __m256i a2 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(h + j + 1)));
+        __m256i a3 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(m + j - 1)));
+        __m256i a4 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(m + j + 1)));
+        __m256i a5 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(b + j - 1)));
+        __m256i a6 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(b + j)));
+        __m256i a7 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(b + j + 1)));
+        __m256i dm = _mm256_sub_epi16(a4, a3);
+        __m256i vx = _mm256_add_epi16(_mm256_add_epi16(_mm256_sub_epi16(a2, a0), _mm256_sub_epi16(a7, a5)),
+                                      _mm256_add_epi16(dm, dm));
+        __m256i sh = _mm256_add_epi16(_mm256_add_epi16(a0, a2), _mm256_add_epi16(a1, a1));
+        __m256i sb = _mm256_add_epi16(_mm256_add_epi16(a5, a7), _mm256_add_epi16(a6, a6));
+        _mm256_storeu_si256((__m256i*)(gx + j), vx);
+        _mm256_storeu_si256((__m256i*)(gy + j), _mm256_sub_epi16(sb, sh));
+    }
+    sobel_ligne_partielle(h, m, b, gx, gy, j, width);
+    sobel_bords(gx, gy, width);
+}
+
+//32 pixels par itération dans un seul registre zmm de int16 (nécessite AVX-512BW)
+__attribute__((target("avx512f,avx512bw")))
+static void sobel_ligne_avx512(const byte *h, const byte *m, const byte *b, int16 *gx, int16 *gy, long width) {
+    if (width < 1) return;
+    long j = 1;
+    for (; j + 32 <= width - 1; j += 32) {
+        __m512i a0 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(h + j - 1)));
+        __m512i a1 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(h + j)));
+        __m512i a2 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(h + j + 1)));
+        __m512i a3 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(m + j - 1)));
+        __m512i a4 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(m + j + 1)));
+        __m512i a5 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(b + j - 1)));
+        __m512i a6 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(b + j)));
+        __m512i a7 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(b + j + 1)));
+        __m512i dm = _mm512_sub_epi16(a4, a3);
+        __m512i vx = _mm512_add_epi16(_mm512_add_epi16(_mm512_sub_epi16(a2, a0), _mm512_sub_epi16(a7, a5)),
+                                      _mm512_add_epi16(dm, dm));
+        __m512i sh = _mm512_add_epi16(_mm512_add_epi16(a0, a2), _mm512_add_epi16(a1, a1));
+        __m512i sb = _mm512_add_epi16(_mm512_add_epi16(a5, a7), _mm512_add_epi16(a6, a6));
+        _mm512_storeu_si512((void*)(gx + j), vx);
+        _mm512_storeu_si512((void*)(gy + j), _mm512_sub_epi16(sb, sh));
+    }
+    sobel_ligne_partielle(h, m, b, gx, gy, j, width);
+    sobel_bords(gx, gy, width);
+}
+
+//gx²+gy² par madd sur (gx,gy) entrelacés, comparaison en int32 et comptage par lanes
+__attribute__((target("sse2")))
+static long contours_ligne_sse2(const int16 *gx, const int16 *gy, long width, int32 seuil_carre) {
+    const __m128i seuil = _mm_set1_epi32(seuil_carre - 1);
+    __m128i acc = _mm_setzero_si128();
+    long j = 1;
+    for (; j + 8 <= width - 1; j += 8) {
+        __m128i vx = _mm_loadu_si128((const __m128i*)(gx + j));
+        __m128i vy = _mm_loadu_si128((const __m128i*)(gy + j));
+        __m128i lo = _mm_unpacklo_epi16(vx, vy);
+        __m128i hi = _mm_unpackhi_epi16(vx, vy);
+        acc = _mm_sub_epi32(acc, _mm_cmpgt_epi32(_mm_madd_epi16(lo, lo), seuil));
+        acc = _mm_sub_epi32(acc, _mm_cmpgt_epi32(_mm_madd_epi16(hi, hi), seuil));
+    }
+    int32 t[4];
+    _mm_storeu_si128((__m128i*)t, acc);
+    long n = (long)t[0] + t[1] + t[2] + t[3];
+    for (; j <= width - 2; j++) {
+        int32 s = (int32)gx[j] * gx[j] + (int32)gy[j] * gy[j];
+        n += (s >= seuil_carre) ? 1 : 0;
+    }
+    return n;
+}
+
+__attribute__((target("avx2")))
+static long contours_ligne_avx2(const int16 *gx, const int16 *gy, long width, int32 seuil_carre) {
+    const __m256i seuil = _mm256_set1_epi32(seuil_carre - 1);
+    __m256i acc = _mm256_setzero_si256();
+    long j = 1;
+    for (; j + 16 <= width - 1; j += 16) {
+        __m256i vx = _mm256_loadu_si256((const __m256i*)(gx + j));
+        __m256i vy = _mm256_loadu_si256((const __m256i*)(gy + j));
+        __m256i lo = _mm256_unpacklo_epi16(vx, vy);
+        __m256i hi = _mm256_unpackhi_epi16(vx, vy);
+        acc = _mm256_sub_epi32(acc, _mm256_cmpgt_epi32(_mm256_madd_epi16(lo, lo), seuil));
+        acc = _mm256_sub_epi32(acc, _mm256_cmpgt_epi32(_mm256_madd_epi16(hi, hi), seuil));
+    }
+    int32 t[8];
+    _mm256_storeu_si256((__m256i*)t, acc);
+    long n = 0;
+    for (int k = 0; k < 8; k++) n += t[k];
+    for (; j <= width - 2; j++) {
+        int32 s = (int32)gx[j] * gx[j] + (int32)gy[j] * gy[j];
+        n += (s >= seuil_carre) ? 1 : 0;
+    }
+    return n;
+}
+
+//norme Q8 sur 8 lanes : au plus 2*369152 par itération et par lane => vidage en 64 bits toutes les 2048 itérations
+__attribute__((target("sse2")))
+static uint64_t magnitude_ligne_q8_sse2(const int16 *gx, const int16 *gy, long width) {
+    const __m128 q8 = _mm_set1_ps(256.0f);
+    uint64_t somme = 0;
+    long j = 1;
+    while (j + 8 <= width - 1) {
+        __m128i acc = _mm_setzero_si128();
+        for (int n = 0; n < 2048 && j + 8 <= width - 1; n++, j += 8) {
+            __m128i vx = _mm_loadu_si128((const __m128i*)(gx + j));
+            __m128i vy = _mm_loadu_si128((const __m128i*)(gy + j));
+            __m128i lo = _mm_unpacklo_epi16(vx, vy);
+            __m128i hi = _mm_unpackhi_epi16(vx, vy);
+            lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(lo, lo))), q8));
+            hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(hi, hi))), q8));
+            acc = _mm_add_epi32(acc, _mm_add_epi32(lo, hi));
+        }
+        uint32 t[4];
+        _mm_storeu_si128((__m128i*)t, acc);
+        somme += (uint64_t)t[0] + t[1] + t[2] + t[3];
+    }
+    for (; j <= width - 2; j++) {
+        somme += norme_q8((int32)gx[j] * gx[j] + (int32)gy[j] * gy[j]);
+    }
+    return somme;
+}
+
+__attribute__((target("avx2")))
+static uint64_t magnitude_ligne_q8_avx2(const int16 *gx, const int16 *gy, long width) {
+    const __m256 q8 = _mm256_set1_ps(256.0f);
+    uint64_t somme = 0;
+    long j = 1;
+    while (j + 16 <= width - 1) {
+        __m256i acc = _mm256_setzero_si256();
+        for (int n = 0; n < 2048 && j + 16 <= width - 1; n++, j += 16) {
+            __m256i vx = _mm256_loadu_si256((const __m256i*)(gx + j));
+            __m256i vy = _mm256_loadu_si256((const __m256i*)(gy + j));
+            __m256i lo = _mm256_unpacklo_epi16(vx, vy);
+            __m256i hi = _mm256_unpackhi_epi16(vx, vy);
+            lo = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_sqrt_ps(_mm256_cvtepi32_ps(_mm256_madd_epi16(lo, lo))), q8));
+            hi = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_sqrt_ps(_mm256_cvtepi32_ps(_mm256_madd_epi16(hi, hi))), q8));
+            acc = _mm256_add_epi32(acc, _mm256_add_epi32(lo, hi));
+        }
+        uint32 t[8];
+        _mm256_storeu_si256((__m256i*)t, acc);
+        for (int k = 0; k < 8; k++) somme += t[k];
+    }
+    for (; j <= width - 2; j++) {
+        somme += norme_q8((int32)gx[j] * gx[j] + (int32)gy[j] * gy[j]);
+    }
+    return somme;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static uint64_t magnitude_ligne_q8_avx512(const int16 *gx, const int16 *gy, long width) {
+    const __m512 q8 = _mm512_set1_ps(256.0f);
+    uint64_t somme = 0;
+    long j = 1;
+    while (j + 32 <= width - 1) {
+        __m512i acc = _mm512_setzero_si512();
+        for (int n = 0; n < 2048 && j + 32 <= width - 1; n++, j += 32) {
+            __m512i vx = _mm512_loadu_si512((const void*)(gx + j));
+            __m512i vy = _mm512_loadu_si512((const void*)(gy + j));
+            __m512i lo = _mm512_unpacklo_epi16(vx, vy);
+            __m512i hi = _mm512_unpackhi_epi16(vx, vy);
+            lo = _mm512_cvtps_epi32(_mm512_mul_ps(_mm512_sqrt_ps(_mm512_cvtepi32_ps(_mm512_madd_epi16(lo, lo))), q8));
+            hi = _mm512_cvtps_epi32(_mm512_mul_ps(_mm512_sqrt_ps(_mm512_cvtepi32_ps(_mm512_madd_epi16(hi, hi))), q8));
+            acc = _mm512_add_epi32(acc, _mm512_add_epi32(lo, hi));
+        }
+        uint32 t[16];
+        _mm512_storeu_si512((void*)t, acc);
+        for (int k = 0; k < 16; k++) somme += t[k];
+    }
+    for (; j <= width - 2; j++) {
+        somme += norme_q8((int32)gx[j] * gx[j] + (int32)gy[j] * gy[j]);
+    }
+    return somme;
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+static long contours_ligne_avx512(const int16 *gx, const int16 *gy, long width, int32 seuil_carre) {
+    const __m512i seuil = _mm512_set1_epi32(seuil_carre);
+    long n = 0;
+    long j = 1;
+    for (; j + 32 <= width - 1; j += 32) {
+        __m512i vx = _mm512_loadu_si512((const void*)(gx + j));
+        __m512i vy = _mm512_loadu_si512((const void*)(gy + j));
+        __m512i lo = _mm512_unpacklo_epi16(vx, vy);
+        __m512i hi = _mm512_unpackhi_epi16(vx, vy);
+        n += __builtin_popcount(_mm512_cmpge_epi32_mask(_mm512_madd_epi16(lo, lo), seuil));
+        n += __builtin_popcount(_mm512_cmpge_epi32_mask(_mm512_madd_epi16(hi, hi), seuil));
+    }
+    for (; j <= width - 2; j++) {
+        int32 s = (int32)gx[j] * gx[j] + (int32)gy[j] * gy[j];
+        n += (s >= seuil_carre) ? 1 : 0;
+    }
+    return n;
+}
+
+//16 pixels (48 octets) par itération : désentrelacement r/g/b par pshufb, sommes par psadbw
+//38470 ne tient pas en int16 => 19595 r + 38470 g + 7471 b = 65536 g + 19595 (r-g) + 7471 (b-g)
+//d'où gris = g + ((19595 (r-g) + 7471 (b-g)) >> 16) avec un seul madd sur (r-g, b-g) entrelacés
+__attribute__((target("ssse3")))
+static void rgb_vers_gris_ligne_ssse3(const rgb8 *src, byte *gris, long width, uint64_t sommes[3]) {
+    const byte *p = (const byte*)src;
+    const __m128i r0 = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i r1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+    const __m128i r2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+    const __m128i g0 = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i g1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+    const __m128i g2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+    const __m128i b0 = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i b1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+    const __m128i b2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+    const __m128i poids = _mm_setr_epi16(19595, 7471, 19595, 7471, 19595, 7471, 19595, 7471);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sr = zero, sg = zero, sb = zero;
+    long j = 0;
+    for (; j + 16 <= width; j += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(p + 3 * j));
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + 3 * j + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(p + 3 * j + 32));
+        __m128i vr = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, r0), _mm_shuffle_epi8(b, r1)), _mm_shuffle_epi8(c, r2));
+        __m128i vg = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, g0), _mm_shuffle_epi8(b, g1)), _mm_shuffle_epi8(c, g2));
+        __m128i vb = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, b0), _mm_shuffle_epi8(b, b1)), _mm_shuffle_epi8(c, b2));
+        //sommes des canaux dans les mêmes registres (2 x u64 par canal)
+        sr = _mm_add_epi64(sr, _mm_sad_epu8(vr, zero));
+        sg = _mm_add_epi64(sg, _mm_sad_epu8(vg, zero));
+        sb = _mm_add_epi64(sb, _mm_sad_epu8(vb, zero));
+        __m128i y[2];
+        for (int moitie = 0; moitie < 2; moitie++) {
+            __m128i r16 = moitie ? _mm_unpackhi_epi8(vr, zero) : _mm_unpacklo_epi8(vr, zero);
+            __m128i g16 = moitie ? _mm_unpackhi_epi8(vg, zero) : _mm_unpacklo_epi8(vg, zero);
+            __m128i b16 = moitie ? _mm_unpackhi_epi8(vb, zero) : _mm_unpacklo_epi8(vb, zero);
+            __m128i dr = _mm_sub_epi16(r16, g16);
+            __m128i db = _mm_sub_epi16(b16, g16);
+            __m128i lo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(dr, db), poids), 16);
+            __m128i hi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(dr, db), poids), 16);
+            y[moitie] = _mm_add_epi16(g16, _mm_packs_epi32(lo, hi));
+        }
+        _mm_storeu_si128((__m128i*)(gris + j), _mm_packus_epi16(y[0], y[1]));
+    }
+    uint64_t t[2];
+    _mm_storeu_si128((__m128i*)t, sr); sommes[0] += t[0] + t[1];
+    _mm_storeu_si128((__m128i*)t, sg); sommes[1] += t[0] + t[1];
+    _mm_storeu_si128((__m128i*)t, sb); sommes[2] += t[0] + t[1];
+    if (j < width) rgb_vers_gris_ligne_scalaire(src + j, gris + j, width - j, sommes);
+}
+
+//différence de préfixes + division par mulhi sur 8 (sse2) ou 16 (avx2) lanes uint16
+__attribute__((target("sse2")))
+static void boite_ligne_sse2(const uint16 *prefixe, byte *out, long j0, long j1, int rayon, uint16 mult, int decalage) {
+    const __m128i vm = _mm_set1_epi16((short)mult);
+    const __m128i vd = _mm_cvtsi32_si128(decalage);
+    long j = j0;
+    for (; j + 16 <= j1 + 1; j += 16) {
+        __m128i s0 = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(prefixe + j + rayon + 1)),
+                                   _mm_loadu_si128((const __m128i*)(prefixe + j - rayon)));
+        __m128i s1 = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(prefixe + j + 8 + rayon + 1)),
+                                   _mm_loadu_si128((const __m128i*)(prefixe + j + 8 - rayon)));
+        s0 = _mm_srl_epi16(_mm_mulhi_epu16(s0, vm), vd);
+        s1 = _mm_srl_epi16(_mm_mulhi_epu16(s1, vm), vd);
+        _mm_storeu_si128((__m128i*)(out + j), _mm_packus_epi16(s0, s1));
+    }
+    boite_ligne_scalaire(prefixe, out, j, j1, rayon, mult, decalage);
+}
+
+__attribute__((target("avx2")))
+static void boite_ligne_avx2(const uint16 *prefixe, byte *out, long j0, long j1, int rayon, uint16 mult, int decalage) {
+    const __m256i vm = _mm256_set1_epi16((short)mult);
+    const __m128i vd = _mm_cvtsi32_si128(decalage);
+    long j = j0;
+    for (; j + 32 <= j1 + 1; j += 32) {
+        __m256i s0 = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)(prefixe + j + rayon + 1)),
+                                      _mm256_loadu_si256((const __m256i*)(prefixe + j - rayon)));
+        __m256i s1 = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)(prefixe + j + 16 + rayon + 1)),
+                                      _mm256_loadu_si256((const __m256i*)(prefixe + j + 16 - rayon)));
+        s0 = _mm256_srl_epi16(_mm256_mulhi_epu16(s0, vm), vd);
+        s1 = _mm256_srl_epi16(_mm256_mulhi_epu16(s1, vm), vd);
+        //packus travaille par demi-registre => remise dans l'ordre des lignes
+        __m256i p = _mm256_permute4x64_epi64(_mm256_packus_epi16(s0, s1), 0xD8);
+        _mm256_storeu_si256((__m256i*)(out + j), p);
+    }
+    boite_ligne_sse2(prefixe, out, j, j1, rayon, mult, decalage);
+}
+
+__attribute__((target("sse2")))
+static void norme_ligne_f32_sse2(const int16 *gx, const int16 *gy, float *mn, long width) {
+    const __m128 vmax = _mm_set1_ps(NORME_F32_MAX);
+    long j = 1;
+    for (; j + 8 <= width - 1; j += 8) {
+        __m128i vx = _mm_loadu_si128((const __m128i*)(gx + j));
+        __m128i vy = _mm_loadu_si128((const __m128i*)(gy + j));
+        __m128i lo = _mm_unpacklo_epi16(vx, vy);
+        __m128i hi = _mm_unpackhi_epi16(vx, vy);
+        _mm_storeu_ps(mn + j, _mm_div_ps(_mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(lo, lo))), vmax));
+        _mm_storeu_ps(mn + j + 4, _mm_div_ps(_mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(hi, hi))), vmax));
+    }
+    for (; j <= width - 2; j++) {
+        mn[j] = sqrtf((float)((int32)gx[j] * gx[j] + (int32)gy[j] * gy[j])) / NORME_F32_MAX;
+    }
+    if (width >= 1) mn[0] = mn[width - 1] = 0.0f;
+}
+
+__attribute__((target("avx2")))
+static void norme_ligne_f32_avx2(const int16 *gx, const int16 *gy, float *mn, long width) {
+    const __m256 vmax = _mm256_set1_ps(NORME_F32_MAX);
+    long j = 1;
+    for (; j + 16 <= width - 1; j += 16) {
+        //extension en int32 pour garder l'ordre des pixels (unpack + madd mélange les demi-registres)
+        __m256i vx = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(gx + j)));
+        __m256i vy = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(gy + j)));
+        __m256i wx = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(gx + j + 8)));
+        __m256i wy = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(gy + j + 8)));
+        __m256i s0 = _mm256_add_epi32(_mm256_mullo_epi32(vx, vx), _mm256_mullo_epi32(vy, vy));
+        __m256i s1 = _mm256_add_epi32(_mm256_mullo_epi32(wx, wx), _mm256_mullo_epi32(wy, wy));
+        _mm256_storeu_ps(mn + j, _mm256_div_ps(_mm256_sqrt_ps(_mm256_cvtepi32_ps(s0)), vmax));
+        _mm256_storeu_ps(mn + j + 8, _mm256_div_ps(_mm256_sqrt_ps(_mm256_cvtepi32_ps(s1)), vmax));
+    }
+    for (; j <= width - 2; j++) {
+        mn[j] = sqrtf((float)((int32)gx[j] * gx[j] + (int32)gy[j] * gy[j])) / NORME_F32_MAX;
+    }
+    if (width >= 1) mn[0] = mn[width - 1] = 0.0f;
+}
+
+__attribute__((target("sse2")))
+static void norme_ligne_q16_sse2(const int16 *gx, const int16 *gy, uint16 *mn, long width) {
+    const __m128 ech = _mm_set1_ps(NORME_Q16_ECHELLE);
+    const __m128i biais = _mm_set1_epi32(32768);
+    long j = 1;
+    for (; j + 8 <= width - 1; j += 8) {
+        __m128i vx = _mm_loadu_si128((const __m128i*)(gx + j));
+        __m128i vy = _mm_loadu_si128((const __m128i*)(gy + j));
+        __m128i lo = _mm_unpacklo_epi16(vx, vy);
+        __m128i hi = _mm_unpackhi_epi16(vx, vy);
+        lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(lo, lo))), ech));
+        hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(hi, hi))), ech));
+        //pas de packus_epi32 en sse2 : décalage dans la plage signée puis retour par xor du bit de poids fort
+        __m128i q = _mm_packs_epi32(_mm_sub_epi32(lo, biais), _mm_sub_epi32(hi, biais));
+        _mm_storeu_si128((__m128i*)(mn + j), _mm_xor_si128(q, _mm_set1_epi16((short)0x8000)));
+    }
+    for (; j <= width - 2; j++) {
+        mn[j] = norme_q16((int32)gx[j] * gx[j] + (int32)gy[j] * gy[j]);
+    }
+    if (width >= 1) mn[0] = mn[width - 1] = 0;
+}
+
+#endif
+
+SobelLigneFunc sobel_ligne = sobel_ligne_scalaire;
+ContoursLigneFunc contours_ligne = contours_ligne_scalaire;
+MagnitudeLigneFunc magnitude_ligne_q8 = magnitude_ligne_q8_scalaire;
+RgbVersGrisFunc rgb_vers_gris_ligne = rgb_vers_gris_ligne_scalaire;
+BoiteLigneFunc boite_ligne = boite_ligne_scalaire;
+NormeLigneF32Func norme_ligne_f32 = norme_ligne_f32_scalaire;
+NormeLigneQ16Func norme_ligne_q16 = norme_ligne_q16_scalaire;
+
+//branche les noyaux correspondant au niveau demandé
+static void simd_brancher(int niveau) {
+    niveau_actif = niveau;
+    sobel_ligne = sobel_ligne_scalaire;
+    contours_ligne = contours_ligne_scalaire;
+    magnitude_ligne_q8 = magnitude_ligne_q8_scalaire;
+    rgb_vers_gris_ligne = rgb_vers_gris_ligne_scalaire;
+    boite_ligne = boite_ligne_scalaire;
+    norme_ligne_f32 = norme_ligne_f32_scalaire;
+    norme_ligne_q16 = norme_ligne_q16_scalaire;
+#ifdef SIMD_X86
+    if (niveau >= SIMD_SSE2) norme_ligne_q16 = norme_ligne_q16_sse2;
+    if (niveau == SIMD_SSE2) norme_ligne_f32 = norme_ligne_f32_sse2;
+    if (niveau >= SIMD_AVX2) norme_ligne_f32 = norme_ligne_f32_avx2;
+    if (niveau == SIMD_SSE2) boite_ligne = boite_ligne_sse2;
+    if (niveau >= SIMD_AVX2) boite_ligne = boite_ligne_avx2;
+    //pshufb (SSSE3) toujours présent à partir d'AVX2, le niveau SSE2 garde la version scalaire
+    if (niveau >= SIMD_AVX2) rgb_vers_gris_ligne = rgb_vers_gris_ligne_ssse3;
+    if (niveau == SIMD_SSE2) {
+        sobel_ligne = sobel_ligne_sse2;
+        contours_ligne = contours_ligne_sse2;
+        magnitude_ligne_q8 = magnitude_ligne_q8_sse2;
+    } else if (niveau == SIMD_AVX2) {
+        sobel_ligne = sobel_ligne_avx2;
+        contours_ligne = contours_ligne_avx2;
+        magnitude_ligne_q8 = magnitude_ligne_q8_avx2;
+    } else if (niveau == SIMD_AVX512) {
+        sobel_ligne = sobel_ligne_avx512;
+        contours_ligne = contours_ligne_avx512;
+        magnitude_ligne_q8 = magnitude_ligne_q8_avx512;
+    }
+#endif
+}
+
+//cpuid via le builtin gcc (vérifie aussi que l'OS sauvegarde les registres larges)
+__attribute__((constructor))
+void simd_init(void) {
+    niveau_cpu = SIMD_SCALAIRE;
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) niveau_cpu = SIMD_SSE2;
+    if (__builtin_cpu_supports("avx2")) niveau_cpu = SIMD_AVX2;
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) niveau_cpu = SIMD_AVX512;
+#endif
+    simd_brancher(niveau_cpu);
+}
+
+int simd_forcer(int niveau) {
+    if (niveau < SIMD_SCALAIRE) niveau = SIMD_SCALAIRE;
+    if (niveau > niveau_cpu) niveau = niveau_cpu;
+    simd_brancher(niveau);
+    return niveau;
+}
+
+int simd_niveau(void) {
+    return niveau_actif;
+}
+
+const char *simd_nom(int niveau) {
+    switch (niveau) {
+        case SIMD_SSE2:   return "sse2";
+        case SIMD_AVX2:   return "avx2";
+        case SIMD_AVX512: return "avx512bw";
+        default:          return "scalaire";
+    }
+}
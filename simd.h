@@ -0,0 +1,83 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdint.h>
+#include "nrc/def.h"
+
+//niveaux d'instructions détectés au démarrage (cpuid), du plus simple au plus large
+#define SIMD_SCALAIRE 0
+#define SIMD_SSE2     1
+#define SIMD_AVX2     2
+#define SIMD_AVX512   3  // AVX-512BW (opérations int16 sur 512 bits)
+
+
+//noyau sobel sur une ligne : h/m/b = lignes du haut, du milieu et du bas
+//gx[j], gy[j] pour j = 1..width-2, bords (0 et width-1) mis à 0 ; |gx|,|gy| <= 1020 donc int16 suffit
+typedef void (*SobelLigneFunc)(const byte *h, const byte *m, const byte *b,
+                               int16 *gx, int16 *gy, long width);
+
+//version scalaire = référence, les versions vectorielles doivent donner exactement la même chose
+void sobel_ligne_scalaire(const byte *h, const byte *m, const byte *b, int16 *gx, int16 *gy, long width);
+
+//comptage des contours en entier : pixels j = 1..width-2 tels que gx²+gy² >= seuil_carre
+//seuil_carre = (t_norm * VAL_SOBEL_MAX_THEORIQUE)² => même décision que sqrt(..)/1500 >= t_norm sans racine
+typedef long (*ContoursLigneFunc)(const int16 *gx, const int16 *gy, long width, int32 seuil_carre);
+
+long contours_ligne_scalaire(const int16 *gx, const int16 *gy, long width, int32 seuil_carre);
+
+//somme de sqrt(gx²+gy²) sur j = 1..width-2 en Q8 (1/256 d'unité sobel)
+//racine simple précision sur l'entier exact puis arrondi Q8 : identique quel que soit le niveau simd
+//erreur par pixel <= 0.0021 unité sobel (mesurée exhaustivement sur gx,gy dans [-1020,1020])
+//soit <= 1.4e-6 sur la norme normalisée (/1500) et donc sur la moyenne
+typedef uint64_t (*MagnitudeLigneFunc)(const int16 *gx, const int16 *gy, long width);
+
+uint64_t magnitude_ligne_q8_scalaire(const int16 *gx, const int16 *gy, long width);
+
+//conversion d'une ligne rgb8 (3 octets packés) en gris, virgule fixe 16.16
+//gris = (19595 r + 38470 g + 7471 b) >> 16 (poids de 0.299/0.587/0.114, somme = 65536 donc pas de bornage)
+//diffère de (int)(0.299 r + 0.587 g + 0.114 b) en double d'au plus 1 niveau sur 0.06% des couleurs,
+//dont 65 gris neutres (r=g=b=v) que le calcul double ramène à v-1 alors que la virgule fixe rend v
+//(ces gris neutres abondent dans les vraies images => histogrammes nettement différents, chiffres dans image.h)
+//sommes[0..2] += sommes des canaux r, g, b de la ligne
+typedef void (*RgbVersGrisFunc)(const rgb8 *src, byte *gris, long width, uint64_t sommes[3]);
+
+void rgb_vers_gris_ligne_scalaire(const rgb8 *src, byte *gris, long width, uint64_t sommes[3]);
+
+//passe horizontale du filtre boîte : prefixe[k] = somme des sommes verticales des colonnes 0..k-1 (mod 2^16)
+//out[j] = (prefixe[j+rayon+1] - prefixe[j-rayon]) / diviseur pour j = j0..j1, la somme d'une fenêtre
+//(<= 49*255) tient sur 16 bits donc la différence modulo 2^16 est exacte
+//division par (mulhi(s, mult) >> decalage), exacte pour s <= 255*diviseur (voir filtre_boite_init)
+typedef void (*BoiteLigneFunc)(const uint16 *prefixe, byte *out, long j0, long j1, int rayon,
+                               uint16 mult, int decalage);
+
+void boite_ligne_scalaire(const uint16 *prefixe, byte *out, long j0, long j1, int rayon, uint16 mult, int decalage);
+
+//norme normalisée sqrt(gx²+gy²)/1500 d'une ligne en précision réduite, j = 1..width-2, bords à 0
+//float32 : sqrt et division simple précision, écart au double <= 6e-8 (demi-ulp float)
+//q16 : round(sqrt(gx²+gy²) * 65535/1500) en uint16 (max 63028 < 65535), pas de 1/65535
+#define NORME_F32_MAX      1500.0f
+#define NORME_Q16_ECHELLE  (65535.0f / 1500.0f)
+typedef void (*NormeLigneF32Func)(const int16 *gx, const int16 *gy, float *mn, long width);
+typedef void (*NormeLigneQ16Func)(const int16 *gx, const int16 *gy, uint16 *mn, long width);
+
+void norme_ligne_f32_scalaire(const int16 *gx, const int16 *gy, float *mn, long width);
+void norme_ligne_q16_scalaire(const int16 *gx, const int16 *gy, uint16 *mn, long width);
+
+//noyaux choisis au démarrage selon le cpu
+extern SobelLigneFunc sobel_ligne;
+extern ContoursLigneFunc contours_ligne;
+extern MagnitudeLigneFunc magnitude_ligne_q8;
+extern RgbVersGrisFunc rgb_vers_gris_ligne;
+extern BoiteLigneFunc boite_ligne;
+extern NormeLigneF32Func norme_ligne_f32;
+extern NormeLigneQ16Func norme_ligne_q16;
+
+//détection cpuid et choix des noyaux (appelée automatiquement au chargement)
+void simd_init(void);
+//force un niveau (ex. SIMD_SCALAIRE pour la reproductibilité), borné par ce que le cpu supporte
+//retourne le niveau effectivement retenu
+int simd_forcer(int niveau);
+int simd_niveau(void);
+const char *simd_nom(int niveau);
+
+#endif
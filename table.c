@@ -0,0 +1,126 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "table.h"
+
+static int agrandir(void **colonne, size_t taille, long cap) {
+    void *p = realloc(*colonne, (size_t)cap * taille);
+    if (!p) return -1;
+    *colonne = p;
+    return 0;
+}
+
+//toutes les colonnes à cap lignes ; en cas d'échec les colonnes déjà agrandies le restent (sans effet)
+static int reserver_lignes(TableFeatures *t, long cap) {
+    if (agrandir((void**)&t->hist, 256 * sizeof(double), cap) != 0) return -1;
+    if (agrandir((void**)&t->gradient, sizeof(double), cap) != 0) return -1;
+    if (agrandir((void**)&t->contours, sizeof(double), cap) != 0) return -1;
+    if (agrandir((void**)&t->rouge, sizeof(double), cap) != 0) return -1;
+    if (agrandir((void**)&t->vert, sizeof(double), cap) != 0) return -1;
+    if (agrandir((void**)&t->bleu, sizeof(double), cap) != 0) return -1;
+    if (agrandir((void**)&t->couleur, sizeof(int), cap) != 0) return -1;
+    if (agrandir((void**)&t->largeur, sizeof(long), cap) != 0) return -1;
+    if (agrandir((void**)&t->hauteur, sizeof(long), cap) != 0) return -1;
+    if (agrandir((void**)&t->chemin, sizeof(size_t), cap) != 0) return -1;
+    t->cap = cap;
+    return 0;
+}
+
+int table_features_init(TableFeatures *t, long cap) {
+    memset(t, 0, sizeof(*t));
+    if (cap < 16) cap = 16;
+    if (reserver_lignes(t, cap) != 0) {
+        table_features_liberer(t);
+        return -1;
+    }
+    return 0;
+}
+
+long table_features_ajouter(TableFeatures *t, const char *chemin, const ImageFeatures *feat) {
+    if (t->nb == t->cap && reserver_lignes(t, 2 * t->cap) != 0) return -1;
+    size_t l = strlen(chemin) + 1;
+    if (t->taille_chemins + l > t->cap_chemins) {
+        size_t cap = t->cap_chemins ? 2 * t->cap_chemins : 16384;
+        while (cap < t->taille_chemins + l) cap *= 2;
+        char *p = (char*)realloc(t->chemins, cap);
+        if (!p) return -1;
+        t->chemins = p;
+        t->cap_chemins = cap;
+    }
+    long i = t->nb;
+    memcpy(t->chemins + t->taille_chemins, chemin, l);
+    t->chemin[i] = t->taille_chemins;
+    t->taille_chemins += l;
+    memcpy(t->hist + (size_t)i * 256, feat->hist, 256 * sizeof(double));
+    t->gradient[i] = feat->moyenne_gradient_norme;
+    t->contours[i] = feat->densite_contours;
+    t->rouge[i] = feat->ratio_rouge;
+    t->vert[i] = feat->ratio_vert;
+    t->bleu[i] = feat->ratio_bleu;
+    t->couleur[i] = feat->est_couleur;
+    t->largeur[i] = feat->width;
+    t->hauteur[i] = feat->height;
+    t->nb++;
+    return i;
+}
+
+void table_features_lire(const TableFeatures *t, long id, ImageFeatures *feat) {
+    feat->width = t->largeur[id];
+    feat->height = t->hauteur[id];
+    feat->nrl = 0;
+    feat->nrh = feat->height - 1;
+    feat->ncl = 0;
+    feat->nch = feat->width - 1;
+    feat->moyenne_gradient_norme = t->gradient[id];
+    feat->densite_contours = t->contours[id];
+    feat->ratio_rouge = t->rouge[id];
+    feat->ratio_vert = t->vert[id];
+    feat->ratio_bleu = t->bleu[id];
+    feat->est_couleur = t->couleur[id];
+    memcpy(feat->hist, t->hist + (size_t)id * 256, 256 * sizeof(double));
+}
+
+const char *table_features_chemin(const TableFeatures *t, long id) {
+    return t->chemins + t->chemin[id];
+}
+
+void table_features_liberer(TableFeatures *t) {
+    free(t->hist);
+    free(t->gradient);
+    free(t->contours);
+    free(t->rouge);
+    free(t->vert);
+    free(t->bleu);
+    free(t->couleur);
+    free(t->largeur);
+    free(t->hauteur);
+    free(t->chemins);
+    free(t->chemin);
+    memset(t, 0, sizeof(*t));
+}
+
+//terme poids * |requête - colonne| ajouté à tous les scores
+static void ajouter_ecart(double *scores, const double *colonne, double valeur, double poids, long n) {
+    if (poids == 0.0) return;
+    for (long i = 0; i < n; i++) scores[i] += poids * fabs(valeur - colonne[i]);
+}
+
+void table_features_scores(const TableFeatures *t, const ImageFeatures *requete, DistanceFunc dist_func,
+                           double weight_hist, double weight_r, double weight_g, double weight_b,
+                           double weight_norm, double weight_contour, double weight_color, double *scores) {
+    long n = t->nb;
+    //même ordre d'addition qu'evaluate_score ; un terme de poids nul vaut 0 et n'est pas lu
+    if (weight_hist != 0.0) {
+        for (long i = 0; i < n; i++) scores[i] = weight_hist * dist_func(requete->hist, t->hist + (size_t)i * 256);
+    } else {
+        for (long i = 0; i < n; i++) scores[i] = 0.0;
+    }
+    ajouter_ecart(scores, t->rouge, requete->ratio_rouge, weight_r, n);
+    ajouter_ecart(scores, t->vert, requete->ratio_vert, weight_g, n);
+    ajouter_ecart(scores, t->bleu, requete->ratio_bleu, weight_b, n);
+    ajouter_ecart(scores, t->gradient, requete->moyenne_gradient_norme, weight_norm, n);
+    ajouter_ecart(scores, t->contours, requete->densite_contours, weight_contour, n);
+    if (weight_color != 0.0) {
+        for (long i = 0; i < n; i++) scores[i] += weight_color * ((requete->est_couleur != t->couleur[i]) ? 1.0 : 0.0);
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <stddef.h>
+#include "image.h"
+
+//table des caractéristiques en colonnes, à la place d'un tableau d'ImageFeatures (~2,1 Ko par image,
+//bornes NRC et histogramme mélangés) : une colonne par descripteur scalaire, les histogrammes dans
+//une seule matrice nb x 256 contiguë, les chemins à part (id -> chemin) => un parcours pour une
+//requête ne lit que les colonnes dont le poids est non nul, en pas unitaire
+//histogrammes gardés en double : mêmes distances (DistanceFunc) et mêmes scores qu'evaluate_score
+typedef struct {
+    long nb, cap;
+    double *hist;          // ligne i = histogramme de l'image i (256 valeurs)
+    double *gradient;      // moyenne_gradient_norme
+    double *contours;      // densite_contours
+    double *rouge, *vert, *bleu;
+    int *couleur;          // est_couleur
+    long *largeur, *hauteur;
+    //id -> chemin
+    char *chemins;         // chemins terminés par '\0', les uns à la suite des autres
+    size_t taille_chemins, cap_chemins;
+    size_t *chemin;        // position du chemin i dans chemins
+} TableFeatures;
+
+int  table_features_init(TableFeatures *t, long cap);
+//ajoute une image, retourne son id (0, 1, ...) ou -1 si l'allocation échoue
+long table_features_ajouter(TableFeatures *t, const char *chemin, const ImageFeatures *feat);
+//reconstruit l'ImageFeatures de l'image id (bornes NRC 0..h-1, 0..w-1)
+void table_features_lire(const TableFeatures *t, long id, ImageFeatures *feat);
+const char *table_features_chemin(const TableFeatures *t, long id);
+void table_features_liberer(TableFeatures *t);
+
+//scores[i] = evaluate_score(requete, image i, ...) pour toute la table, colonne par colonne,
+//mêmes termes dans le même ordre => résultats identiques, sans l'affichage de chaque terme
+void table_features_scores(const TableFeatures *t, const ImageFeatures *requete, DistanceFunc dist_func,
+                           double weight_hist, double weight_r, double weight_g, double weight_b,
+                           double weight_norm, double weight_contour, double weight_color, double *scores);
+
+#endif
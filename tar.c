@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "tar.h"
+#include "image.h"
+
+//------------------------------------------------------------------------------------------------
+//en-tête ustar : champs numériques en octal ASCII (ou base 256 GNU si le bit de poids fort est mis)
+
+static int lire_nombre(const byte *champ, int n, uint64_t *v) {
+    uint64_t r = 0;
+    if (champ[0] & 0x80) {
+        //base 256 : grand-boutiste sur le reste du champ, négatif refusé
+        if (champ[0] & 0x40) return -1;
+        r = champ[0] & 0x3F;
+        for (int i = 1; i < n; i++) {
+            if (r >> 56) return -1;
+            r = (r << 8) | champ[i];
+        }
+        *v = r;
+        return 0;
+    }
+    int i = 0;
+    while (i < n && champ[i] == ' ') i++;
+    for (; i < n && champ[i] >= '0' && champ[i] <= '7'; i++) {
+        if (r >> 60) return -1;
+        r = (r << 3) | (uint64_t)(champ[i] - '0');
+    }
+    if (i < n && champ[i] != ' ' && champ[i] != '\0') return -1;
+    *v = r;
+    return 0;
+}
+
+//somme des 512 octets, champ chksum compté comme 8 espaces (non signée ou signée selon les vieux tar)
+static int somme_valide(const byte *h) {
+    uint64_t attendu;
+    if (lire_nombre(h + 148, 8, &attendu) != 0) return 0;
+    long non_signee = 0, signee = 0;
+    for (int i = 0; i < TAR_BLOC; i++) {
+        int c = (i >= 148 && i < 156) ? ' ' : h[i];
+        non_signee += c;
+        signee += (i >= 148 && i < 156) ? ' ' : (signed char)h[i];
+    }
+    return (uint64_t)non_signee == attendu || (uint64_t)signee == attendu;
+}
+
+static int bloc_nul(const byte *h) {
+    for (int i = 0; i < TAR_BLOC; i++) if (h[i]) return 0;
+    return 1;
+}
+
+//enregistrements pax "longueur clé=valeur\n" : seuls path et size servent ici
+static void lire_pax(Tar *tar, const byte *d, size_t n) {
+    size_t pos = 0;
+    while (pos < n) {
+        size_t l = 0, i = pos;
+        while (i < n && d[i] >= '0' && d[i] <= '9' && l < n) l = l * 10 + (size_t)(d[i++] - '0');
+        if (i >= n || d[i] != ' ' || l == 0 || l > n - pos) return;
+        //l doit couvrir "longueur " et finir par '\n' (sinon cle > fin)
+        if (l < i - pos + 2 || d[pos + l - 1] != '\n') return;
+        const char *cle = (const char*)d + i + 1;
+        const char *fin = (const char*)d + pos + l - 1; //'\n'
+        const char *egal = memchr(cle, '=', (size_t)(fin - cle));
+        if (egal) {
+            size_t lc = (size_t)(egal - cle), lv = (size_t)(fin - egal - 1);
+            if (lc == 4 && memcmp(cle, "path", 4) == 0) {
+                if (lv >= sizeof(tar->nom_long)) lv = sizeof(tar->nom_long) - 1;
+                memcpy(tar->nom_long, egal + 1, lv);
+                tar->nom_long[lv] = '\0';
+            } else if (lc == 4 && memcmp(cle, "size", 4) == 0) {
+                char nombre[32];
+                if (lv < sizeof(nombre)) {
+                    memcpy(nombre, egal + 1, lv);
+                    nombre[lv] = '\0';
+                    tar->taille_pax = strtoll(nombre, NULL, 10);
+                }
+            }
+        }
+        pos += l;
+    }
+}
+
+//------------------------------------------------------------------------------------------------
+//accès aux blocs : projection (pointeurs en place) ou flux (copie dans tar->tampon)
+
+static int reserver(Tar *tar, size_t n) {
+    if (n <= tar->cap) return PNM_OK;
+    size_t cap = tar->cap ? tar->cap : 1 << 20;
+    while (cap < n) {
+        if (cap > SIZE_MAX / 2) return PNM_ERR_MEMOIRE;
+        cap *= 2;
+    }
+    byte *p = (byte*)realloc(tar->tampon, cap);
+    if (!p) return PNM_ERR_MEMOIRE;
+    tar->tampon = p;
+    tar->cap = cap;
+    return PNM_OK;
+}
+
+//flux seulement (en projection, lire_contenu avance sans rien lire)
+static int sauter(Tar *tar, uint64_t n) {
+    if (tar->seekable && (n >> 62) == 0) {
+        //fseeko accepte d'aller au-delà de la fin => archive tronquée vue par la taille du fichier
+        off_t ici = ftello(tar->f);
+        if (ici >= 0 && n > (uint64_t)tar->taille - (uint64_t)ici) return PNM_ERR_TRONQUE;
+        if (ici >= 0 && fseeko(tar->f, (off_t)n, SEEK_CUR) == 0) return PNM_OK;
+    }
+    tar->seekable = 0; //tube : on lit pour rien
+    int code = reserver(tar, 1 << 20);
+    if (code != PNM_OK) return code;
+    while (n > 0) {
+        size_t morceau = (n < tar->cap) ? (size_t)n : tar->cap;
+        if (fread(tar->tampon, 1, morceau, tar->f) != morceau) return PNM_ERR_TRONQUE;
+        n -= morceau;
+    }
+    return PNM_OK;
+}
+
+//contenu d'une entrée de n octets (bourrage jusqu'au bloc suivant consommé)
+static int lire_contenu(Tar *tar, uint64_t n, const byte **d) {
+    uint64_t bourrage = (TAR_BLOC - n % TAR_BLOC) % TAR_BLOC;
+    if (tar->map) {
+        if (n > tar->taille - tar->pos) return PNM_ERR_TRONQUE;
+        *d = tar->map + tar->pos;
+        tar->pos += (size_t)n;
+        //dernier bloc sans bourrage toléré
+        tar->pos += (bourrage > tar->taille - tar->pos) ? tar->taille - tar->pos : (size_t)bourrage;
+        return PNM_OK;
+    }
+    if (n > SIZE_MAX - 1) return PNM_ERR_MEMOIRE;
+    int code = reserver(tar, (size_t)n + 1);
+    if (code != PNM_OK) return code;
+    if (fread(tar->tampon, 1, (size_t)n, tar->f) != (size_t)n) return PNM_ERR_TRONQUE;
+    tar->tampon[n] = '\0';
+    *d = tar->tampon;
+    byte reste[TAR_BLOC];
+    if (bourrage && fread(reste, 1, (size_t)bourrage, tar->f) != (size_t)bourrage) return PNM_ERR_TRONQUE;
+    return PNM_OK;
+}
+
+//prochain en-tête : 0 = bloc lu, TAR_FIN = fin de fichier propre, sinon code d'erreur
+static int lire_entete(Tar *tar, byte *h) {
+    if (tar->map) {
+        if (tar->pos == tar->taille) return TAR_FIN;
+        if (tar->taille - tar->pos < TAR_BLOC) return PNM_ERR_TRONQUE;
+        memcpy(h, tar->map + tar->pos, TAR_BLOC);
+        tar->pos += TAR_BLOC;
+        return PNM_OK;
+    }
+    size_t n = fread(h, 1, TAR_BLOC, tar->f);
+    if (n == 0) return TAR_FIN;
+    return (n == TAR_BLOC) ? PNM_OK : PNM_ERR_TRONQUE;
+}
+
+//------------------------------------------------------------------------------------------------
+
+int tar_ouvrir(const char *chemin, int mode, Tar *tar) {
+    memset(tar, 0, sizeof(*tar));
+    tar->taille_pax = -1;
+    int standard = strcmp(chemin, "-") == 0;
+    int fd = standard ? dup(STDIN_FILENO) : open(chemin, O_RDONLY);
+    if (fd < 0) return PNM_ERR_FICHIER;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return PNM_ERR_FICHIER;
+    }
+    if (mode == TAR_MMAP && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            close(fd);
+            tar->map = (byte*)map;
+            tar->taille = (size_t)st.st_size;
+            //un seul passage du début à la fin => lecture anticipée maximale, pages libérées derrière
+            madvise(map, tar->taille, MADV_SEQUENTIAL);
+            return PNM_OK;
+        }
+    }
+    tar->f = fdopen(fd, "rb");
+    if (!tar->f) {
+        close(fd);
+        return PNM_ERR_FICHIER;
+    }
+    tar->seekable = S_ISREG(st.st_mode);
+    if (tar->seekable) tar->taille = (size_t)st.st_size;
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    setvbuf(tar->f, NULL, _IOFBF, 1 << 20);
+    return PNM_OK;
+}
+
+int tar_suivante(Tar *tar, ImagePack *img) {
+    byte h[TAR_BLOC];
+    for (;;) {
+        int code = lire_entete(tar, h);
+        if (code != PNM_OK) return code;
+        //deux blocs nuls terminent l'archive ; un seul suffit ici, la suite n'est pas lue
+        if (bloc_nul(h)) return TAR_FIN;
+        if (!somme_valide(h)) return PNM_ERR_FORMAT;
+
+        uint64_t taille;
+        if (lire_nombre(h + 124, 12, &taille) != 0) return PNM_ERR_FORMAT;
+        if (tar->taille_pax >= 0) taille = (uint64_t)tar->taille_pax;
+        uint64_t bourree = (taille + TAR_BLOC - 1) / TAR_BLOC * TAR_BLOC;
+        char type = (char)h[156];
+
+        if (type == 'x' || type == 'L') {
+            //en-tête étendu pour l'entrée suivante
+            const byte *d;
+            tar->taille_pax = -1;
+            code = lire_contenu(tar, taille, &d);
+            if (code != PNM_OK) return code;
+            if (type == 'x') {
+                lire_pax(tar, d, (size_t)taille);
+            } else {
+                size_t l = strnlen((const char*)d, (size_t)taille);
+                if (l >= sizeof(tar->nom_long)) l = sizeof(tar->nom_long) - 1;
+                memcpy(tar->nom_long, d, l);
+                tar->nom_long[l] = '\0';
+            }
+            continue;
+        }
+
+        //nom : pax / GNU s'il y en avait un, sinon préfixe ustar + nom
+        if (tar->nom_long[0]) {
+            memcpy(tar->nom, tar->nom_long, sizeof(tar->nom));
+        } else if (memcmp(h + 257, "ustar\0", 6) == 0 && h[345]) {
+            snprintf(tar->nom, sizeof(tar->nom), "%.155s/%.100s", (const char*)h + 345, (const char*)h);
+        } else {
+            snprintf(tar->nom, sizeof(tar->nom), "%.100s", (const char*)h);
+        }
+        tar->nom_long[0] = '\0';
+        tar->taille_pax = -1;
+
+        int image_type = -1;
+        if (type == '0' || type == '\0' || type == '7') image_type = image_type_depuis_nom(tar->nom);
+        if (image_type < 0) {
+            //répertoires, liens, en-têtes globaux 'g', fichiers non image
+            const byte *ignore;
+            code = tar->map ? lire_contenu(tar, taille, &ignore) : sauter(tar, bourree);
+            if (code != PNM_OK) return code;
+            continue;
+        }
+        const byte *d;
+        code = lire_contenu(tar, taille, &d);
+        if (code != PNM_OK) return code;
+        img->nom = tar->nom;
+        img->image_type = image_type;
+        img->donnees = d;
+        img->taille = (size_t)taille;
+        return PNM_OK;
+    }
+}
+
+void tar_fermer(Tar *tar) {
+    if (tar->map) munmap(tar->map, tar->taille);
+    if (tar->f) fclose(tar->f);
+    free(tar->tampon);
+    memset(tar, 0, sizeof(*tar));
+}
@@ -0,0 +1,46 @@
+#ifndef TAR_H
+#define TAR_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "nrc/def.h"
+#include "pack.h"
+
+//lecture directe d'une archive tar (ustar, pax, noms longs GNU) sans extraction sur disque :
+//entrées parcourues dans l'ordre du fichier, en une seule lecture séquentielle, et seules les images
+//(même règle de nom que image_type_depuis_nom) sont rendues, avec leur contenu
+//  - fichier régulier + TAR_MMAP : projection => contenu rendu en place (aucune copie)
+//  - sinon (tube, entrée standard "-", ou sans TAR_MMAP) : flux lu par fread, contenu copié dans un
+//    tampon réutilisé ; les entrées ignorées sont sautées par fseeko quand c'est possible
+//archives compressées non gérées : passer par un tube (zcat x.tar.gz | ./main_programme -)
+#define TAR_BLOC   512
+#define TAR_FLUX   0
+#define TAR_MMAP   1
+
+#define TAR_FIN    1  // retour de tar_suivante : plus d'entrée
+
+typedef struct {
+    //projection
+    byte *map;
+    size_t taille;   // taille du fichier (projection, ou flux sur un fichier régulier)
+    size_t pos;
+    //flux
+    FILE *f;
+    int seekable;
+    byte *tampon;
+    size_t cap;
+    //entrée courante
+    char nom[4096];
+    char nom_long[4096]; // chemin donné par l'en-tête pax ou GNU 'L' précédent, vide sinon
+    long long taille_pax; // taille donnée par l'en-tête pax précédent, -1 sinon
+} Tar;
+
+//chemin "-" => entrée standard ; mode TAR_MMAP retombe sur le flux si le fichier n'est pas projetable
+//retourne PNM_OK ou PNM_ERR_FICHIER
+int  tar_ouvrir(const char *chemin, int mode, Tar *tar);
+//image suivante : img->donnees valide jusqu'à l'appel suivant (flux) ou jusqu'à tar_fermer (projection)
+//retourne PNM_OK, TAR_FIN, ou PNM_ERR_FORMAT / PNM_ERR_TRONQUE / PNM_ERR_MEMOIRE (archive abîmée => arrêt)
+int  tar_suivante(Tar *tar, ImagePack *img);
+void tar_fermer(Tar *tar);
+
+#endif
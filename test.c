@@ -5,12 +5,14 @@
 #include <math.h>
 #include <ctype.h>  
 #include "image.h"
+#include "table.h"
 
-Stypedef struct {
-    char filename[256];   $
-    char category[256];    
-    ImageFeatures feat;     
-} DatasetImage;
+//dataset en colonnes (table.h) : caractéristiques et noms dans la table, catégories à part
+//=> le parcours d'une requête ne lit que les colonnes des poids non nuls, pas 2,6 Ko par image
+typedef struct {
+    TableFeatures table;   // id -> nom de fichier dans la table
+    char (*category)[256];
+} Dataset;
 
 
 
@@ -20,17 +22,22 @@ void extract_category(const char *filename, char *category) {
     if (dot) *dot = '\0'; 
     char *num = category;
     while (*num && !isdigit(*num)) num++;  //avance jusquaux chiffre
-    if (num > category) *(num - 1) = '\0';  t
+    if (num > category) *(num - 1) = '\0';
+}
+
+void free_dataset(Dataset *dataset) {
+    table_features_liberer(&dataset->table);
+    free(dataset->category);
 }
 
 /*
  * Charge le dataset depuis un dossier.
- * - Compte les fichiers .pgm.
- * - Alloue un tableau de DatasetImage.
+ * - Compte les fichiers .ppm.
+ * - Alloue la table et les catégories.
  * - Pour chaque fichier, extrait la catégorie et les features.
  * Retour : 0 si succès, -1 si erreur (dossier introuvable).
  */
-int load_dataset(const char *dir_path, DatasetImage **dataset, int *num_images) {
+int load_dataset(const char *dir_path, Dataset *dataset, int *num_images) {
     DIR *dir = opendir(dir_path);
     if (!dir) {
         printf("Erreur : Impossible d'ouvrir le dossier %s\n", dir_path);
@@ -39,16 +46,17 @@ int load_dataset(const char *dir_path, DatasetImage **dataset, int *num_images)
 
     struct dirent *entry;
     *num_images = 0;
-    // Premier passage : compte les fichiers .pgm
+    // Premier passage : compte les fichiers .ppm
     while ((entry = readdir(dir))) {
         if (strstr(entry->d_name, ".ppm")) (*num_images)++;
     }
     rewinddir(dir);  // Remet au début
 
-    // Allocation du tableau
-    *dataset = malloc(*num_images * sizeof(DatasetImage));
-    if (!*dataset) {
+    // Allocation de la table et des catégories
+    dataset->category = malloc((*num_images ? *num_images : 1) * sizeof(*dataset->category));
+    if (!dataset->category || table_features_init(&dataset->table, *num_images) != 0) {
         printf("Erreur : Allocation mémoire échouée\n");
+        free(dataset->category);
         closedir(dir);
         return -1;
     }
@@ -57,15 +65,19 @@ int load_dataset(const char *dir_path, DatasetImage **dataset, int *num_images)
     // Deuxième passage : charge les données
     while ((entry = readdir(dir)) && idx < *num_images) {
         if (strstr(entry->d_name, ".ppm")) {
-            strcpy((*dataset)[idx].filename, entry->d_name);
-            extract_category(entry->d_name, (*dataset)[idx].category);
             char full_path[512];
             sprintf(full_path, "%s/%s", dir_path, entry->d_name);
             // Charge les features ; si échec, ignore l'image
-            if (extraire_features_from_file(full_path, &(*dataset)[idx].feat, 0, 0.25, IMAGE_TYPE_PPM) != 0) {
+            ImageFeatures feat;
+            if (extraire_features_from_file(full_path, &feat, 0, 0.25, IMAGE_TYPE_PPM) != 0) {
                 printf("Erreur extraction features pour %s\n", full_path);
-                idx--;  // Ne compte pas cette image
+                continue;  // Ne compte pas cette image
             }
+            if (table_features_ajouter(&dataset->table, entry->d_name, &feat) < 0) {
+                printf("Erreur : Allocation mémoire échouée\n");
+                break;
+            }
+            extract_category(entry->d_name, dataset->category[idx]);
             idx++;
         }
     }
@@ -79,10 +91,10 @@ int load_dataset(const char *dir_path, DatasetImage **dataset, int *num_images)
  * Trouve les indices des images similaires (même catégorie, différent de la requête).
  * Exemple : Pour "arbre1", retourne indices de "arbre2", "arbre3".
  */
-void get_similar_indices(const DatasetImage *dataset, int num_images, int query_idx, int *similar_indices, int *num_similar) {
+void get_similar_indices(const Dataset *dataset, int num_images, int query_idx, int *similar_indices, int *num_similar) {
     *num_similar = 0;
     for (int i = 0; i < num_images; i++) {
-        if (i != query_idx && strcmp(dataset[i].category, dataset[query_idx].category) == 0) {
+        if (i != query_idx && strcmp(dataset->category[i], dataset->category[query_idx]) == 0) {
             similar_indices[*num_similar] = i;
             (*num_similar)++;
         }
@@ -90,30 +102,24 @@ void get_similar_indices(const DatasetImage *dataset, int num_images, int query_
 }
 
 /*
- * Calcule le top-k images les plus similaires (plus petits scores) pour une requête.
- * - Exclut soi-même.
- * - Utilise evaluate_score avec les poids donnés.
- * - Tri simple : trouve le min k fois.
-*/
-void get_top_k(const DatasetImage *dataset, int num_images, int query_idx, DistanceFunc dist_func,
-               double w_hist, double w_r, double w_g, double w_b, double w_norm, double w_contour, double w_color,
-               int k, int *top_k_indices) {
-    double *scores = malloc(num_images * sizeof(double));
-    if (!scores) {
-        printf("Erreur : Allocation scores échouée\n");
-        return;
-    }
-    // Calcule les scores pour toutes les images
-    for (int i = 0; i < num_images; i++) {
-        if (i == query_idx) {
-            scores[i] = INFINITY;  // Exclut soi-même
-        } else {
-            scores[i] = evaluate_score(&dataset[query_idx].feat, &dataset[i].feat, dist_func,
-                                       w_hist, w_r, w_g, w_b, w_norm, w_contour, w_color);
-        }
-    }
+ * Scores de la requête contre tout le dataset (mêmes valeurs qu'evaluate_score),
+ * calculés colonne par colonne sur la table.
+ */
+void get_scores(const Dataset *dataset, int query_idx, DistanceFunc dist_func,
+                double w_hist, double w_r, double w_g, double w_b, double w_norm, double w_contour, double w_color,
+                double *scores) {
+    ImageFeatures query;
+    table_features_lire(&dataset->table, query_idx, &query);
+    table_features_scores(&dataset->table, &query, dist_func, w_hist, w_r, w_g, w_b, w_norm, w_contour, w_color, scores);
+}
 
-    // Tri pour top-k : trouve les k plus petits scores
+/*
+ * Top-k depuis les scores d'une requête (plus petits scores).
+ * - Exclut soi-même.
+ * - Tri simple : trouve le min k fois (scores modifiés).
+ */
+void get_top_k_scores(double *scores, int num_images, int query_idx, int k, int *top_k_indices) {
+    scores[query_idx] = INFINITY;  // Exclut soi-même
     for (int i = 0; i < k; i++) {
         double min_score = INFINITY;
         int min_idx = -1;
@@ -128,20 +134,34 @@ void get_top_k(const DatasetImage *dataset, int num_images, int query_idx, Dista
             scores[min_idx] = INFINITY;  // Marque comme traité
         }
     }
+}
+
+/*
+ * Calcule le top-k images les plus similaires (plus petits scores) pour une requête.
+ */
+void get_top_k(const Dataset *dataset, int num_images, int query_idx, DistanceFunc dist_func,
+               double w_hist, double w_r, double w_g, double w_b, double w_norm, double w_contour, double w_color,
+               int k, int *top_k_indices) {
+    double *scores = malloc(num_images * sizeof(double));
+    if (!scores) {
+        printf("Erreur : Allocation scores échouée\n");
+        return;
+    }
+    get_scores(dataset, query_idx, dist_func, w_hist, w_r, w_g, w_b, w_norm, w_contour, w_color, scores);
+    get_top_k_scores(scores, num_images, query_idx, k, top_k_indices);
     free(scores);
 }
 
 /*
- * Évalue l'accuracy pour une requête : 1.0 si au moins un similaire est dans top-k, 0.0 sinon.
+ * Accuracy depuis les scores d'une requête : 1.0 si au moins un similaire est dans top-k, 0.0 sinon.
  */
-double evaluate_query(const DatasetImage *dataset, int num_images, int query_idx, DistanceFunc dist_func,
-                      double w_hist, double w_r, double w_g, double w_b, double w_norm, double w_contour, double w_color, int k) {
+double evaluate_query_scores(const Dataset *dataset, int num_images, int query_idx, double *scores, int k) {
     int similar_indices[10];  // Max 10 similaires (suffisant pour 10 images)
     int num_similar;
     get_similar_indices(dataset, num_images, query_idx, similar_indices, &num_similar);
 
     int top_k_indices[10];  // k <= 10
-    get_top_k(dataset, num_images, query_idx, dist_func, w_hist, w_r, w_g, w_b, w_norm, w_contour, w_color, k, top_k_indices);
+    get_top_k_scores(scores, num_images, query_idx, k, top_k_indices);
 
     // Vérifie si un similaire est dans top-k
     for (int i = 0; i < k; i++) {
@@ -152,6 +172,22 @@ double evaluate_query(const DatasetImage *dataset, int num_images, int query_idx
     return 0.0;
 }
 
+/*
+ * Évalue l'accuracy pour une requête : 1.0 si au moins un similaire est dans top-k, 0.0 sinon.
+ */
+double evaluate_query(const Dataset *dataset, int num_images, int query_idx, DistanceFunc dist_func,
+                      double w_hist, double w_r, double w_g, double w_b, double w_norm, double w_contour, double w_color, int k) {
+    double *scores = malloc(num_images * sizeof(double));
+    if (!scores) {
+        printf("Erreur : Allocation scores échouée\n");
+        return 0.0;
+    }
+    get_scores(dataset, query_idx, dist_func, w_hist, w_r, w_g, w_b, w_norm, w_contour, w_color, scores);
+    double acc = evaluate_query_scores(dataset, num_images, query_idx, scores, k);
+    free(scores);
+    return acc;
+}
+
 /*
  * Grid search pour optimiser les poids.
  * - Explore toutes les combinaisons de poids dans les grilles.
@@ -160,11 +196,17 @@ double evaluate_query(const DatasetImage *dataset, int num_images, int query_idx
  * - Affiche les poids optimaux, accuracy, et analyse des échecs.
  */
 void grid_search_cv(const char *dir_path, DistanceFunc dist_func, int k) {
-    DatasetImage *dataset;
+    Dataset dataset;
     int num_images;
     if (load_dataset(dir_path, &dataset, &num_images) != 0) {
         return;  // Erreur déjà affichée
     }
+    double *scores = malloc((num_images ? num_images : 1) * sizeof(double));  // scores d'une requête
+    if (!scores) {
+        printf("Erreur : Allocation scores échouée\n");
+        free_dataset(&dataset);
+        return;
+    }
 
     
     double hist_vals[] = {0.5, 1.0, 1.5, 2.0};     // 5 valeurs (suppression de 2.5)
@@ -204,22 +246,21 @@ void grid_search_cv(const char *dir_path, DistanceFunc dist_func, int k) {
                                 double score_total = 0.0;
                                 // Évalue sur toutes les requêtes
                                 for (int q = 0; q < num_images; q++) {
-                                    double acc = evaluate_query(dataset, num_images, q, dist_func,
-                                                               hist_vals[ih], rgb_vals[ir], rgb_vals[ig], rgb_vals[ib],
-                                                               norm_vals[inn], contour_vals[ico], color_vals[icol], k);
-                                    accuracy += acc;
+                                    // Scores de la requête contre tout le dataset, une seule passe sur les colonnes
+                                    get_scores(&dataset, q, dist_func,
+                                               hist_vals[ih], rgb_vals[ir], rgb_vals[ig], rgb_vals[ib],
+                                               norm_vals[inn], contour_vals[ico], color_vals[icol], scores);
                                     // Score total amélioré : moyenne des scores entre la requête et toutes les autres (plus représentatif)
                                     double local_score = 0.0;
                                     int count = 0;
                                     for (int other = 0; other < num_images; other++) {
                                         if (other != q) {
-                                            local_score += evaluate_score(&dataset[q].feat, &dataset[other].feat, dist_func,
-                                                                          hist_vals[ih], rgb_vals[ir], rgb_vals[ig], rgb_vals[ib],
-                                                                          norm_vals[inn], contour_vals[ico], color_vals[icol]);
+                                            local_score += scores[other];
                                             count++;
                                         }
                                     }
                                     score_total += local_score / count;
+                                    accuracy += evaluate_query_scores(&dataset, num_images, q, scores, k);
                                 }
                                 accuracy /= num_images;
                                 score_total /= num_images;
@@ -278,22 +319,22 @@ void grid_search_cv(const char *dir_path, DistanceFunc dist_func, int k) {
     printf("Requêtes où aucun similaire n'est dans top-%d :\n", k);
     int failed_count = 0;
     for (int q = 0; q < num_images; q++) {
-        double acc = evaluate_query(dataset, num_images, q, dist_func,
+        double acc = evaluate_query(&dataset, num_images, q, dist_func,
                                     best_w_hist, best_w_r, best_w_g, best_w_b, best_w_norm, best_w_contour, best_w_color, k);
         if (acc == 0.0) {
-            printf("  Échec pour %s (catégorie: %s)\n", dataset[q].filename, dataset[q].category);
+            printf("  Échec pour %s (catégorie: %s)\n", table_features_chemin(&dataset.table, q), dataset.category[q]);
             printf("    Attendu (similaires) : ");
             int similar_indices[10];
             int num_similar;
-            get_similar_indices(dataset, num_images, q, similar_indices, &num_similar);
+            get_similar_indices(&dataset, num_images, q, similar_indices, &num_similar);
             for (int j = 0; j < num_similar; j++) {
-                printf("%s ", dataset[similar_indices[j]].filename);
+                printf("%s ", table_features_chemin(&dataset.table, similar_indices[j]));
             }
             printf("\n    Retourné (top-%d) : ", k);
             int top_k_indices[10];
-            get_top_k(dataset, num_images, q, dist_func, best_w_hist, best_w_r, best_w_g, best_w_b, best_w_norm, best_w_contour, best_w_color, k, top_k_indices);
+            get_top_k(&dataset, num_images, q, dist_func, best_w_hist, best_w_r, best_w_g, best_w_b, best_w_norm, best_w_contour, best_w_color, k, top_k_indices);
             for (int i = 0; i < k; i++) {
-                printf("%s ", dataset[top_k_indices[i]].filename);
+                printf("%s ", table_features_chemin(&dataset.table, top_k_indices[i]));
             }
             printf("\n");
             failed_count++;
@@ -305,7 +346,8 @@ void grid_search_cv(const char *dir_path, DistanceFunc dist_func, int k) {
         printf("Suggestion : Augmenter k, ajuster seuil_contour, ou utiliser plus de features.\n");
     }
 
-    free(dataset);
+    free(scores);
+    free_dataset(&dataset);
 }
 
 /*
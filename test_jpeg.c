@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <string.h>
+#include "image.h"
+#include "jpeg.h"
+
+//non-régression du décodeur jpeg sur des segments malformés : chacun doit être refusé proprement
+//(PNM_ERR_FORMAT), sans écriture hors des tables (à lancer aussi sous -fsanitize=address)
+
+//SOI + DHT (une table DC 0, nb[l] codes de longueur l + 1, valeurs 0..total-1) + EOI
+static size_t jpeg_dht(byte *buf, const byte nb[16]) {
+    int total = 0;
+    for (int l = 0; l < 16; l++) total += nb[l];
+    size_t n = 0;
+    buf[n++] = 0xFF; buf[n++] = 0xD8;
+    buf[n++] = 0xFF; buf[n++] = 0xC4;
+    buf[n++] = (byte)((2 + 17 + total) >> 8); buf[n++] = (byte)((2 + 17 + total) & 0xFF);
+    buf[n++] = 0x00;
+    memcpy(buf + n, nb, 16);
+    n += 16;
+    for (int i = 0; i < total; i++) buf[n++] = (byte)i;
+    buf[n++] = 0xFF; buf[n++] = 0xD9;
+    return n;
+}
+
+static int verifier(const char *nom, const byte nb[16]) {
+    byte buf[512];
+    size_t n = jpeg_dht(buf, nb);
+    ImageJPEG img;
+    int code = jpeg_decoder(buf, n, JPEG_ECHELLE_PLEINE, 0, &img);
+    if (code == PNM_OK) jpeg_liberer(&img);
+    printf("%s : %s\n", nom, code == PNM_ERR_FORMAT ? "ok" : "ECHEC");
+    return code == PNM_ERR_FORMAT ? 0 : 1;
+}
+
+int main(void) {
+    int echecs = 0;
+    //255 codes de longueur 1 : la longueur 1 n'en permet que 2
+    byte trop_courts[16] = {255};
+    echecs += verifier("DHT 255 codes de longueur 1", trop_courts);
+    //2 codes de longueur 1 puis 5 de longueur 2 : il ne reste que 2 codes de longueur 2
+    byte deborde[16] = {2, 5};
+    echecs += verifier("DHT longueur 2 débordée", deborde);
+    //3 codes de longueur 1
+    byte trois[16] = {3};
+    echecs += verifier("DHT 3 codes de longueur 1", trois);
+    return echecs != 0;
+}